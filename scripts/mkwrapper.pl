@@ -29,6 +29,8 @@ open(MH, "Murmur.h");
 
 sub func($$\@\@\@) {
   my ($class, $func, $wrapargs, $callargs, $implargs) = @_;
+  # Server calls carry the server id, so they can run on its control thread.
+  my $server = ($class eq "Server") ? ", QString::fromStdString(current.id.name).toInt()" : "";
   
 
   print I qq'
@@ -58,7 +60,7 @@ void ::Murmur::${class}I::${func}_async('. join(", ", @{$wrapargs}).qq') {
 		}
 	}
 #endif
-	ExecEvent *ie = new ExecEvent(boost::bind(&impl_${class}_$func, ' . join(", ", @${callargs}).qq'));
+	ExecEvent *ie = new ExecEvent(boost::bind(&impl_${class}_$func, ' . join(", ", @${callargs}).qq')$server);
 	QCoreApplication::instance()->postEvent(mi, ie);
 }
 ';
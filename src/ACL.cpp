@@ -36,6 +36,7 @@
 #include "User.h"
 
 #ifdef MURMUR
+#include "ACLProgram.h"
 #include "ServerUser.h"
 #endif
 
@@ -83,6 +84,30 @@ QFlags<ChanACL::Perm> ChanACL::effectivePermissions(ServerUser *p, Channel *chan
 		return granted;
 	}
 
+	if (cache && cache->apProgram)
+		granted = cache->apProgram->evaluate(p, chan);
+	else
+		granted = walkPermissions(p, chan);
+
+	if (granted & Write) {
+		granted |= Traverse|Enter|MuteDeafen|Move|MakeChannel|LinkChannel|TextMessage|MakeTempChannel;
+		if (chan->iId == 0)
+			granted |= Kick|Ban|Register|SelfRegister;
+	}
+
+	if (cache) {
+		if (! cache->contains(p))
+			cache->insert(p, new QHash<Channel *, Permissions>);
+
+		cache->value(p)->insert(chan, granted | Cached);
+	}
+
+	return granted;
+}
+
+// Work out permissions by walking the ACLs from the root channel down to chan,
+// not including what Write implies.
+QFlags<ChanACL::Perm> ChanACL::walkPermissions(ServerUser *p, Channel *chan) {
 	QStack<Channel *> chanstack;
 	Channel *ch = chan;
 
@@ -94,7 +119,7 @@ QFlags<ChanACL::Perm> ChanACL::effectivePermissions(ServerUser *p, Channel *chan
 	// Default permissions
 	Permissions def = Traverse | Enter | Speak | Whisper | TextMessage;
 
-	granted = def;
+	Permissions granted = def;
 
 	bool traverse = true;
 	bool write = false;
@@ -139,19 +164,6 @@ QFlags<ChanACL::Perm> ChanACL::effectivePermissions(ServerUser *p, Channel *chan
 		}
 	}
 
-	if (granted & Write) {
-		granted |= Traverse|Enter|MuteDeafen|Move|MakeChannel|LinkChannel|TextMessage|MakeTempChannel;
-		if (chan->iId == 0)
-			granted |= Kick|Ban|Register|SelfRegister;
-	}
-
-	if (cache) {
-		if (! cache->contains(p))
-			cache->insert(p, new QHash<Channel *, Permissions>);
-
-		cache->value(p)->insert(chan, granted | Cached);
-	}
-
 	return granted;
 }
 
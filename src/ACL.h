@@ -37,6 +37,7 @@
 class Channel;
 class User;
 class ServerUser;
+class ACLProgram;
 
 class ChanACL : public QObject {
 	private:
@@ -70,7 +71,16 @@ class ChanACL : public QObject {
 		Q_DECLARE_FLAGS(Permissions, Perm)
 
 		typedef QHash<Channel *, Permissions> ChanCache;
+#ifdef MURMUR
+		/// Permissions per user and channel. Misses are computed by apProgram,
+		/// the compiled ACLs and groups, if there is one.
+		struct ACLCache : public QHash<User *, ChanCache *> {
+			ACLProgram *apProgram;
+			ACLCache() : apProgram(NULL) { }
+		};
+#else
 		typedef QHash<User *, ChanCache * > ACLCache;
+#endif
 
 		Channel *c;
 		bool bApplyHere;
@@ -87,6 +97,7 @@ class ChanACL : public QObject {
 #ifdef MURMUR
 		static bool hasPermission(ServerUser *p, Channel *c, QFlags<Perm> perm, ACLCache *cache);
 		static QFlags<Perm> effectivePermissions(ServerUser *p, Channel *c, ACLCache *cache);
+		static QFlags<Perm> walkPermissions(ServerUser *p, Channel *c);
 #else
 		static QString whatsThis(Perm p);
 #endif
@@ -42,6 +42,8 @@
 #include "SSL.h"
 #include "Mumble.pb.h"
 
+// Largest message buffer that is kept around for the next message.
+#define MAX_CACHED_PACKET 65536
 
 #ifdef Q_OS_WIN
 HANDLE Connection::hQoS = NULL;
@@ -50,6 +52,7 @@ HANDLE Connection::hQoS = NULL;
 Connection::Connection(QObject *p, QSslSocket *qtsSock) : QObject(p) {
 	qtsSocket = qtsSock;
 	qtsSocket->setParent(this);
+	qiodWrite = qtsSocket;
 	iPacketLength = -1;
 	bDisconnectedEmitted = false;
 
@@ -152,11 +155,18 @@ void Connection::socketRead() {
 			return;
 		}
 
-		QByteArray qbaBuffer = qtsSocket->read(iPacketLength);
-		iPacketLength = -1;
+		// Read into the buffer of the previous message. Should a receiver still
+		// hold on to that one, data() detaches and it gets a buffer of its own.
+		qbaPacket.resize(iPacketLength);
+		qtsSocket->read(qbaPacket.data(), iPacketLength);
 		iAvailable -= iPacketLength;
+		iPacketLength = -1;
+
+		emit message(uiType, qbaPacket);
 
-		emit message(uiType, qbaBuffer);
+		// Don't keep the memory of an unusually large message around.
+		if (qbaPacket.capacity() > MAX_CACHED_PACKET)
+			qbaPacket.clear();
 	}
 }
 
@@ -198,7 +208,7 @@ void Connection::sendMessage(const ::google::protobuf::Message &msg, unsigned in
 
 void Connection::sendMessage(const QByteArray &qbaMsg) {
 	if (! qbaMsg.isEmpty())
-		qtsSocket->write(qbaMsg);
+		qiodWrite->write(qbaMsg);
 }
 
 void Connection::forceFlush() {
@@ -210,6 +220,8 @@ void Connection::forceFlush() {
 
 	int nodelay;
 
+	if (qiodWrite != qtsSocket)
+		qiodWrite->waitForBytesWritten(0);
 	qtsSocket->flush();
 
 	nodelay = 1;
@@ -226,6 +238,8 @@ void Connection::disconnectSocket(bool force) {
 
 	if (force)
 		qtsSocket->abort();
+	else if (qiodWrite != qtsSocket)
+		qiodWrite->close();
 	else
 		qtsSocket->disconnectFromHost();
 }
@@ -58,6 +58,10 @@ class Connection : public QObject {
 		Q_DISABLE_COPY(Connection)
 	protected:
 		QSslSocket *qtsSocket;
+		/// Where messages are written to. The socket itself, unless the
+		/// server handed sealing its records to the kernel. Closing it
+		/// disconnects once everything written went out.
+		QIODevice *qiodWrite;
 #if QT_VERSION >= 0x040700
 		QElapsedTimer qtLastPacket;
 #else
@@ -65,6 +69,8 @@ class Connection : public QObject {
 #endif
 		unsigned int uiType;
 		int iPacketLength;
+		/// Payload of the last message read, reused for the next one.
+		QByteArray qbaPacket;
 #ifdef Q_OS_WIN
 		static HANDLE hQoS;
 		DWORD dwFlow;
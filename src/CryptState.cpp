@@ -43,12 +43,207 @@
 
 #include "Net.h"
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && ! defined(__INTEL_COMPILER)
+#define CRYPT_AESNI
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+#define AESNI_TARGET __attribute__((target("aes,ssse3")))
+
+// Interleaving only pays off for voice sized packets; the EVP backend
+// already keeps the cipher busy with the blocks of a longer one.
+#define AESNI_MULTI_LENGTH 128
+
+static bool hasAesNi() {
+	static const bool supported = __builtin_cpu_supports("aes");
+	return supported;
+}
+
+AESNI_TARGET static inline __m128i aesni_key_step(__m128i key, __m128i keygened) {
+	keygened = _mm_shuffle_epi32(keygened, _MM_SHUFFLE(3,3,3,3));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	return _mm_xor_si128(key, keygened);
+}
+
+#define AESNI_KEY_STEP(k, rcon) aesni_key_step(k, _mm_aeskeygenassist_si128(k, rcon))
+
+AESNI_TARGET static void aesni_set_key(const unsigned char *raw, unsigned char *schedule) {
+	__m128i *rk = reinterpret_cast<__m128i *>(schedule);
+	__m128i k = _mm_loadu_si128(reinterpret_cast<const __m128i *>(raw));
+	_mm_storeu_si128(rk++, k);
+	k = AESNI_KEY_STEP(k, 0x01);
+	_mm_storeu_si128(rk++, k);
+	k = AESNI_KEY_STEP(k, 0x02);
+	_mm_storeu_si128(rk++, k);
+	k = AESNI_KEY_STEP(k, 0x04);
+	_mm_storeu_si128(rk++, k);
+	k = AESNI_KEY_STEP(k, 0x08);
+	_mm_storeu_si128(rk++, k);
+	k = AESNI_KEY_STEP(k, 0x10);
+	_mm_storeu_si128(rk++, k);
+	k = AESNI_KEY_STEP(k, 0x20);
+	_mm_storeu_si128(rk++, k);
+	k = AESNI_KEY_STEP(k, 0x40);
+	_mm_storeu_si128(rk++, k);
+	k = AESNI_KEY_STEP(k, 0x80);
+	_mm_storeu_si128(rk++, k);
+	k = AESNI_KEY_STEP(k, 0x1b);
+	_mm_storeu_si128(rk++, k);
+	k = AESNI_KEY_STEP(k, 0x36);
+	_mm_storeu_si128(rk, k);
+}
+
+// Multiplication by x in GF(2^128) of a big-endian block, as S2() does.
+AESNI_TARGET static inline __m128i aesni_double(__m128i x) {
+	const __m128i swap = _mm_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+	__m128i v = _mm_shuffle_epi8(x, swap);
+	__m128i carry = _mm_shuffle_epi32(_mm_srai_epi32(v, 31), _MM_SHUFFLE(3,3,3,3));
+	v = _mm_or_si128(_mm_slli_epi64(v, 1), _mm_slli_si128(_mm_srli_epi64(v, 63), 8));
+	v = _mm_xor_si128(v, _mm_and_si128(carry, _mm_set_epi32(0,0,0,0x87)));
+	return _mm_shuffle_epi8(v, swap);
+}
+
+// Encrypts b[k] with keys[k], the rounds interleaved across all n blocks.
+AESNI_TARGET static inline void aesni_encrypt_n(const unsigned char * const *keys, __m128i *b, unsigned int n) {
+	for (unsigned int k=0;k<n;++k)
+		b[k] = _mm_xor_si128(b[k], _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys[k])));
+	for (int r=1;r<10;++r)
+		for (unsigned int k=0;k<n;++k)
+			b[k] = _mm_aesenc_si128(b[k], _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys[k] + r * AES_BLOCK_SIZE)));
+	for (unsigned int k=0;k<n;++k)
+		b[k] = _mm_aesenclast_si128(b[k], _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys[k] + 10 * AES_BLOCK_SIZE)));
+}
+
+// CryptState::encrypt() for n states at once. The plaintext is shared, so its
+// part of the checksum only has to be computed once.
+AESNI_TARGET static void aesni_encrypt_many(CryptState * const *states, const unsigned char *plain, unsigned char * const *dst, unsigned int len, unsigned int n) {
+	const unsigned char *keys[CRYPT_MULTI];
+	__m128i delta[CRYPT_MULTI], b[CRYPT_MULTI];
+	unsigned char tmp[AES_BLOCK_SIZE];
+	unsigned int offset = 4;
+
+	for (unsigned int k=0;k<n;++k) {
+		unsigned char *iv = states[k]->encrypt_iv;
+		for (int i=0;i<AES_BLOCK_SIZE;i++)
+			if (++iv[i])
+				break;
+		keys[k] = states[k]->aesni_key;
+		b[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(iv));
+	}
+	aesni_encrypt_n(keys, b, n);
+	for (unsigned int k=0;k<n;++k)
+		delta[k] = b[k];
+
+	__m128i sum = _mm_setzero_si128();
+	while (len > AES_BLOCK_SIZE) {
+		__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(plain));
+		for (unsigned int k=0;k<n;++k) {
+			delta[k] = aesni_double(delta[k]);
+			b[k] = _mm_xor_si128(p, delta[k]);
+		}
+		aesni_encrypt_n(keys, b, n);
+		for (unsigned int k=0;k<n;++k)
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst[k] + offset), _mm_xor_si128(b[k], delta[k]));
+		sum = _mm_xor_si128(sum, p);
+		len -= AES_BLOCK_SIZE;
+		plain += AES_BLOCK_SIZE;
+		offset += AES_BLOCK_SIZE;
+	}
+
+	const __m128i bits = _mm_slli_si128(_mm_cvtsi32_si128(len * 8), 15);
+	for (unsigned int k=0;k<n;++k) {
+		delta[k] = aesni_double(delta[k]);
+		b[k] = _mm_xor_si128(bits, delta[k]);
+	}
+	aesni_encrypt_n(keys, b, n);
+	for (unsigned int k=0;k<n;++k) {
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(tmp), b[k]);
+		memcpy(tmp, plain, len);
+		__m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tmp));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(tmp), _mm_xor_si128(t, b[k]));
+		memcpy(dst[k] + offset, tmp, len);
+
+		delta[k] = _mm_xor_si128(aesni_double(delta[k]), delta[k]);
+		b[k] = _mm_xor_si128(delta[k], _mm_xor_si128(sum, t));
+	}
+	aesni_encrypt_n(keys, b, n);
+
+	for (unsigned int k=0;k<n;++k) {
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(tmp), b[k]);
+		dst[k][0] = states[k]->encrypt_iv[0];
+		dst[k][1] = tmp[0];
+		dst[k][2] = tmp[1];
+		dst[k][3] = tmp[2];
+	}
+}
+#endif
+
+static CryptState::Backend bDefaultBackend = CryptState::OpenSSLEVP;
+
 CryptState::CryptState() {
 	for (int i=0;i<0x100;i++)
 		decrypt_history[i] = 0;
 	bInit = false;
 	uiGood=uiLate=uiLost=uiResync=0;
 	uiRemoteGood=uiRemoteLate=uiRemoteLost=uiRemoteResync=0;
+	encrypt_ctx = decrypt_ctx = NULL;
+	bAesNi = false;
+	bBackend = bDefaultBackend;
+}
+
+CryptState::~CryptState() {
+	if (encrypt_ctx)
+		EVP_CIPHER_CTX_free(encrypt_ctx);
+	if (decrypt_ctx)
+		EVP_CIPHER_CTX_free(decrypt_ctx);
+}
+
+CryptState::Backend CryptState::defaultBackend() {
+	return bDefaultBackend;
+}
+
+void CryptState::setDefaultBackend(Backend b) {
+	bDefaultBackend = b;
+}
+
+CryptState::Backend CryptState::backend() const {
+	return bBackend;
+}
+
+void CryptState::setBackend(Backend b) {
+	bBackend = b;
+	if (bInit)
+		initBackend();
+}
+
+void CryptState::initBackend() {
+	bAesNi = false;
+	if (bBackend != OpenSSLEVP)
+		return;
+
+#ifdef CRYPT_AESNI
+	if (hasAesNi()) {
+		aesni_set_key(raw_key, aesni_key);
+		bAesNi = true;
+	}
+#endif
+
+	if (! encrypt_ctx)
+		encrypt_ctx = EVP_CIPHER_CTX_new();
+	if (! decrypt_ctx)
+		decrypt_ctx = EVP_CIPHER_CTX_new();
+
+	// OCB is built on raw ECB blocks, so no padding.
+	if (encrypt_ctx && decrypt_ctx &&
+	        EVP_EncryptInit_ex(encrypt_ctx, EVP_aes_128_ecb(), NULL, raw_key, NULL) &&
+	        EVP_CIPHER_CTX_set_padding(encrypt_ctx, 0) &&
+	        EVP_DecryptInit_ex(decrypt_ctx, EVP_aes_128_ecb(), NULL, raw_key, NULL) &&
+	        EVP_CIPHER_CTX_set_padding(decrypt_ctx, 0))
+		return;
+
+	qWarning("CryptState: Failed to initialize OpenSSL EVP, using reference implementation");
+	bBackend = Reference;
 }
 
 bool CryptState::isValid() const {
@@ -61,6 +256,7 @@ void CryptState::genKey() {
 	RAND_bytes(decrypt_iv, AES_BLOCK_SIZE);
 	AES_set_encrypt_key(raw_key, 128, &encrypt_key);
 	AES_set_decrypt_key(raw_key, 128, &decrypt_key);
+	initBackend();
 	bInit = true;
 }
 
@@ -70,6 +266,7 @@ void CryptState::setKey(const unsigned char *rkey, const unsigned char *eiv, con
 	memcpy(decrypt_iv, div, AES_BLOCK_SIZE);
 	AES_set_encrypt_key(raw_key, 128, &encrypt_key);
 	AES_set_decrypt_key(raw_key, 128, &decrypt_key);
+	initBackend();
 	bInit = true;
 }
 
@@ -234,6 +431,20 @@ static void inline ZERO(keyblock &block) {
 #define AESdecrypt(src,dst,key) AES_decrypt(reinterpret_cast<const unsigned char *>(src),reinterpret_cast<unsigned char *>(dst), key);
 
 void CryptState::ocb_encrypt(const unsigned char *plain, unsigned char *encrypted, unsigned int len, const unsigned char *nonce, unsigned char *tag) {
+	if (bBackend == OpenSSLEVP)
+		ocb_encrypt_evp(plain, encrypted, len, nonce, tag);
+	else
+		ocb_encrypt_ref(plain, encrypted, len, nonce, tag);
+}
+
+void CryptState::ocb_decrypt(const unsigned char *encrypted, unsigned char *plain, unsigned int len, const unsigned char *nonce, unsigned char *tag) {
+	if (bBackend == OpenSSLEVP)
+		ocb_decrypt_evp(encrypted, plain, len, nonce, tag);
+	else
+		ocb_decrypt_ref(encrypted, plain, len, nonce, tag);
+}
+
+void CryptState::ocb_encrypt_ref(const unsigned char *plain, unsigned char *encrypted, unsigned int len, const unsigned char *nonce, unsigned char *tag) {
 	keyblock checksum, delta, tmp, pad;
 
 	// Initialize
@@ -267,7 +478,7 @@ void CryptState::ocb_encrypt(const unsigned char *plain, unsigned char *encrypte
 	AESencrypt(tmp, tag, &encrypt_key);
 }
 
-void CryptState::ocb_decrypt(const unsigned char *encrypted, unsigned char *plain, unsigned int len, const unsigned char *nonce, unsigned char *tag) {
+void CryptState::ocb_decrypt_ref(const unsigned char *encrypted, unsigned char *plain, unsigned int len, const unsigned char *nonce, unsigned char *tag) {
 	keyblock checksum, delta, tmp, pad;
 
 	// Initialize
@@ -300,3 +511,134 @@ void CryptState::ocb_decrypt(const unsigned char *encrypted, unsigned char *plai
 	XOR(tmp, delta, checksum);
 	AESencrypt(tmp, tag, &encrypt_key);
 }
+
+// Number of blocks handed to OpenSSL at once. Lets AES-NI keep several blocks in flight.
+#define OCB_BATCH 16
+
+#define EVPencrypt(src,dst,nblocks) { int outl; EVP_EncryptUpdate(encrypt_ctx, reinterpret_cast<unsigned char *>(dst), &outl, reinterpret_cast<const unsigned char *>(src), (nblocks) * AES_BLOCK_SIZE); }
+#define EVPdecrypt(src,dst,nblocks) { int outl; EVP_DecryptUpdate(decrypt_ctx, reinterpret_cast<unsigned char *>(dst), &outl, reinterpret_cast<const unsigned char *>(src), (nblocks) * AES_BLOCK_SIZE); }
+
+void CryptState::ocb_encrypt_evp(const unsigned char *plain, unsigned char *encrypted, unsigned int len, const unsigned char *nonce, unsigned char *tag) {
+	keyblock checksum, delta, tmp, pad;
+	keyblock deltas[OCB_BATCH];
+	keyblock blocks[OCB_BATCH + 1];
+
+	// Initialize
+	EVPencrypt(nonce, delta, 1);
+	ZERO(checksum);
+
+	// Same as ocb_encrypt_ref(), but the independent block encryptions are
+	// batched. The final pad block rides along with the last batch.
+	while (true) {
+		unsigned int n = 0;
+		while ((len > AES_BLOCK_SIZE) && (n < OCB_BATCH)) {
+			S2(delta);
+			memcpy(deltas[n], delta, AES_BLOCK_SIZE);
+			XOR(blocks[n], delta, reinterpret_cast<const subblock *>(plain));
+			XOR(checksum, checksum, reinterpret_cast<const subblock *>(plain));
+			len -= AES_BLOCK_SIZE;
+			plain += AES_BLOCK_SIZE;
+			++n;
+		}
+
+		const bool last = (len <= AES_BLOCK_SIZE);
+		if (last) {
+			S2(delta);
+			ZERO(blocks[n]);
+			blocks[n][BLOCKSIZE - 1] = SWAPPED(len * 8);
+			XOR(blocks[n], blocks[n], delta);
+		}
+
+		EVPencrypt(blocks, blocks, n + (last ? 1 : 0));
+
+		for (unsigned int i=0;i<n;++i) {
+			XOR(reinterpret_cast<subblock *>(encrypted), deltas[i], blocks[i]);
+			encrypted += AES_BLOCK_SIZE;
+		}
+
+		if (last) {
+			memcpy(pad, blocks[n], AES_BLOCK_SIZE);
+			break;
+		}
+	}
+
+	memcpy(tmp, plain, len);
+	memcpy(reinterpret_cast<unsigned char *>(tmp)+len, reinterpret_cast<const unsigned char *>(pad)+len, AES_BLOCK_SIZE - len);
+	XOR(checksum, checksum, tmp);
+	XOR(tmp, pad, tmp);
+	memcpy(encrypted, tmp, len);
+
+	S3(delta);
+	XOR(tmp, delta, checksum);
+	EVPencrypt(tmp, tag, 1);
+}
+
+void CryptState::ocb_decrypt_evp(const unsigned char *encrypted, unsigned char *plain, unsigned int len, const unsigned char *nonce, unsigned char *tag) {
+	keyblock checksum, delta, tmp, pad;
+	keyblock deltas[OCB_BATCH];
+	keyblock blocks[OCB_BATCH];
+
+	// Initialize
+	EVPencrypt(nonce, delta, 1);
+	ZERO(checksum);
+
+	while (len > AES_BLOCK_SIZE) {
+		unsigned int n = 0;
+		while ((len > AES_BLOCK_SIZE) && (n < OCB_BATCH)) {
+			S2(delta);
+			memcpy(deltas[n], delta, AES_BLOCK_SIZE);
+			XOR(blocks[n], delta, reinterpret_cast<const subblock *>(encrypted));
+			len -= AES_BLOCK_SIZE;
+			encrypted += AES_BLOCK_SIZE;
+			++n;
+		}
+
+		EVPdecrypt(blocks, blocks, n);
+
+		for (unsigned int i=0;i<n;++i) {
+			XOR(reinterpret_cast<subblock *>(plain), deltas[i], blocks[i]);
+			XOR(checksum, checksum, reinterpret_cast<const subblock *>(plain));
+			plain += AES_BLOCK_SIZE;
+		}
+	}
+
+	S2(delta);
+	ZERO(tmp);
+	tmp[BLOCKSIZE - 1] = SWAPPED(len * 8);
+	XOR(tmp, tmp, delta);
+	EVPencrypt(tmp, pad, 1);
+	memset(tmp, 0, AES_BLOCK_SIZE);
+	memcpy(tmp, encrypted, len);
+	XOR(tmp, tmp, pad);
+	XOR(checksum, checksum, tmp);
+	memcpy(plain, tmp, len);
+
+	S3(delta);
+	XOR(tmp, delta, checksum);
+	EVPencrypt(tmp, tag, 1);
+}
+
+void CryptState::encryptMany(CryptState * const *states, const unsigned char *source, unsigned char * const *dst, unsigned int plain_length, unsigned int count) {
+	while (count > 0) {
+		unsigned int n = 0;
+#ifdef CRYPT_AESNI
+		if (plain_length <= AESNI_MULTI_LENGTH)
+			while ((n < count) && (n < CRYPT_MULTI) && states[n]->bAesNi)
+				++n;
+#endif
+		if (n < 2) {
+			states[0]->encrypt(source, dst[0], plain_length);
+			++states;
+			++dst;
+			--count;
+			continue;
+		}
+
+#ifdef CRYPT_AESNI
+		aesni_encrypt_many(states, source, dst, plain_length, n);
+		states += n;
+		dst += n;
+		count -= n;
+#endif
+	}
+}
@@ -32,13 +32,21 @@
 #define MUMBLE_CRYPTSTATE_H_
 
 #include <openssl/aes.h>
+#include <openssl/evp.h>
 
 #include "Timer.h"
 
+/// Maximum number of recipients CryptState::encryptMany() interleaves.
+#define CRYPT_MULTI 8
+
 class CryptState {
 	private:
 		Q_DISABLE_COPY(CryptState)
 	public:
+		/// Block cipher used for OCB. Both produce identical output;
+		/// Reference is the original AES_encrypt() based code.
+		enum Backend { Reference, OpenSSLEVP };
+
 		unsigned char raw_key[AES_BLOCK_SIZE];
 		unsigned char encrypt_iv[AES_BLOCK_SIZE];
 		unsigned char decrypt_iv[AES_BLOCK_SIZE];
@@ -56,21 +64,47 @@ class CryptState {
 
 		AES_KEY	encrypt_key;
 		AES_KEY decrypt_key;
+		EVP_CIPHER_CTX *encrypt_ctx;
+		EVP_CIPHER_CTX *decrypt_ctx;
+		/// AES-128 round keys for the interleaved AES-NI path of encryptMany().
+		unsigned char aesni_key[11 * AES_BLOCK_SIZE];
+		bool bAesNi;
+		Backend bBackend;
 		Timer tLastGood;
 		Timer tLastRequest;
 		bool bInit;
 		CryptState();
+		~CryptState();
+
+		static Backend defaultBackend();
+		static void setDefaultBackend(Backend b);
+		Backend backend() const;
+		void setBackend(Backend b);
 
 		bool isValid() const;
+		/// Number of packets lost before one with the clear IV byte ivbyte, if it is
+		/// for this state; 0 if it is the next packet expected. A hint only.
+		unsigned int ivGap(unsigned char ivbyte) const {
+			return static_cast<unsigned char>(ivbyte - decrypt_iv[0] - 1);
+		};
 		void genKey();
 		void setKey(const unsigned char *rkey, const unsigned char *eiv, const unsigned char *div);
 		void setDecryptIV(const unsigned char *iv);
 
 		void ocb_encrypt(const unsigned char *plain, unsigned char *encrypted, unsigned int len, const unsigned char *nonce, unsigned char *tag);
 		void ocb_decrypt(const unsigned char *encrypted, unsigned char *plain, unsigned int len, const unsigned char *nonce, unsigned char *tag);
+		void ocb_encrypt_ref(const unsigned char *plain, unsigned char *encrypted, unsigned int len, const unsigned char *nonce, unsigned char *tag);
+		void ocb_decrypt_ref(const unsigned char *encrypted, unsigned char *plain, unsigned int len, const unsigned char *nonce, unsigned char *tag);
+		void ocb_encrypt_evp(const unsigned char *plain, unsigned char *encrypted, unsigned int len, const unsigned char *nonce, unsigned char *tag);
+		void ocb_decrypt_evp(const unsigned char *encrypted, unsigned char *plain, unsigned int len, const unsigned char *nonce, unsigned char *tag);
 
 		bool decrypt(const unsigned char *source, unsigned char *dst, unsigned int crypted_length);
 		void encrypt(const unsigned char *source, unsigned char *dst, unsigned int plain_length);
+		/// Encrypts the same plaintext once for each of count states, as if encrypt() was
+		/// called on every one of them. With AES-NI the states are processed interleaved.
+		static void encryptMany(CryptState * const *states, const unsigned char *source, unsigned char * const *dst, unsigned int plain_length, unsigned int count);
+	protected:
+		void initBackend();
 };
 
 #endif
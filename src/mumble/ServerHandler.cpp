@@ -86,6 +86,9 @@ static HANDLE loadQoS() {
 }
 #endif
 
+QHash<QString, QByteArray> ServerHandler::qhSessions;
+QMutex ServerHandler::qmSessions;
+
 ServerHandler::ServerHandler() {
 	cConnection.reset();
 	qusUdp = NULL;
@@ -224,8 +227,8 @@ void ServerHandler::handleVoicePacket(unsigned int msgFlags, PacketDataStream &p
 	}
 }
 
-void ServerHandler::sendMessage(const char *data, int len, bool force) {
-	STACKVAR(unsigned char, crypto, len+4);
+void ServerHandler::sendMessage(const char *data, int len, bool force, bool hint) {
+	STACKVAR(unsigned char, crypto, len+12);
 
 	QMutexLocker qml(&qmUdp);
 
@@ -247,8 +250,16 @@ void ServerHandler::sendMessage(const char *data, int len, bool force) {
 
 		QApplication::postEvent(this, new ServerHandlerMessageEvent(qba, MessageHandler::UDPTunnel, true));
 	} else {
-		connection->csCrypt.encrypt(reinterpret_cast<const unsigned char *>(data), crypto, len);
-		qusUdp->writeDatagram(reinterpret_cast<const char *>(crypto), len + 4, qhaRemote, usPort);
+		// Name our session ahead of the datagram, so a server that hasn't
+		// seen our address yet needn't find us by trial decryption.
+		int offset = 0;
+		if (hint && g.uiSession) {
+			* reinterpret_cast<quint32 *>(& crypto[0]) = 0;
+			* reinterpret_cast<quint32 *>(& crypto[4]) = qToBigEndian(static_cast<quint32>(g.uiSession));
+			offset = 8;
+		}
+		connection->csCrypt.encrypt(reinterpret_cast<const unsigned char *>(data), crypto + offset, len);
+		qusUdp->writeDatagram(reinterpret_cast<const char *>(crypto), len + 4 + offset, qhaRemote, usPort);
 	}
 }
 
@@ -273,14 +284,32 @@ void ServerHandler::run() {
 	bStrong = true;
 	QSslSocket *qtsSock = new QSslSocket(this);
 
+	QByteArray identity;
 	if (! g.s.bSuppressIdentity && CertWizard::validateCert(g.s.kpCertificate)) {
 		qtsSock->setPrivateKey(g.s.kpCertificate.second);
 		qtsSock->setLocalCertificate(g.s.kpCertificate.first.at(0));
 		QList<QSslCertificate> certs = qtsSock->caCertificates();
 		certs << g.s.kpCertificate.first;
 		qtsSock->setCaCertificates(certs);
+		identity = g.s.kpCertificate.first.at(0).digest(QCryptographicHash::Sha1).toHex();
 	}
 
+	qsSessionKey = QString::fromLatin1("%1:%2:%3").arg(qsHostName).arg(usPort).arg(QString::fromLatin1(identity));
+
+#if QT_VERSION >= 0x050200
+	{
+		QSslConfiguration cfg = qtsSock->sslConfiguration();
+		cfg.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+
+		QMutexLocker qml(&qmSessions);
+		const QByteArray session = qhSessions.value(qsSessionKey);
+		if (! session.isEmpty())
+			cfg.setSessionTicket(session);
+
+		qtsSock->setSslConfiguration(cfg);
+	}
+#endif
+
 	{
 		ConnectionPtr connection(new Connection(this, qtsSock));
 		cConnection = connection;
@@ -289,6 +318,10 @@ void ServerHandler::run() {
 		qscCert.clear();
 
 		connect(qtsSock, SIGNAL(encrypted()), this, SLOT(serverConnectionConnected()));
+#if QT_VERSION >= 0x050F00
+		// With TLS 1.3 the ticket only arrives after the handshake.
+		connect(qtsSock, SIGNAL(newSessionTicketReceived()), this, SLOT(sessionTicketReceived()));
+#endif
 		connect(qtsSock, SIGNAL(stateChanged(QAbstractSocket::SocketState)), this, SLOT(serverConnectionStateChanged(QAbstractSocket::SocketState)));
 		connect(connection.get(), SIGNAL(connectionClosed(QAbstractSocket::SocketError, const QString &)), this, SLOT(serverConnectionClosed(QAbstractSocket::SocketError, const QString &)));
 		connect(connection.get(), SIGNAL(message(unsigned int, const QByteArray &)), this, SLOT(message(unsigned int, const QByteArray &)));
@@ -418,7 +451,8 @@ void ServerHandler::sendPing() {
 		PacketDataStream pds(buffer + 1, 255);
 		buffer[0] = MessageHandler::UDPPing << 5;
 		pds << t;
-		sendMessage(reinterpret_cast<const char *>(buffer), pds.size() + 1, true);
+		// Hinted until a datagram from the server shows ours get through.
+		sendMessage(reinterpret_cast<const char *>(buffer), pds.size() + 1, true, cs.uiGood == 0);
 	}
 
 	MumbleProto::Ping mpp;
@@ -545,6 +579,26 @@ void ServerHandler::serverConnectionStateChanged(QAbstractSocket::SocketState st
 	}
 }
 
+void ServerHandler::saveSession(QSslSocket *socket) {
+#if QT_VERSION >= 0x050200
+	if (! socket)
+		return;
+
+	const QByteArray session = socket->sslConfiguration().sessionTicket();
+	if (session.isEmpty())
+		return;
+
+	QMutexLocker qml(&qmSessions);
+	qhSessions.insert(qsSessionKey, session);
+#else
+	Q_UNUSED(socket);
+#endif
+}
+
+void ServerHandler::sessionTicketReceived() {
+	saveSession(qobject_cast<QSslSocket *>(sender()));
+}
+
 void ServerHandler::serverConnectionConnected() {
 	ConnectionPtr connection(cConnection);
 	if (!connection) return;
@@ -557,6 +611,8 @@ void ServerHandler::serverConnectionConnected() {
 	qscCert = connection->peerCertificateChain();
 	qscCipher = connection->sessionCipher();
 
+	saveSession(qobject_cast<QSslSocket *>(sender()));
+
 	if (! qscCert.isEmpty()) {
 		const QSslCertificate &qsc = qscCert.last();
 		qbaDigest = sha1(qsc.publicKey().toDer());
@@ -596,6 +652,7 @@ void ServerHandler::serverConnectionConnected() {
 #else
 	mpa.set_opus(false);
 #endif
+	mpa.set_udp_hint(true);
 	sendMessage(mpa);
 
 	{
@@ -40,6 +40,7 @@
 #endif
 
 #include <QtCore/QEvent>
+#include <QtCore/QHash>
 #include <QtCore/QMutex>
 #include <QtCore/QObject>
 #include <QtCore/QThread>
@@ -95,6 +96,15 @@ class ServerHandler : public QThread {
 		QUdpSocket *qusUdp;
 		QMutex qmUdp;
 
+		/// TLS sessions of earlier connections by qsSessionKey, so that a
+		/// reconnect can resume them instead of doing a full handshake.
+		static QHash<QString, QByteArray> qhSessions;
+		static QMutex qmSessions;
+		/// Server and identity of this connection; a session is only
+		/// resumed for the certificate it was made with.
+		QString qsSessionKey;
+		void saveSession(QSslSocket *socket);
+
 		void handleVoicePacket(unsigned int msgFlags, PacketDataStream &pds, MessageHandler::UDPMessageType type);
 	public:
 		Timer tTimestamp;
@@ -121,7 +131,7 @@ class ServerHandler : public QThread {
 		void customEvent(QEvent *evt) Q_DECL_OVERRIDE;
 
 		void sendProtoMessage(const ::google::protobuf::Message &msg, unsigned int msgType);
-		void sendMessage(const char *data, int len, bool force = false);
+		void sendMessage(const char *data, int len, bool force = false, bool hint = false);
 
 #define MUMBLE_MH_MSG(x) void sendMessage(const MumbleProto:: x &msg) { sendProtoMessage(msg, MessageHandler:: x); }
 		MUMBLE_MH_ALL
@@ -162,6 +172,7 @@ class ServerHandler : public QThread {
 		void serverConnectionStateChanged(QAbstractSocket::SocketState);
 		void serverConnectionClosed(QAbstractSocket::SocketError, const QString &);
 		void setSslErrors(const QList<QSslError> &);
+		void sessionTicketReceived();
 		void udpReady();
 	public slots:
 		void sendPing();
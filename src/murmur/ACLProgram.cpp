@@ -0,0 +1,394 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "ACLProgram.h"
+
+#include "Channel.h"
+#include "Group.h"
+#include "ServerUser.h"
+
+ACLProgram::ACLProgram() {
+}
+
+void ACLProgram::clear() {
+	qhPrograms.clear();
+	qvPredicates.clear();
+	qhTokens.clear();
+	qhHashes.clear();
+	qhGroups.clear();
+	qhMembers.clear();
+}
+
+void ACLProgram::clear(User *p) {
+	qhMembers.remove(static_cast<ServerUser *>(p));
+}
+
+int ACLProgram::predicate(Predicate::Kind kind, Channel *c, const QString &name) {
+	QHash<QString, int> *qh = NULL;
+	QPair<Channel *, QString> key(c, name);
+
+	if (kind == Predicate::AccessToken)
+		qh = &qhTokens;
+	else if (kind == Predicate::CertHash)
+		qh = &qhHashes;
+
+	int bit = qh ? qh->value(name, -1) : qhGroups.value(key, -1);
+	if (bit >= 0)
+		return bit;
+
+	Predicate pr;
+	pr.kind = kind;
+	pr.qsName = name;
+
+	if (kind == Predicate::GroupMember) {
+		QStack<Group *> s;
+		Channel *p = c;
+
+		while (p) {
+			Group *g = p->qhGroups.value(name);
+
+			if (g) {
+				if ((p != c) && ! g->bInheritable)
+					break;
+				s.push(g);
+				if (! g->bInherit)
+					break;
+			}
+
+			p = p->cParent;
+		}
+
+		while (! s.isEmpty())
+			pr.qvGroups << s.pop();
+	}
+
+	bit = qvPredicates.count();
+	qvPredicates << pr;
+
+	if (qh)
+		qh->insert(name, bit);
+	else
+		qhGroups.insert(key, bit);
+
+	return bit;
+}
+
+// Same parsing as Group::isMember(), done once per ACL and channel.
+ACLProgram::Match ACLProgram::compileMatch(Channel *curChan, Channel *aclChan, QString name) {
+	Match m;
+	m.kind = Match::Never;
+	m.bInvert = false;
+	m.cChannel = NULL;
+	m.iBit = -1;
+	m.iMinDepth = m.iMaxDepth = 0;
+
+	bool invert = false;
+	bool token = false;
+	bool hash = false;
+	Channel *c = curChan;
+
+	while (true) {
+		if (name.isEmpty())
+			return m;
+
+		if (name.startsWith(QChar::fromLatin1('!'))) {
+			invert = true;
+			name = name.remove(0,1);
+			continue;
+		}
+
+		if (name.startsWith(QChar::fromLatin1('~'))) {
+			c = aclChan;
+			name = name.remove(0,1);
+			continue;
+		}
+
+		if (name.startsWith(QChar::fromLatin1('#'))) {
+			token = true;
+			name = name.remove(0,1);
+			continue;
+		}
+		if (name.startsWith(QChar::fromLatin1('$'))) {
+			hash = true;
+			name = name.remove(0,1);
+			continue;
+		}
+
+		break;
+	}
+
+	m.bInvert = invert;
+
+	if (token) {
+		m.kind = Match::Member;
+		m.iBit = predicate(Predicate::AccessToken, NULL, name);
+	} else if (hash) {
+		m.kind = Match::Member;
+		m.iBit = predicate(Predicate::CertHash, NULL, name);
+	} else if (name == QLatin1String("none")) {
+		m.kind = Match::Never;
+	} else if (name == QLatin1String("all")) {
+		m.kind = Match::Always;
+	} else if (name == QLatin1String("auth")) {
+		m.kind = Match::Auth;
+	} else if (name == QLatin1String("strong")) {
+		m.kind = Match::Strong;
+	} else if (name == QLatin1String("in")) {
+		m.kind = Match::In;
+		m.cChannel = c;
+	} else if (name == QLatin1String("out")) {
+		m.kind = Match::Out;
+		m.cChannel = c;
+	} else if (name == QLatin1String("sub")
+			|| name.startsWith(QLatin1String("sub,"))) {
+
+		name = name.remove(0,4);
+		int mindesc = 1;
+		int maxdesc = 1000;
+		int minpath = 0;
+		QStringList args = name.split(QLatin1String(","));
+		switch (args.count()) {
+			default:
+			case 3:
+				maxdesc = args[2].isEmpty() ? maxdesc : args[2].toInt();
+			case 2:
+				mindesc = args[1].isEmpty() ? mindesc : args[1].toInt();
+			case 1:
+				minpath = args[0].isEmpty() ? minpath : args[0].toInt();
+			case 0:
+				break;
+		}
+
+		QList<Channel *> groupChain;
+		for (Channel *p = curChan; p; p = p->cParent)
+			groupChain.prepend(p);
+
+		int cofs = groupChain.indexOf(c);
+		Q_ASSERT(cofs != -1);
+
+		cofs += minpath;
+
+		if (cofs >= groupChain.count())
+			return m;
+		else if (cofs < 0)
+			cofs = 0;
+
+		m.kind = Match::Sub;
+		m.cChannel = groupChain[cofs];
+		m.iMinDepth = cofs + mindesc;
+		m.iMaxDepth = cofs + maxdesc;
+	} else {
+		m.kind = Match::Member;
+		m.iBit = predicate(Predicate::GroupMember, c, name);
+		if (qvPredicates.at(m.iBit).qvGroups.isEmpty())
+			m.kind = Match::Never;
+	}
+
+	return m;
+}
+
+void ACLProgram::compile(Channel *chan, QVector<Step> &steps) {
+	QStack<Channel *> chanstack;
+
+	for (Channel *ch = chan; ch; ch = ch->cParent)
+		chanstack.push(ch);
+
+	while (! chanstack.isEmpty()) {
+		Channel *ch = chanstack.pop();
+		bool check = false;
+
+		if (! ch->bInheritACL && ! steps.isEmpty()) {
+			Step s;
+			s.op = Step::Reset;
+			steps << s;
+		}
+
+		foreach(ChanACL *acl, ch->qlACL) {
+			Step s;
+			s.op = Step::Apply;
+			s.iUserId = acl->iUserId;
+			s.m = compileMatch(chan, ch, acl->qsGroup);
+			s.pPathAllow = acl->pAllow & (ChanACL::Traverse | ChanACL::Write);
+			s.pPathDeny = acl->pDeny & (ChanACL::Traverse | ChanACL::Write);
+			s.pAllow = ChanACL::None;
+			s.pDeny = ChanACL::None;
+
+			if (ch->iId == 0 && chan == ch && acl->bApplyHere)
+				s.pAllow |= acl->pAllow & (ChanACL::Kick | ChanACL::Ban | ChanACL::Register | ChanACL::SelfRegister);
+			if ((ch == chan && acl->bApplyHere) || (ch != chan && acl->bApplySubs)) {
+				s.pAllow |= acl->pAllow & ~(ChanACL::Kick | ChanACL::Ban | ChanACL::Register | ChanACL::SelfRegister | ChanACL::Cached);
+				s.pDeny = acl->pDeny;
+			}
+
+			if (! s.pAllow && ! s.pDeny && ! s.pPathAllow && ! s.pPathDeny)
+				continue;
+			if (s.iUserId == -1 && s.m.kind == Match::Never && ! s.m.bInvert)
+				continue;
+
+			steps << s;
+
+			// Only a deny can leave the path without both Traverse and Write.
+			if (s.pPathDeny)
+				check = true;
+		}
+
+		if (check) {
+			Step s;
+			s.op = Step::Check;
+			steps << s;
+		}
+	}
+}
+
+bool ACLProgram::test(int bit, ServerUser *p, Membership &ms) {
+	const int word = bit / 32;
+	const quint32 mask = 1U << (bit % 32);
+
+	if (word >= ms.qvKnown.count()) {
+		ms.qvKnown.resize(word + 1);
+		ms.qvValue.resize(word + 1);
+	} else if (ms.qvKnown.at(word) & mask) {
+		return (ms.qvValue.at(word) & mask) != 0;
+	}
+
+	const Predicate &pr = qvPredicates.at(bit);
+	bool m = false;
+
+	switch (pr.kind) {
+		case Predicate::AccessToken:
+			m = p->qslAccessTokens.contains(pr.qsName, Qt::CaseInsensitive);
+			break;
+		case Predicate::CertHash:
+			m = (p->qsHash == pr.qsName);
+			break;
+		case Predicate::GroupMember:
+			foreach(Group *g, pr.qvGroups) {
+				if (g->qsAdd.contains(p->iId) || g->qsTemporary.contains(p->iId) || g->qsTemporary.contains(- static_cast<int>(p->uiSession)))
+					m = true;
+				if (g->qsRemove.contains(p->iId))
+					m = false;
+			}
+			break;
+	}
+
+	ms.qvKnown[word] |= mask;
+	if (m)
+		ms.qvValue[word] |= mask;
+	return m;
+}
+
+bool ACLProgram::matches(const Match &m, ServerUser *p, Membership &ms) {
+	bool r = false;
+
+	switch (m.kind) {
+		case Match::Never:
+			break;
+		case Match::Always:
+			r = true;
+			break;
+		case Match::Auth:
+			r = (p->iId >= 0);
+			break;
+		case Match::Strong:
+			r = p->bVerified;
+			break;
+		case Match::In:
+			r = (p->cChannel == m.cChannel);
+			break;
+		case Match::Out:
+			r = (p->cChannel != m.cChannel);
+			break;
+		case Match::Sub: {
+				bool found = false;
+				int depth = -1;
+				for (Channel *c = p->cChannel; c; c = c->cParent) {
+					if (c == m.cChannel)
+						found = true;
+					++depth;
+				}
+				r = found && (depth >= m.iMinDepth) && (depth <= m.iMaxDepth);
+			}
+			break;
+		case Match::Member:
+			r = test(m.iBit, p, ms);
+			break;
+	}
+
+	return m.bInvert ? !r : r;
+}
+
+ChanACL::Permissions ACLProgram::evaluate(ServerUser *p, Channel *chan) {
+	QHash<Channel *, QVector<Step> >::const_iterator it = qhPrograms.constFind(chan);
+	if (it == qhPrograms.constEnd()) {
+		QVector<Step> steps;
+		compile(chan, steps);
+		it = qhPrograms.insert(chan, steps);
+	}
+
+	Membership &ms = qhMembers[p];
+	if ((ms.iId != p->iId) || (ms.uiSession != p->uiSession)) {
+		ms.iId = p->iId;
+		ms.uiSession = p->uiSession;
+		ms.qvKnown.clear();
+		ms.qvValue.clear();
+	}
+
+	const ChanACL::Permissions def = ChanACL::Traverse | ChanACL::Enter | ChanACL::Speak | ChanACL::Whisper | ChanACL::TextMessage;
+	ChanACL::Permissions granted = def;
+	ChanACL::Permissions path = ChanACL::Traverse;
+
+	const QVector<Step> &steps = it.value();
+	const Step *s = steps.constData();
+	const Step *end = s + steps.count();
+
+	for (; s != end; ++s) {
+		switch (s->op) {
+			case Step::Reset:
+				granted = def;
+				break;
+			case Step::Apply:
+				if (((s->iUserId != -1) && (s->iUserId == p->iId)) || matches(s->m, p, ms)) {
+					granted = (granted | s->pAllow) & ~s->pDeny;
+					path = (path | s->pPathAllow) & ~s->pPathDeny;
+				}
+				break;
+			case Step::Check:
+				if (! path)
+					return ChanACL::None;
+				break;
+		}
+	}
+
+	return granted;
+}
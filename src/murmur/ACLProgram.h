@@ -0,0 +1,122 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_ACLPROGRAM_H_
+#define MUMBLE_MURMUR_ACLPROGRAM_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+#include <QtCore/QVector>
+
+#include "ACL.h"
+
+class Channel;
+class Group;
+class User;
+class ServerUser;
+
+/// Compiled form of the ACLs and groups of a channel tree, used to fill the
+/// ACL cache. Each channel's chain of ACLs is flattened into a list of steps
+/// with ready-made allow and deny masks, and group names are parsed and
+/// resolved once. Whatever a group test needs from a user is looked up the
+/// first time and kept in that user's membership bitset.
+///
+/// Whoever changes ACLs, groups or the shape of the tree must call clear(),
+/// and clear(User *) when a user's id, access tokens or temporary groups
+/// change. Guarded by the same lock as the ACL cache.
+class ACLProgram {
+	private:
+		Q_DISABLE_COPY(ACLProgram)
+	protected:
+		/// A group name as seen from one channel.
+		struct Match {
+			enum Kind { Never, Always, Auth, Strong, In, Out, Sub, Member };
+			Kind kind;
+			bool bInvert;
+			/// Channel for In and Out, required ancestor for Sub.
+			Channel *cChannel;
+			/// Index in the membership bitset for Member.
+			int iBit;
+			int iMinDepth, iMaxDepth;
+		};
+
+		struct Step {
+			enum Op { Reset, Apply, Check };
+			Op op;
+			int iUserId;
+			Match m;
+			/// Applied to the granted permissions.
+			ChanACL::Permissions pAllow, pDeny;
+			/// Applied to the Traverse and Write state of the path to the channel.
+			ChanACL::Permissions pPathAllow, pPathDeny;
+		};
+
+		/// Something a user either is or isn't, whichever channel asks.
+		struct Predicate {
+			enum Kind { AccessToken, CertHash, GroupMember };
+			Kind kind;
+			QString qsName;
+			/// For GroupMember, the definitions that apply, outermost first.
+			QVector<Group *> qvGroups;
+		};
+
+		struct Membership {
+			int iId;
+			unsigned int uiSession;
+			QVector<quint32> qvKnown;
+			QVector<quint32> qvValue;
+			Membership() : iId(-1), uiSession(0) { }
+		};
+
+		QHash<Channel *, QVector<Step> > qhPrograms;
+		QVector<Predicate> qvPredicates;
+		QHash<QString, int> qhTokens;
+		QHash<QString, int> qhHashes;
+		QHash<QPair<Channel *, QString>, int> qhGroups;
+		QHash<ServerUser *, Membership> qhMembers;
+
+		void compile(Channel *chan, QVector<Step> &steps);
+		Match compileMatch(Channel *curChan, Channel *aclChan, QString name);
+		int predicate(Predicate::Kind kind, Channel *c, const QString &name);
+		bool matches(const Match &m, ServerUser *p, Membership &ms);
+		bool test(int bit, ServerUser *p, Membership &ms);
+	public:
+		ACLProgram();
+		/// Permissions of p in chan, not including what Write implies.
+		ChanACL::Permissions evaluate(ServerUser *p, Channel *chan);
+		/// Drops everything compiled.
+		void clear();
+		/// Drops the membership bits of p.
+		void clear(User *p);
+};
+
+#endif
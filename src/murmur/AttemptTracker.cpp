@@ -0,0 +1,119 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "AttemptTracker.h"
+
+AttemptTracker::AttemptTracker() {
+	clear();
+}
+
+void AttemptTracker::clear() {
+	Slot s;
+	s.uiWindow = s.uiLast = s.uiBanned = 0;
+	s.uiPrevious = s.uiCurrent = 0;
+	s.bUsed = false;
+
+	qvSlots.fill(s, ATTEMPT_SLOTS);
+}
+
+AttemptTracker::Slot *AttemptTracker::find(const HostAddress &address, quint64 now) {
+	const quint32 sets = ATTEMPT_SLOTS / ATTEMPT_WAYS;
+	const quint32 set = (qHash(address) * 0x9e3779b1U) % sets;
+
+	Slot *first = qvSlots.data() + set * ATTEMPT_WAYS;
+	Slot *victim = NULL;
+
+	for (int i=0;i<ATTEMPT_WAYS;++i) {
+		Slot *s = first + i;
+		if (! s->bUsed) {
+			if (! victim || victim->bUsed)
+				victim = s;
+			continue;
+		}
+		if (s->haAddress == address)
+			return s;
+		if (! victim)
+			victim = s;
+		else if (victim->bUsed) {
+			const bool banned = (s->uiBanned > now);
+			const bool victimBanned = (victim->uiBanned > now);
+			if ((victimBanned && ! banned) || ((victimBanned == banned) && (s->uiLast < victim->uiLast)))
+				victim = s;
+		}
+	}
+
+	victim->haAddress = address;
+	victim->uiWindow = now;
+	victim->uiLast = now;
+	victim->uiBanned = 0;
+	victim->uiPrevious = victim->uiCurrent = 0;
+	victim->bUsed = true;
+	return victim;
+}
+
+bool AttemptTracker::attempt(const HostAddress &address, quint64 now, int tries, quint64 timeframe, quint64 bantime) {
+	Slot *s = find(address, now);
+
+	s->uiLast = now;
+
+	if (s->uiBanned) {
+		if (now < s->uiBanned)
+			return true;
+		s->uiBanned = 0;
+	}
+
+	const quint64 elapsed = now - s->uiWindow;
+	if (elapsed >= 2 * timeframe) {
+		s->uiWindow = now;
+		s->uiPrevious = 0;
+		s->uiCurrent = 0;
+	} else if (elapsed >= timeframe) {
+		s->uiWindow += timeframe;
+		s->uiPrevious = s->uiCurrent;
+		s->uiCurrent = 0;
+	}
+
+	++s->uiCurrent;
+
+	const quint64 overlap = timeframe - (now - s->uiWindow);
+	const quint64 estimate = s->uiCurrent + (static_cast<quint64>(s->uiPrevious) * overlap) / timeframe;
+
+	if (estimate > static_cast<quint64>(tries)) {
+		s->uiBanned = now + bantime;
+		s->uiPrevious = s->uiCurrent = 0;
+		s->uiWindow = now;
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,82 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_ATTEMPTTRACKER_H_
+#define MUMBLE_MURMUR_ATTEMPTTRACKER_H_
+
+#include <QtCore/QVector>
+
+#include "Net.h"
+
+/// Addresses tracked at once; the table never grows past this.
+#define ATTEMPT_SLOTS 8192
+/// Slots an address may land in.
+#define ATTEMPT_WAYS 8
+
+/// Counts connection attempts per address in a fixed-size table, for
+/// Meta::banCheck(). Each address keeps the number of attempts in the
+/// current and the previous window, and the rate is estimated by weighing
+/// the previous window by how much of it still overlaps the last timeframe.
+/// An address that goes over the limit is banned for a while.
+///
+/// When all slots an address could use are taken, the one seen least
+/// recently is reused, preferring slots that aren't banned. A flood from
+/// many addresses therefore costs a bounded amount of memory, at the price
+/// of forgetting the quietest of them.
+class AttemptTracker {
+	protected:
+		struct Slot {
+			HostAddress haAddress;
+			/// Start of the current window.
+			quint64 uiWindow;
+			/// Last attempt, for picking slots to reuse.
+			quint64 uiLast;
+			/// End of the ban, or 0 when not banned.
+			quint64 uiBanned;
+			quint32 uiPrevious, uiCurrent;
+			bool bUsed;
+		};
+
+		QVector<Slot> qvSlots;
+
+		Slot *find(const HostAddress &address, quint64 now);
+	public:
+		AttemptTracker();
+		/// Records an attempt from address at now, with all times in
+		/// microseconds. Returns true if address is banned, either already
+		/// or because there were more than tries attempts in the last
+		/// timeframe, in which case it stays banned for bantime.
+		bool attempt(const HostAddress &address, quint64 now, int tries, quint64 timeframe, quint64 bantime);
+		void clear();
+};
+
+#endif
@@ -0,0 +1,226 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "BanIndex.h"
+
+static inline int leadingZeros(quint64 v) {
+#if defined(__GNUC__)
+	return __builtin_clzll(v);
+#else
+	int n = 0;
+	while (! (v & 0x8000000000000000ULL)) {
+		v <<= 1;
+		++n;
+	}
+	return n;
+#endif
+}
+
+static inline int bitAt(const quint64 *key, int i) {
+	if (i < 64)
+		return static_cast<int>((key[0] >> (63 - i)) & 1);
+	return static_cast<int>((key[1] >> (127 - i)) & 1);
+}
+
+static inline int commonBits(const quint64 *a, const quint64 *b) {
+	quint64 v = a[0] ^ b[0];
+	if (v)
+		return leadingZeros(v);
+	v = a[1] ^ b[1];
+	if (v)
+		return 64 + leadingZeros(v);
+	return 128;
+}
+
+static inline void maskKey(quint64 *key, int bits) {
+	if (bits == 0) {
+		key[0] = key[1] = 0ULL;
+	} else if (bits < 64) {
+		key[0] &= ~((1ULL << (64 - bits)) - 1);
+		key[1] = 0ULL;
+	} else if (bits == 64) {
+		key[1] = 0ULL;
+	} else if (bits < 128) {
+		key[1] &= ~((1ULL << (128 - bits)) - 1);
+	}
+}
+
+static inline void toKey(const HostAddress &ha, quint64 *key) {
+	key[0] = SWAP64(ha.addr[0]);
+	key[1] = SWAP64(ha.addr[1]);
+}
+
+BanIndex::BanIndex() {
+	clear();
+}
+
+void BanIndex::clear() {
+	const quint64 root[2] = { 0ULL, 0ULL };
+
+	qvNodes.clear();
+	uiNextExpiry = 0;
+	iCount = 0;
+	addNode(root, 0);
+}
+
+int BanIndex::addNode(const quint64 *key, int bits) {
+	Node n;
+	n.key[0] = key[0];
+	n.key[1] = key[1];
+	n.uiExpires = 0;
+	n.child[0] = n.child[1] = -1;
+	n.iBits = bits;
+	n.bBanned = false;
+	qvNodes.append(n);
+	return qvNodes.count() - 1;
+}
+
+void BanIndex::ban(int node, quint64 expires) {
+	Node &n = qvNodes[node];
+	if (! n.bBanned) {
+		n.bBanned = true;
+		n.uiExpires = expires;
+		++iCount;
+	} else if ((n.uiExpires != 0) && ((expires == 0) || (expires > n.uiExpires))) {
+		n.uiExpires = expires;
+	}
+
+	if ((expires != 0) && ((uiNextExpiry == 0) || (expires < uiNextExpiry)))
+		uiNextExpiry = expires;
+}
+
+void BanIndex::insert(const HostAddress &address, int bits, quint64 expires) {
+	// Masks outside the address would shift out of range below.
+	if ((bits < 0) || (bits > 128))
+		return;
+
+	quint64 key[2];
+	toKey(address, key);
+	maskKey(key, bits);
+
+	int node = 0;
+	forever {
+		if (qvNodes.at(node).iBits == bits) {
+			ban(node, expires);
+			return;
+		}
+
+		const int b = bitAt(key, qvNodes.at(node).iBits);
+		const int next = qvNodes.at(node).child[b];
+
+		if (next < 0) {
+			const int leaf = addNode(key, bits);
+			qvNodes[node].child[b] = leaf;
+			ban(leaf, expires);
+			return;
+		}
+
+		const int nextBits = qvNodes.at(next).iBits;
+		const int common = qMin(commonBits(key, qvNodes.at(next).key), qMin(bits, nextBits));
+
+		if (common == nextBits) {
+			node = next;
+			continue;
+		}
+
+		// The new prefix and next part ways before next's prefix ends, so
+		// next goes below either the new prefix or a new fork.
+		if (common == bits) {
+			const int leaf = addNode(key, bits);
+			qvNodes[leaf].child[bitAt(qvNodes.at(next).key, bits)] = next;
+			qvNodes[node].child[b] = leaf;
+			ban(leaf, expires);
+			return;
+		}
+
+		quint64 forkKey[2] = { key[0], key[1] };
+		maskKey(forkKey, common);
+
+		const int fork = addNode(forkKey, common);
+		const int leaf = addNode(key, bits);
+		qvNodes[fork].child[bitAt(key, common)] = leaf;
+		qvNodes[fork].child[bitAt(qvNodes.at(next).key, common)] = next;
+		qvNodes[node].child[b] = fork;
+		ban(leaf, expires);
+		return;
+	}
+}
+
+void BanIndex::rebuild(const QList<Ban> &bans) {
+	clear();
+	qvNodes.reserve(bans.count() * 2 + 1);
+	foreach(const Ban &ban, bans)
+		if (ban.isValid())
+			insert(ban.haAddress, ban.iMask, expiry(ban));
+}
+
+bool BanIndex::match(const HostAddress &address, quint64 timestamp) const {
+	quint64 key[2];
+	toKey(address, key);
+
+	const Node *nodes = qvNodes.constData();
+	const Node *n = nodes;
+	forever {
+		if (n->bBanned && ((n->uiExpires == 0) || (timestamp <= n->uiExpires)))
+			return true;
+		if (n->iBits == 128)
+			return false;
+
+		const int next = n->child[bitAt(key, n->iBits)];
+		if (next < 0)
+			return false;
+
+		n = nodes + next;
+		if (commonBits(key, n->key) < n->iBits)
+			return false;
+	}
+}
+
+quint64 BanIndex::nextExpiry() const {
+	return uiNextExpiry;
+}
+
+int BanIndex::count() const {
+	return iCount;
+}
+
+quint64 BanIndex::expiry(const Ban &ban) {
+	if (ban.iDuration == 0)
+		return 0;
+	return static_cast<quint64>(ban.qdtStart.toTime_t()) + ban.iDuration;
+}
+
+quint64 BanIndex::now() {
+	return QDateTime::currentDateTime().toUTC().toTime_t();
+}
@@ -0,0 +1,85 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_BANINDEX_H_
+#define MUMBLE_MURMUR_BANINDEX_H_
+
+#include <QtCore/QList>
+#include <QtCore/QVector>
+
+#include "Net.h"
+
+/// Address bans of a server as a path-compressed binary trie over the 128
+/// bit address, so checking a connecting address costs one walk down the
+/// trie instead of a HostAddress::match() per ban. IPv4 bans live under the
+/// v4-mapped prefix like everywhere else. Each prefix keeps the latest
+/// expiry of the bans on it.
+///
+/// The index is rebuilt from Server::qlBans whenever that changes.
+class BanIndex {
+	protected:
+		struct Node {
+			/// Prefix, masked to iBits, in host byte order.
+			quint64 key[2];
+			/// Time the bans on this prefix expire, in seconds since the epoch, or 0 for never.
+			quint64 uiExpires;
+			int child[2];
+			int iBits;
+			bool bBanned;
+		};
+
+		QVector<Node> qvNodes;
+		quint64 uiNextExpiry;
+		int iCount;
+
+		int addNode(const quint64 *key, int bits);
+		void ban(int node, quint64 expires);
+	public:
+		BanIndex();
+		void clear();
+		/// Bans the first bits bits of address. Does nothing unless bits is
+		/// between 0 and 128.
+		void insert(const HostAddress &address, int bits, quint64 expires);
+		/// Indexes the valid ones of bans, see Ban::isValid().
+		void rebuild(const QList<Ban> &bans);
+		/// Whether address falls under a ban that hasn't expired at now.
+		bool match(const HostAddress &address, quint64 now) const;
+		/// Earliest expiry of any temporary ban, or 0 if there are none.
+		quint64 nextExpiry() const;
+		/// Number of distinct banned prefixes.
+		int count() const;
+
+		static quint64 expiry(const Ban &ban);
+		static quint64 now();
+};
+
+#endif
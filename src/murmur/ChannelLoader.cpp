@@ -0,0 +1,143 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "murmur_pch.h"
+
+#include "ChannelLoader.h"
+
+#include "ACL.h"
+#include "Channel.h"
+#include "Group.h"
+#include "ServerDB.h"
+
+const char *ChannelLoader::sqlChannels = "SELECT `channel_id`, `parent_id`, `name`, `inheritacl` FROM `%1channels` WHERE `server_id` = ? ORDER BY `name`";
+const char *ChannelLoader::sqlInfo = "SELECT `channel_id`, `key`, `value` FROM `%1channel_info` WHERE `server_id` = ?";
+const char *ChannelLoader::sqlGroups = "SELECT `group_id`, `channel_id`, `name`, `inherit`, `inheritable` FROM `%1groups` WHERE `server_id` = ?";
+const char *ChannelLoader::sqlGroupMembers = "SELECT `group_id`, `user_id`, `addit` FROM `%1group_members` WHERE `server_id` = ?";
+// Sorting by priority alone keeps each channel's ACLs in order.
+const char *ChannelLoader::sqlACL = "SELECT `channel_id`, `user_id`, `group_name`, `apply_here`, `apply_sub`, `grantpriv`, `revokepriv` FROM `%1acl` WHERE `server_id` = ? ORDER BY `priority`";
+const char *ChannelLoader::sqlLinks = "SELECT `channel_id`, `link_id` FROM `%1channel_links` WHERE `server_id` = ?";
+
+ChannelLoader::ChannelLoader(QHash<int, Channel *> &channels, QObject *root) : qhChannels(channels), qoRoot(root) {
+}
+
+void ChannelLoader::addChannels(QSqlQuery &query) {
+	// Children of every channel, ordered by name. Root channels are listed under -1.
+	QHash<int, QList<Row> > qhChildren;
+
+	while (query.next()) {
+		Row r;
+		r.iId = query.value(0).toInt();
+		r.qsName = query.value(2).toString();
+		r.bInheritACL = query.value(3).toBool();
+		qhChildren[query.value(1).isNull() ? -1 : query.value(1).toInt()] << r;
+	}
+
+	QList<Channel *> pending;
+	pending << NULL;
+	while (! pending.isEmpty()) {
+		Channel *p = pending.takeFirst();
+		foreach(const Row &r, qhChildren.value(p ? p->iId : -1)) {
+			if (qhChannels.contains(r.iId))
+				continue;
+			Channel *c = new Channel(r.iId, r.qsName, p);
+			if (! p)
+				c->setParent(qoRoot);
+			c->bInheritACL = r.bInheritACL;
+			qhChannels.insert(c->iId, c);
+			pending << c;
+		}
+	}
+}
+
+void ChannelLoader::addInfo(QSqlQuery &query) {
+	while (query.next()) {
+		Channel *c = qhChannels.value(query.value(0).toInt());
+		if (! c)
+			continue;
+		int key = query.value(1).toInt();
+		const QString &value = query.value(2).toString();
+		if (key == ServerDB::Channel_Description) {
+			c->qsDesc = value;
+		} else if (key == ServerDB::Channel_Position) {
+			c->iPosition = QVariant(value).toInt(); // If the conversion fails it'll return the default value 0
+		}
+	}
+}
+
+void ChannelLoader::addGroups(QSqlQuery &query) {
+	while (query.next()) {
+		Channel *c = qhChannels.value(query.value(1).toInt());
+		if (! c)
+			continue;
+		Group *g = new Group(c, query.value(2).toString());
+		g->bInherit = query.value(3).toBool();
+		g->bInheritable = query.value(4).toBool();
+		qhGroups.insert(query.value(0).toInt(), g);
+	}
+}
+
+void ChannelLoader::addGroupMembers(QSqlQuery &query) {
+	while (query.next()) {
+		Group *g = qhGroups.value(query.value(0).toInt());
+		if (! g)
+			continue;
+		int uid = query.value(1).toInt();
+		if (query.value(2).toBool())
+			g->qsAdd << uid;
+		else
+			g->qsRemove << uid;
+	}
+}
+
+void ChannelLoader::addACLs(QSqlQuery &query) {
+	while (query.next()) {
+		Channel *c = qhChannels.value(query.value(0).toInt());
+		if (! c)
+			continue;
+		ChanACL *acl = new ChanACL(c);
+		acl->iUserId = query.value(1).isNull() ? -1 : query.value(1).toInt();
+		acl->qsGroup = query.value(2).toString();
+		acl->bApplyHere = query.value(3).toBool();
+		acl->bApplySubs = query.value(4).toBool();
+		acl->pAllow = static_cast<ChanACL::Permissions>(query.value(5).toInt());
+		acl->pDeny = static_cast<ChanACL::Permissions>(query.value(6).toInt());
+	}
+}
+
+void ChannelLoader::addLinks(QSqlQuery &query) {
+	while (query.next()) {
+		Channel *c = qhChannels.value(query.value(0).toInt());
+		Channel *l = qhChannels.value(query.value(1).toInt());
+		if (c && l)
+			c->link(l);
+	}
+}
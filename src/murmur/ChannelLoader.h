@@ -0,0 +1,89 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MUMBLE_MURMUR_CHANNELLOADER_H_
+#define MUMBLE_MURMUR_CHANNELLOADER_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+class Channel;
+class Group;
+class QObject;
+class QSqlQuery;
+
+/// Assembles a server's channel tree from its channels, channel_info,
+/// groups, group_members, acl and channel_links tables, each read with a
+/// single query, so the number of round trips to the database doesn't grow
+/// with the number of channels. The caller prepares the SQL given here,
+/// binds the server number to it, executes it and passes the query on.
+///
+/// Used by Server::readChannels() and readLinks(), and by tests/BootLoad.
+class ChannelLoader {
+	private:
+		Q_DISABLE_COPY(ChannelLoader)
+	protected:
+		/// A row of the channels table, kept until its parent exists.
+		struct Row {
+			int iId;
+			QString qsName;
+			bool bInheritACL;
+		};
+
+		QHash<int, Channel *> &qhChannels;
+		QObject *qoRoot;
+		QHash<int, Group *> qhGroups;
+	public:
+		static const char *sqlChannels;
+		static const char *sqlInfo;
+		static const char *sqlGroups;
+		static const char *sqlGroupMembers;
+		static const char *sqlACL;
+		static const char *sqlLinks;
+
+		/// Root channels get root as their QObject parent.
+		ChannelLoader(QHash<int, Channel *> &channels, QObject *root);
+		/// Creates the channels, in name order below each parent. Channels
+		/// that can't be reached from a root channel are skipped, and only
+		/// the first of several rows with the same id counts.
+		void addChannels(QSqlQuery &query);
+		/// Sets descriptions and positions. Descriptions are assigned as is;
+		/// the caller works out their hashes.
+		void addInfo(QSqlQuery &query);
+		void addGroups(QSqlQuery &query);
+		/// Needs addGroups() first.
+		void addGroupMembers(QSqlQuery &query);
+		void addACLs(QSqlQuery &query);
+		void addLinks(QSqlQuery &query);
+};
+
+#endif
@@ -0,0 +1,64 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_DBWORKER_H_
+#define MUMBLE_MURMUR_DBWORKER_H_
+
+#include <QtCore/QMutex>
+#include <QtCore/QQueue>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+#include <boost/function.hpp>
+
+/// Runs database jobs on a thread with its own connection, so slow queries
+/// and password hashing don't hold up the server's event loop. Jobs hand
+/// their results back by posting an ExecEvent to the server.
+class DBWorker : public QThread {
+	private:
+		Q_DISABLE_COPY(DBWorker)
+	protected:
+		QString qsConnection;
+		QMutex qmJobs;
+		QWaitCondition qwcJobs;
+		QQueue<boost::function<void ()> > qqJobs;
+		bool bStop;
+		void run();
+	public:
+		DBWorker(const QString &connection, QObject *p = NULL);
+		~DBWorker();
+		/// Queues job, starting the thread on first use.
+		void post(const boost::function<void ()> &job);
+		/// Runs the jobs already queued, then ends the thread.
+		void stop();
+};
+
+#endif
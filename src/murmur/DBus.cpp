@@ -536,7 +536,7 @@ void MurmurDBus::setACL(int id, const QList<ACLInfo> &acls, const QList<GroupInf
 		a->pAllow = static_cast<ChanACL::Permissions>(ai.allow) & ChanACL::All;
 	}
 
-	server->clearACLCache();
+	server->clearACLCache(cChannel);
 	server->updateChannel(cChannel);
 }
 
@@ -866,7 +866,9 @@ void MetaDBus::setConf(int server_id, const QString &key, const QString &value,
 	} else {
 		ServerDB::setConf(server_id, key, value);
 		Server *s = meta->qhServers.value(server_id);
-		if (s)
+		if (s && (s->thread() != thread()))
+			QCoreApplication::instance()->postEvent(s, new ExecEvent(boost::bind(&Server::setLiveConf, s, key, value)));
+		else if (s)
 			s->setLiveConf(key, value);
 	}
 }
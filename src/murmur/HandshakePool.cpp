@@ -0,0 +1,213 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "HandshakePool.h"
+
+#include "Meta.h"
+#include "Server.h"
+
+Handshake::Handshake(HandshakePool *pool, Server *owner, QSslSocket *socket) : QObject() {
+	hpPool = pool;
+	sOwner = owner;
+	qssSocket = socket;
+	qssSocket->setParent(this);
+	qhaPeer = socket->peerAddress();
+	usPeerPort = socket->peerPort();
+	qtTimeout = new QTimer(this);
+	qtTimeout->setSingleShot(true);
+	bVerified = true;
+	bDone = false;
+
+	connect(qssSocket, SIGNAL(encrypted()), this, SLOT(encrypted()));
+	connect(qssSocket, SIGNAL(sslErrors(const QList<QSslError> &)), this, SLOT(sslErrors(const QList<QSslError> &)));
+	connect(qssSocket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(error(QAbstractSocket::SocketError)));
+	connect(qtTimeout, SIGNAL(timeout()), this, SLOT(timeout()));
+}
+
+Server *Handshake::owner() const {
+	return sOwner;
+}
+
+const QHostAddress &Handshake::peerAddress() const {
+	return qhaPeer;
+}
+
+quint16 Handshake::peerPort() const {
+	return usPeerPort;
+}
+
+void Handshake::start() {
+	// Clients that never finish would otherwise hold on to the socket, as
+	// Server::checkTimeout() only sees connections once they're handed over.
+	qtTimeout->start(Meta::mp.iTimeout * 1000);
+	qssSocket->startServerEncryption();
+	sOwner->tkTickets.install(qssSocket);
+}
+
+void Handshake::abort() {
+	finish(QString());
+}
+
+void Handshake::timeout() {
+	finish(QLatin1String("Timed out"));
+}
+
+void Handshake::error(QAbstractSocket::SocketError) {
+	finish(qssSocket->errorString());
+}
+
+void Handshake::sslErrors(const QList<QSslError> &errors) {
+	QList<QSslError> fatal;
+	if (Server::checkSslErrors(errors, bVerified, fatal)) {
+		qssSocket->ignoreSslErrors();
+	} else {
+		QStringList qsl;
+		foreach(const QSslError &e, fatal)
+			qsl << e.errorString();
+		finish(QString::fromLatin1("SSL Error: %1").arg(qsl.join(QLatin1String(", "))));
+	}
+}
+
+void Handshake::encrypted() {
+	if (bDone)
+		return;
+	bDone = true;
+
+	qtTimeout->stop();
+	qssSocket->disconnect(this);
+
+	if (hpPool->finished(this, qssSocket, bVerified, QString()))
+		qssSocket = NULL;
+	else
+		qssSocket->abort();
+
+	deleteLater();
+}
+
+void Handshake::finish(const QString &reason) {
+	if (bDone)
+		return;
+	bDone = true;
+
+	qtTimeout->stop();
+	qssSocket->disconnect(this);
+	qssSocket->abort();
+
+	hpPool->finished(this, NULL, false, reason);
+	deleteLater();
+}
+
+HandshakePool::HandshakePool(int threads) {
+	iThreads = qMax(threads, 0);
+	iNext = 0;
+}
+
+HandshakePool::~HandshakePool() {
+	foreach(QThread *t, qlThreads) {
+		t->quit();
+		t->wait();
+		delete t;
+	}
+}
+
+bool HandshakePool::isEnabled() const {
+	return iThreads > 0;
+}
+
+bool HandshakePool::start(Server *owner, QSslSocket *socket) {
+	QMutexLocker qml(&qmHandshakes);
+
+	if (qsClosed.contains(owner))
+		return false;
+
+	if (qlThreads.isEmpty()) {
+		for (int i=0;i<iThreads;++i) {
+			QThread *t = new QThread();
+			t->start();
+			qlThreads << t;
+		}
+	}
+
+	Handshake *h = new Handshake(this, owner, socket);
+	h->moveToThread(qlThreads.at(iNext));
+	iNext = (iNext + 1) % qlThreads.count();
+
+	qmhActive.insert(owner, h);
+	QMetaObject::invokeMethod(h, "start", Qt::QueuedConnection);
+	return true;
+}
+
+bool HandshakePool::finished(Handshake *h, QSslSocket *socket, bool verified, const QString &reason) {
+	QMutexLocker qml(&qmHandshakes);
+
+	Server *owner = h->owner();
+	qmhActive.remove(owner, h);
+	qwcDone.wakeAll();
+
+	if (qsClosed.contains(owner))
+		return false;
+
+	// Posted while holding the lock, so close() can't let the owner go
+	// before the event is queued. Likewise the owner only changes threads
+	// after close().
+	if (socket) {
+		socket->setParent(NULL);
+		socket->moveToThread(owner->thread());
+
+		HandshakeResultPtr hr(new HandshakeResult());
+		hr->qssSocket = socket;
+		hr->bVerified = verified;
+		QCoreApplication::instance()->postEvent(owner, new ExecEvent(boost::bind(&Server::adoptClient, owner, hr)));
+	} else {
+		QCoreApplication::instance()->postEvent(owner, new ExecEvent(boost::bind(&Server::handshakeFailed, owner, h->peerAddress(), h->peerPort(), reason)));
+	}
+	return true;
+}
+
+void HandshakePool::close(const Server *owner) {
+	QMutexLocker qml(&qmHandshakes);
+
+	qsClosed.insert(owner);
+
+	foreach(Handshake *h, qmhActive.values(owner))
+		QMetaObject::invokeMethod(h, "abort", Qt::QueuedConnection);
+
+	while (qmhActive.contains(owner))
+		qwcDone.wait(&qmHandshakes);
+}
+
+void HandshakePool::forget(const Server *owner) {
+	QMutexLocker qml(&qmHandshakes);
+	qsClosed.remove(owner);
+}
@@ -0,0 +1,122 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_HANDSHAKEPOOL_H_
+#define MUMBLE_MURMUR_HANDSHAKEPOOL_H_
+
+#include <QtCore/QList>
+#include <QtCore/QMultiHash>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QSet>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+#include <QtCore/QWaitCondition>
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QSslError>
+#include <QtNetwork/QSslSocket>
+
+class Server;
+class HandshakePool;
+
+/// The TLS handshake of one new connection, run on a thread of
+/// HandshakePool. Deletes itself once the handshake is over.
+class Handshake : public QObject {
+	private:
+		Q_OBJECT
+		Q_DISABLE_COPY(Handshake)
+	protected:
+		HandshakePool *hpPool;
+		Server *sOwner;
+		QSslSocket *qssSocket;
+		QHostAddress qhaPeer;
+		quint16 usPeerPort;
+		QTimer *qtTimeout;
+		bool bVerified;
+		bool bDone;
+		void finish(const QString &reason);
+	public:
+		Handshake(HandshakePool *pool, Server *owner, QSslSocket *socket);
+		Server *owner() const;
+		const QHostAddress &peerAddress() const;
+		quint16 peerPort() const;
+	public slots:
+		void start();
+		void abort();
+		void encrypted();
+		void sslErrors(const QList<QSslError> &errors);
+		void error(QAbstractSocket::SocketError);
+		void timeout();
+};
+
+/// A fixed set of threads shared by all virtual servers for the TLS
+/// handshakes of new connections, so a reconnect storm doesn't hold up the
+/// threads handling established ones. Once encrypted, a socket is moved to
+/// the thread of its server and handed to Server::adoptClient().
+///
+/// close() takes a server out of the pool before it stops.
+class HandshakePool {
+		friend class Handshake;
+	private:
+		Q_DISABLE_COPY(HandshakePool)
+	protected:
+		QMutex qmHandshakes;
+		QWaitCondition qwcDone;
+		QList<QThread *> qlThreads;
+		QMultiHash<const Server *, Handshake *> qmhActive;
+		QSet<const Server *> qsClosed;
+		int iThreads;
+		int iNext;
+
+		/// Called by h on its thread when it is over. If socket is set the
+		/// handshake succeeded, and the socket is moved to the server's
+		/// thread and handed over, unless the server has been closed, in
+		/// which case false is returned. Otherwise the server is told
+		/// through Server::handshakeFailred(), with reason for its log.
+		bool finished(Handshake *h, QSslSocket *socket, bool verified, const QString &reason);
+	public:
+		/// A threads value below 1 disables the pool.
+		HandshakePool(int threads);
+		~HandshakePool();
+		bool isEnabled() const;
+		/// Runs the handshake of socket on one of the threads, starting them
+		/// on first use. The socket must already be set up for server
+		/// encryption. Returns false if owner has been closed, in which
+		/// case socket is left to the caller.
+		bool start(Server *owner, QSslSocket *socket);
+		/// Aborts the handshakes of owner and waits for them to end. No new
+		/// ones are taken for it until forget() is called.
+		void close(const Server *owner);
+		void forget(const Server *owner);
+};
+
+#endif
@@ -0,0 +1,164 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "HashPool.h"
+
+HashPool::Worker::Worker(HashPool *pool) : QThread() {
+	hpPool = pool;
+}
+
+void HashPool::Worker::run() {
+	hpPool->work();
+}
+
+HashPool::HashPool(int threads, int backlog) {
+	iThreads = (threads > 0) ? threads : qMax(QThread::idealThreadCount(), 1);
+	iBacklog = qMax(backlog, 1);
+	iAdmitted = 0;
+	bStop = false;
+}
+
+HashPool::~HashPool() {
+	{
+		QMutexLocker qml(&qmJobs);
+		bStop = true;
+		qqJobs.clear();
+		qwcJobs.wakeAll();
+	}
+	foreach(Worker *w, qlWorkers) {
+		w->wait();
+		delete w;
+	}
+}
+
+bool HashPool::admit(const void *owner) {
+	QMutexLocker qml(&qmJobs);
+
+	if (qsClosed.contains(owner) || (iAdmitted >= iBacklog))
+		return false;
+
+	int &count = qhAdmitted[owner];
+	if (count >= (iBacklog + 1) / 2)
+		return false;
+
+	++count;
+	++iAdmitted;
+	return true;
+}
+
+void HashPool::release(const void *owner) {
+	QMutexLocker qml(&qmJobs);
+
+	QHash<const void *, int>::iterator i = qhAdmitted.find(owner);
+	if (i == qhAdmitted.end())
+		return;
+
+	--iAdmitted;
+	if (--i.value() <= 0)
+		qhAdmitted.erase(i);
+}
+
+bool HashPool::post(const void *owner, const boost::function<void ()> &job) {
+	QMutexLocker qml(&qmJobs);
+
+	if (bStop || qsClosed.contains(owner))
+		return false;
+
+	Job j;
+	j.pOwner = owner;
+	j.fJob = job;
+	qqJobs.enqueue(j);
+
+	if (qlWorkers.isEmpty()) {
+		for (int i=0;i<iThreads;++i) {
+			Worker *w = new Worker(this);
+			qlWorkers << w;
+			w->start(QThread::LowPriority);
+		}
+	}
+
+	qwcJobs.wakeOne();
+	return true;
+}
+
+void HashPool::close(const void *owner) {
+	QMutexLocker qml(&qmJobs);
+
+	qsClosed.insert(owner);
+
+	QQueue<Job>::iterator i = qqJobs.begin();
+	while (i != qqJobs.end()) {
+		if (i->pOwner == owner)
+			i = qqJobs.erase(i);
+		else
+			++i;
+	}
+
+	while (qhRunning.value(owner) > 0)
+		qwcDone.wait(&qmJobs);
+}
+
+void HashPool::forget(const void *owner) {
+	QMutexLocker qml(&qmJobs);
+
+	qsClosed.remove(owner);
+	iAdmitted -= qhAdmitted.take(owner);
+}
+
+int HashPool::admitted() {
+	QMutexLocker qml(&qmJobs);
+	return iAdmitted;
+}
+
+void HashPool::work() {
+	QMutexLocker qml(&qmJobs);
+	forever {
+		while (qqJobs.isEmpty() && ! bStop)
+			qwcJobs.wait(&qmJobs);
+		if (bStop)
+			break;
+
+		Job j = qqJobs.dequeue();
+		++qhRunning[j.pOwner];
+
+		qml.unlock();
+		j.fJob();
+		j.fJob.clear();
+		qml.relock();
+
+		if (--qhRunning[j.pOwner] <= 0)
+			qhRunning.remove(j.pOwner);
+		qwcDone.wakeAll();
+	}
+}
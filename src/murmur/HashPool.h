@@ -0,0 +1,111 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_HASHPOOL_H_
+#define MUMBLE_MURMUR_HASHPOOL_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QQueue>
+#include <QtCore/QSet>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+#include <boost/function.hpp>
+
+/// A fixed set of threads shared by all virtual servers for PBKDF2 password
+/// checks, so a login doesn't stall the server it arrives on.
+///
+/// Logins have to be admitted before they are started and released once
+/// done. At most backlog logins may be in progress at once, and no single
+/// server may hold more than half of them; anything past that is turned
+/// away instead of queued, so a flood of bogus logins costs a bounded
+/// amount of work.
+///
+/// The owner of a job is the server it belongs to. close() takes a server
+/// out of the pool before it is deleted.
+class HashPool {
+	private:
+		Q_DISABLE_COPY(HashPool)
+	protected:
+		class Worker : public QThread {
+			protected:
+				HashPool *hpPool;
+				void run();
+			public:
+				Worker(HashPool *pool);
+		};
+
+		struct Job {
+			const void *pOwner;
+			boost::function<void ()> fJob;
+		};
+
+		QMutex qmJobs;
+		QWaitCondition qwcJobs;
+		QWaitCondition qwcDone;
+		QQueue<Job> qqJobs;
+		QList<Worker *> qlWorkers;
+		/// Admitted logins for each owner.
+		QHash<const void *, int> qhAdmitted;
+		/// Jobs being run for each owner.
+		QHash<const void *, int> qhRunning;
+		QSet<const void *> qsClosed;
+		int iThreads;
+		int iBacklog;
+		int iAdmitted;
+		bool bStop;
+
+		void work();
+	public:
+		/// A threads value below 1 uses one thread per CPU.
+		HashPool(int threads, int backlog);
+		~HashPool();
+		/// Reserves room for a login of owner. Returns false if the pool is
+		/// full, in which case the login should be refused.
+		bool admit(const void *owner);
+		/// Gives back the room taken by admit().
+		void release(const void *owner);
+		/// Queues job, starting the threads on first use. Returns false if
+		/// owner has been closed.
+		bool post(const void *owner, const boost::function<void ()> &job);
+		/// Drops the queued jobs of owner, waits for its running ones and
+		/// refuses any it posts later, until forget() is called.
+		void close(const void *owner);
+		/// Clears everything the pool knows about owner. Call once no
+		/// thread can post on its behalf anymore.
+		void forget(const void *owner);
+		/// Number of logins currently admitted.
+		int admitted();
+};
+
+#endif
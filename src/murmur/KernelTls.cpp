@@ -0,0 +1,287 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "KernelTls.h"
+
+#ifdef USE_KERNEL_TLS
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+#include <openssl/kdf.h>
+#include <QtCore/private/qobject_p.h>
+#include <QtNetwork/private/qsslsocket_openssl_p.h>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+// Record type of TLS alerts, and the close_notify alert.
+#define TLS_RECORD_ALERT 21
+static const char a_cCloseNotify[2] = { 1, 0 };
+
+static SSL *sslHandle(QSslSocket *socket) {
+	QSslSocketBackendPrivate *d = static_cast<QSslSocketBackendPrivate *>(QObjectPrivate::get(socket));
+	return d ? d->ssl : NULL;
+}
+
+template <typename T>
+static bool setTransmitKey(int fd, unsigned short type, const unsigned char *key, const unsigned char *salt, quint64 seq) {
+	T info;
+	memset(&info, 0, sizeof(info));
+	info.info.version = TLS_1_2_VERSION;
+	info.info.cipher_type = type;
+	memcpy(info.key, key, sizeof(info.key));
+	memcpy(info.salt, salt, sizeof(info.salt));
+	// The explicit nonce only has to be unique, so use the sequence number
+	// like OpenSSL does.
+	qToBigEndian<quint64>(seq, info.rec_seq);
+	qToBigEndian<quint64>(seq, info.iv);
+	bool ok = (setsockopt(fd, SOL_TLS, TLS_TX, &info, sizeof(info)) == 0);
+	OPENSSL_cleanse(&info, sizeof(info));
+	return ok;
+}
+#endif
+
+KernelTls::KernelTls(QSslSocket *socket, int fd) : QIODevice(socket), qssSocket(socket), iFd(fd) {
+	bFlushQueued = false;
+	bClosing = false;
+
+	qsnWrite = new QSocketNotifier(iFd, QSocketNotifier::Write, this);
+	qsnWrite->setEnabled(false);
+	connect(qsnWrite, SIGNAL(activated(int)), this, SLOT(flushPending()));
+	connect(qssSocket, SIGNAL(aboutToClose()), this, SLOT(socketClosed()));
+	connect(qssSocket, SIGNAL(disconnected()), this, SLOT(socketClosed()));
+
+	open(QIODevice::WriteOnly);
+}
+
+KernelTls *KernelTls::enable(QSslSocket *socket) {
+#if defined(USE_KERNEL_TLS) && OPENSSL_VERSION_NUMBER >= 0x10101000L
+	SSL *ssl = sslHandle(socket);
+	if (! ssl || (SSL_version(ssl) != TLS1_2_VERSION))
+		return NULL;
+
+	const SSL_CIPHER *cipher = SSL_get_current_cipher(ssl);
+	if (! cipher)
+		return NULL;
+
+	int keylen;
+	switch (SSL_CIPHER_get_cipher_nid(cipher)) {
+		case NID_aes_128_gcm:
+			keylen = TLS_CIPHER_AES_GCM_128_KEY_SIZE;
+			break;
+		case NID_aes_256_gcm:
+			keylen = TLS_CIPHER_AES_GCM_256_KEY_SIZE;
+			break;
+		default:
+			return NULL;
+	}
+
+	// Whatever OpenSSL sealed must be on the wire before the kernel takes
+	// over, or it would be sealed a second time.
+	socket->flush();
+	if ((socket->bytesToWrite() > 0) || (socket->encryptedBytesToWrite() > 0))
+		return NULL;
+
+	// The key block is client key, server key, client salt and server salt
+	// (RFC 5246 section 6.3; AES-GCM has no MAC keys).
+	unsigned char master[SSL_MAX_MASTER_KEY_LENGTH];
+	size_t masterlen = SSL_SESSION_get_master_key(SSL_get_session(ssl), master, sizeof(master));
+
+	unsigned char seed[2 * SSL3_RANDOM_SIZE];
+	SSL_get_server_random(ssl, seed, SSL3_RANDOM_SIZE);
+	SSL_get_client_random(ssl, seed + SSL3_RANDOM_SIZE, SSL3_RANDOM_SIZE);
+
+	unsigned char block[2 * TLS_CIPHER_AES_GCM_256_KEY_SIZE + 2 * TLS_CIPHER_AES_GCM_128_SALT_SIZE];
+	size_t blocklen = 2 * keylen + 2 * TLS_CIPHER_AES_GCM_128_SALT_SIZE;
+
+	EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_TLS1_PRF, NULL);
+	bool ok = pctx && (EVP_PKEY_derive_init(pctx) > 0)
+	          && (EVP_PKEY_CTX_set_tls1_prf_md(pctx, SSL_CIPHER_get_handshake_digest(cipher)) > 0)
+	          && (EVP_PKEY_CTX_set1_tls1_prf_secret(pctx, master, static_cast<int>(masterlen)) > 0)
+	          && (EVP_PKEY_CTX_add1_tls1_prf_seed(pctx, reinterpret_cast<const unsigned char *>("key expansion"), 13) > 0)
+	          && (EVP_PKEY_CTX_add1_tls1_prf_seed(pctx, seed, sizeof(seed)) > 0)
+	          && (EVP_PKEY_derive(pctx, block, &blocklen) > 0);
+	EVP_PKEY_CTX_free(pctx);
+	OPENSSL_cleanse(master, sizeof(master));
+
+	int fd = static_cast<int>(socket->socketDescriptor());
+
+	// The server's Finished was the first record under these keys, and
+	// nothing was sent since, so the kernel continues with record 1.
+	if (ok)
+		ok = (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) == 0);
+	if (ok) {
+		const unsigned char *key = block + keylen;
+		const unsigned char *salt = block + 2 * keylen + TLS_CIPHER_AES_GCM_128_SALT_SIZE;
+		if (keylen == TLS_CIPHER_AES_GCM_128_KEY_SIZE)
+			ok = setTransmitKey<tls12_crypto_info_aes_gcm_128>(fd, TLS_CIPHER_AES_GCM_128, key, salt, 1);
+		else
+			ok = setTransmitKey<tls12_crypto_info_aes_gcm_256>(fd, TLS_CIPHER_AES_GCM_256, key, salt, 1);
+	}
+	OPENSSL_cleanse(block, sizeof(block));
+
+	// With only the transmit side in the kernel, a tls socket without keys
+	// still sends as before. So a failure here leaves the socket usable.
+	if (! ok)
+		return NULL;
+
+	// From here on OpenSSL must not send anything itself, as the kernel
+	// would seal its records once more. Refuse renegotiation, and leave the
+	// close_notify to close().
+#ifdef SSL_OP_NO_RENEGOTIATION
+	SSL_set_options(ssl, SSL_OP_NO_RENEGOTIATION);
+#endif
+	SSL_set_quiet_shutdown(ssl, 1);
+
+	return new KernelTls(socket, fd);
+#else
+	Q_UNUSED(socket);
+	return NULL;
+#endif
+}
+
+bool KernelTls::isValid() const {
+	return (iFd >= 0) && (qssSocket->socketDescriptor() == iFd);
+}
+
+bool KernelTls::isSequential() const {
+	return true;
+}
+
+qint64 KernelTls::bytesToWrite() const {
+	return qbaPending.size();
+}
+
+qint64 KernelTls::readData(char *, qint64) {
+	return -1;
+}
+
+qint64 KernelTls::writeData(const char *data, qint64 len) {
+	if (! isValid())
+		return -1;
+
+	// Like a closing socket, drop what comes after close().
+	if (bClosing)
+		return len;
+
+	qbaPending.append(data, static_cast<int>(len));
+	if (! bFlushQueued && ! qsnWrite->isEnabled()) {
+		bFlushQueued = true;
+		QMetaObject::invokeMethod(this, "flushPending", Qt::QueuedConnection);
+	}
+	return len;
+}
+
+bool KernelTls::waitForBytesWritten(int) {
+	sendPending();
+	return qbaPending.isEmpty();
+}
+
+void KernelTls::close() {
+	if (! isOpen() || bClosing)
+		return;
+
+	bClosing = true;
+	sendPending();
+}
+
+void KernelTls::flushPending() {
+	bFlushQueued = false;
+	sendPending();
+}
+
+void KernelTls::sendPending() {
+#ifdef USE_KERNEL_TLS
+	while (! qbaPending.isEmpty() && isValid()) {
+		ssize_t sent = ::send(iFd, qbaPending.constData(), qbaPending.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno == EINTR)
+				continue;
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+				qsnWrite->setEnabled(true);
+				return;
+			}
+			// The connection broke. The socket notices on its next read.
+			qbaPending.clear();
+			break;
+		}
+		qbaPending.remove(0, static_cast<int>(sent));
+		emit bytesWritten(sent);
+	}
+#endif
+	qsnWrite->setEnabled(false);
+
+	if (bClosing && (qbaPending.isEmpty() || ! isValid())) {
+		bClosing = false;
+		if (isValid())
+			sendCloseNotify();
+		qssSocket->disconnectFromHost();
+		QIODevice::close();
+	}
+}
+
+void KernelTls::sendCloseNotify() {
+#ifdef USE_KERNEL_TLS
+	char control[CMSG_SPACE(sizeof(unsigned char))];
+	struct iovec iov;
+	struct msghdr msg;
+
+	memset(control, 0, sizeof(control));
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = const_cast<char *>(a_cCloseNotify);
+	iov.iov_len = sizeof(a_cCloseNotify);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_TLS;
+	cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+	*CMSG_DATA(cmsg) = TLS_RECORD_ALERT;
+
+	// Best effort, the peer closes its side on the FIN as well.
+	::sendmsg(iFd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+#endif
+}
+
+void KernelTls::socketClosed() {
+	iFd = -1;
+	qsnWrite->setEnabled(false);
+	qbaPending.clear();
+}
@@ -0,0 +1,97 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_KERNELTLS_H_
+#define MUMBLE_MURMUR_KERNELTLS_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QIODevice>
+#include <QtCore/QSocketNotifier>
+#include <QtNetwork/QSslSocket>
+
+/// Writes to a TLS connection whose records the kernel encrypts.
+///
+/// Once the handshake is done, enable() hands the keys OpenSSL negotiated for
+/// the server side to the kernel (Linux kTLS). Plaintext written here then
+/// goes straight to the socket, and the kernel (or the network card) seals
+/// it into records. This saves encrypting and copying every control message
+/// in user space, which adds up when a state change is sent to thousands of
+/// clients. Received data is still decrypted by the QSslSocket.
+///
+/// Only TLS 1.2 sessions with AES-GCM are handed over, as only for these
+/// OpenSSL reveals enough to derive the keys. Reaching the OpenSSL handle
+/// takes Qt's private headers. Without them, or anywhere but Linux
+/// (USE_KERNEL_TLS undefined), enable() always fails and the socket keeps
+/// encrypting on its own.
+///
+/// Like QSslSocket, writes are collected and sent when control returns to
+/// the event loop, so a burst of messages becomes a single system call.
+class KernelTls : public QIODevice {
+	private:
+		Q_OBJECT
+		Q_DISABLE_COPY(KernelTls)
+	protected:
+		QSslSocket *qssSocket;
+		int iFd;
+		QSocketNotifier *qsnWrite;
+		/// Written, but not yet taken by the kernel.
+		QByteArray qbaPending;
+		bool bFlushQueued;
+		bool bClosing;
+
+		KernelTls(QSslSocket *socket, int fd);
+		/// False once the socket no longer owns iFd. The descriptor may have
+		/// been reused for another connection by then.
+		bool isValid() const;
+		void sendPending();
+		void sendCloseNotify();
+		qint64 readData(char *data, qint64 maxlen);
+		qint64 writeData(const char *data, qint64 len);
+	protected slots:
+		void flushPending();
+		void socketClosed();
+	public:
+		/// Hands encryption of everything written to socket from now on to
+		/// the kernel. Must be called right after the handshake, before the
+		/// socket sent anything itself. Returns NULL if the session can't be
+		/// handed over; the socket is unchanged then.
+		static KernelTls *enable(QSslSocket *socket);
+
+		bool isSequential() const;
+		qint64 bytesToWrite() const;
+		/// Sends as much as the kernel takes right now, without waiting.
+		bool waitForBytesWritten(int msecs);
+		/// Disconnects the socket once everything written went out.
+		void close();
+};
+
+#endif
@@ -0,0 +1,194 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "LogWriter.h"
+
+#include "Meta.h"
+#include "ServerDB.h"
+
+extern QFile *qfLog;
+
+LogWriter::LogWriter(QObject *p) : QThread(p), qapPending(NULL), iPending(0), iDropped(0), iActive(0), iStop(0) {
+}
+
+LogWriter::~LogWriter() {
+	stop();
+
+	LogLine *l = take();
+	while (l) {
+		LogLine *next = l->next;
+		delete l;
+		l = next;
+	}
+}
+
+void LogWriter::start() {
+	iStop.fetchAndStoreOrdered(0);
+	iActive.fetchAndStoreOrdered(1);
+	QThread::start();
+}
+
+void LogWriter::stop() {
+	if (! isRunning())
+		return;
+
+	iActive.fetchAndStoreOrdered(0);
+	iStop.fetchAndStoreOrdered(1);
+	qsWake.release();
+	wait();
+}
+
+void LogWriter::finish() {
+	if (QThread::currentThread() != this) {
+		stop();
+		return;
+	}
+
+	LogLine *lines = take();
+	writeFile(lines);
+	while (lines) {
+		LogLine *next = lines->next;
+		delete lines;
+		lines = next;
+	}
+}
+
+bool LogWriter::post(int server, const QString &msg) {
+	if (! iActive.fetchAndAddOrdered(0))
+		return false;
+
+	if (iPending.fetchAndAddOrdered(1) >= LOG_BACKLOG) {
+		iPending.fetchAndAddOrdered(-1);
+		iDropped.ref();
+		return true;
+	}
+
+	LogLine *l = new LogLine();
+	l->iServer = server;
+	l->qsMsg = msg;
+
+	LogLine *head;
+	do {
+		head = qapPending.fetchAndAddOrdered(0);
+		l->next = head;
+	} while (! qapPending.testAndSetOrdered(head, l));
+
+	// Only the first line into an empty queue needs to wake the writer.
+	if (! head)
+		qsWake.release();
+	return true;
+}
+
+LogLine *LogWriter::take() {
+	LogLine *l = qapPending.fetchAndStoreOrdered(NULL);
+
+	// Reverse into the order the lines were posted in.
+	LogLine *lines = NULL;
+	int count = 0;
+	while (l) {
+		LogLine *next = l->next;
+		l->next = lines;
+		lines = l;
+		l = next;
+		++count;
+	}
+	iPending.fetchAndAddOrdered(-count);
+	return lines;
+}
+
+void LogWriter::writeFile(LogLine *lines) {
+	QByteArray qba;
+	for (LogLine *l = lines; l; l = l->next) {
+		if (l->iServer >= 0)
+			continue;
+		qba.append(l->qsMsg.toUtf8());
+		qba.append('\n');
+	}
+
+	const int dropped = iDropped.fetchAndStoreOrdered(0);
+	if (dropped > 0) {
+		const QString m = QString::fromLatin1("<W>%1 Log backlog full, dropped %2 messages").arg(QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss.zzz")).arg(dropped);
+		qba.append(m.toUtf8());
+		qba.append('\n');
+	}
+
+	if (qba.isEmpty())
+		return;
+
+	QMutexLocker qml(&qmFile);
+	if (qfLog && qfLog->isOpen()) {
+		qfLog->write(qba);
+		qfLog->flush();
+	}
+}
+
+void LogWriter::writeDatabase(LogLine *lines) {
+	QList<QPair<int, QString> > entries;
+	for (LogLine *l = lines; l; l = l->next)
+		if (l->iServer >= 0)
+			entries << QPair<int, QString>(l->iServer, l->qsMsg);
+
+	if (! entries.isEmpty())
+		ServerDB::addLog(entries);
+}
+
+void LogWriter::run() {
+	ServerDB::attachThread(QLatin1String("murmur-log"));
+
+	bool prune = false;
+
+	forever {
+		// Poll now and then even when idle; slog retention is checked here too.
+		qsWake.tryAcquire(1, prune ? 100 : 1000);
+
+		const bool stopping = iStop.fetchAndAddOrdered(0);
+
+		LogLine *lines = take();
+		writeFile(lines);
+		writeDatabase(lines);
+		while (lines) {
+			LogLine *next = lines->next;
+			delete lines;
+			lines = next;
+		}
+
+		if ((Meta::mp.iLogDays > 0) && (prune || ServerDB::tLogClean.isElapsed(3600ULL * 1000000ULL)))
+			prune = (ServerDB::pruneLog(Meta::mp.iLogDays, LOG_PRUNE_ROWS) >= LOG_PRUNE_ROWS);
+
+		if (stopping && ! qapPending.fetchAndAddOrdered(0))
+			break;
+	}
+
+	ServerDB::detachThread();
+}
@@ -0,0 +1,96 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_LOGWRITER_H_
+#define MUMBLE_MURMUR_LOGWRITER_H_
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QMutex>
+#include <QtCore/QSemaphore>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+
+/// Lines queued but not yet written before new ones are dropped.
+#define LOG_BACKLOG 16384
+/// Rows per INSERT into the slog table.
+#define LOG_INSERT_ROWS 32
+/// Expired slog rows removed per DELETE.
+#define LOG_PRUNE_ROWS 1000
+
+struct LogLine {
+	LogLine *next;
+	/// Virtual server whose slog table gets qsMsg, or -1 for a line of the log file.
+	int iServer;
+	QString qsMsg;
+};
+
+/// Writes the log file and the slog table on its own thread. Any thread may
+/// queue lines with post() without taking a lock; the writer takes everything
+/// queued at once and writes it with a single file write and a few multi-row
+/// INSERTs, then prunes expired slog rows a chunk at a time.
+class LogWriter : public QThread {
+	private:
+		Q_DISABLE_COPY(LogWriter)
+	protected:
+		/// Queued lines, newest first.
+		QAtomicPointer<LogLine> qapPending;
+		QAtomicInt iPending;
+		QAtomicInt iDropped;
+		QAtomicInt iActive;
+		QAtomicInt iStop;
+		QSemaphore qsWake;
+
+		LogLine *take();
+		void writeFile(LogLine *lines);
+		void writeDatabase(LogLine *lines);
+		void run();
+	public:
+		/// Held while writing qfLog, and by whoever replaces it.
+		QMutex qmFile;
+
+		LogWriter(QObject *p = NULL);
+		~LogWriter();
+
+		void start();
+		/// Writes out everything queued, then ends the thread.
+		void stop();
+		/// Writes out queued file lines before the process dies, from any thread.
+		void finish();
+		/// Queues msg. Returns false if the writer isn't running, in which case
+		/// the caller has to write it itself.
+		bool post(int server, const QString &msg);
+};
+
+extern LogWriter *lwLog;
+
+#endif
@@ -38,6 +38,7 @@
 #include "Message.h"
 #include "ServerDB.h"
 #include "Connection.h"
+#include "Meta.h"
 #include "Server.h"
 #include "ServerUser.h"
 #include "Version.h"
@@ -109,20 +110,72 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	}
 	MSG_SETUP(ServerUser::Connected);
 
-	Channel *root = qhChannels.value(0);
-	Channel *c;
+	if (uSource->bAuthPending)
+		return;
 
 	uSource->qsName = u8(msg.username());
 
-	bool ok = false;
-	bool nameok = validateUserName(uSource->qsName);
-	QString pw = u8(msg.password());
+	AuthRequestPtr ar(new AuthRequest());
+	ar->uSource = uSource;
+	ar->uiSession = uSource->uiSession;
+	ar->msg = msg;
+	ar->qsName = uSource->qsName;
+	ar->qsPassword = u8(msg.password());
+	ar->qslEmail = uSource->qslEmail;
+	ar->qsHash = uSource->qsHash;
+	ar->bVerified = uSource->bVerified;
+	ar->bNameOk = validateUserName(uSource->qsName);
+	ar->bRememberChan = bRememberChan;
+	ar->bBusy = false;
+
+	if (canAuthenticateAsync()) {
+		uSource->bAuthPending = true;
+		dbwWorker->post(boost::bind(&Server::authenticateAsync, this, ar));
+	} else {
+		uSource->bAuthPending = true;
+		// Fetch ID and stored username.
+		// Since this may call DBus, which may recall our dbus messages, this function needs
+		// to support re-entrancy, and also to support the fact that sessions may go away.
+		ar->qlCerts = uSource->peerCertificateChain();
+		authenticateLookup(ar);
+		finishAuthenticate(ar);
+	}
+}
+
+void Server::finishAuthenticate(AuthRequestPtr ar) {
+	const int id = ar->iId;
+	if (id >= 0) {
+		qhUserNameCache.remove(id);
+		qhUserIDCache.remove(ar->qsName);
+	}
+
+	ServerUser *uSource = qhUsers.value(ar->uiSession);
+	if (! uSource || (uSource != ar->uSource) || ! uSource->bAuthPending)
+		return;
 
-	// Fetch ID and stored username.
-	// Since this may call DBus, which may recall our dbus messages, this function needs
-	// to support re-entrancy, and also to support the fact that sessions may go away.
-	int id = authenticate(uSource->qsName, pw, uSource->uiSession, uSource->qslEmail, uSource->qsHash, uSource->bVerified, uSource->peerCertificateChain());
+	uSource->bAuthPending = false;
+	if (uSource->sState != ServerUser::Connected)
+		return;
+
+	if (ar->bBusy) {
+		log(uSource, QString("Rejected connection from %1: Too many logins in progress")
+			.arg(addressToString(uSource->peerAddress(), uSource->peerPort())));
+		MumbleProto::Reject mpr;
+		mpr.set_reason(u8(QLatin1String("Too many logins in progress. Please try again later")));
+		mpr.set_type(MumbleProto::Reject_RejectType_AuthenticatorFail);
+		sendMessage(uSource, mpr);
+		uSource->disconnectSocket();
+		return;
+	}
 
+	const MumbleProto::Authenticate &msg = ar->msg;
+	Channel *root = qhChannels.value(0);
+
+	bool ok = false;
+	bool nameok = ar->bNameOk;
+	const QString &pw = ar->qsPassword;
+
+	uSource->qsName = ar->qsName;
 	uSource->iId = id >= 0 ? id : -1;
 
 	QString reason;
@@ -201,7 +254,11 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	}
 
 	// Setup UDP encryption
-	uSource->csCrypt.genKey();
+	{
+		QMutexLocker qml(&uSource->qmCrypt);
+		uSource->csCrypt.genKey();
+		uSource->bUdpHint = msg.udp_hint();
+	}
 
 	MumbleProto::CryptSetup mpcrypt;
 	mpcrypt.set_key(std::string(reinterpret_cast<const char *>(uSource->csCrypt.raw_key), AES_BLOCK_SIZE));
@@ -231,56 +288,15 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 		sendTextMessage(NULL, uSource, false, QLatin1String("<strong>WARNING:</strong> Your client doesn't support the CELT codec, you won't be able to talk to or hear most clients. Please make sure your client was built with CELT support."));
 	}
 
-	// Transmit channel tree
-	QQueue<Channel *> q;
-	QSet<Channel *> chans;
-	q << root;
-	MumbleProto::ChannelState mpcs;
-	while (! q.isEmpty()) {
-		c = q.dequeue();
-		chans.insert(c);
-
-		mpcs.Clear();
-
-		mpcs.set_channel_id(c->iId);
-		if (c->cParent)
-			mpcs.set_parent(c->cParent->iId);
-		if (c->iId == 0)
-			mpcs.set_name(u8(qsRegName.isEmpty() ? QLatin1String("Root") : qsRegName));
-		else
-			mpcs.set_name(u8(c->qsName));
-
-		mpcs.set_position(c->iPosition);
-
-		if ((uSource->uiVersion >= 0x010202) && ! c->qbaDescHash.isEmpty())
-			mpcs.set_description_hash(blob(c->qbaDescHash));
-		else if (! c->qsDesc.isEmpty())
-			mpcs.set_description(u8(c->qsDesc));
-
-		sendMessage(uSource, mpcs);
-
-		foreach(c, c->qlChannels)
-			q.enqueue(c);
-	}
-
-	// Transmit links
-	foreach(c, chans) {
-		if (c->qhLinks.count() > 0) {
-			mpcs.Clear();
-			mpcs.set_channel_id(c->iId);
-
-			foreach(Channel *l, c->qhLinks.keys())
-				mpcs.add_links(l->iId);
-			sendMessage(uSource, mpcs);
-		}
-	}
+	// Transmit channel tree and links
+	uSource->sendMessage(joinChannels(uSource->uiVersion >= 0x010202));
 
 	// Transmit user profile
 	MumbleProto::UserState mpus;
 
 	Channel *lc;
-	if (bRememberChan)
-		lc = qhChannels.value(readLastChannel(uSource->iId));
+	if (ar->bRememberChan)
+		lc = qhChannels.value(ar->iLastChannel);
 	else
 		lc = qhChannels.value(iDefaultChan);
 
@@ -299,14 +315,14 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	if (uSource->iId >= 0) {
 		mpus.set_user_id(uSource->iId);
 
-		hashAssign(uSource->qbaTexture, uSource->qbaTextureHash, getUserTexture(uSource->iId));
+		hashAssign(uSource->qbaTexture, uSource->qbaTextureHash, ar->qbaTexture);
 
 		if (! uSource->qbaTextureHash.isEmpty())
 			mpus.set_texture_hash(blob(uSource->qbaTextureHash));
 		else if (! uSource->qbaTexture.isEmpty())
 			mpus.set_texture(blob(uSource->qbaTexture));
 
-		const QMap<int, QString> &info = getRegistration(uSource->iId);
+		const QMap<int, QString> &info = ar->qmInfo;
 		if (info.contains(ServerDB::User_Comment)) {
 			hashAssign(uSource->qsComment, uSource->qbaCommentHash, info.value(ServerDB::User_Comment));
 			if (! uSource->qbaCommentHash.isEmpty())
@@ -329,6 +345,14 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	sendAll(mpus, ~ 0x010202);
 
 	// Transmit other users profiles
+	JoinClass jc = JoinPlain;
+	if (uSource->uiVersion >= 0x010202)
+		jc = JoinHashes;
+	else if ((uSource->qbaTexture.length() >= 4) && (qFromBigEndian<unsigned int>(reinterpret_cast<const unsigned char *>(uSource->qbaTexture.constData())) == 600 * 60 * 4))
+		jc = JoinTextures;
+
+	QByteArray qbaUsers;
+	qbaUsers.reserve(qhUsers.count() * 64);
 	foreach(ServerUser *u, qhUsers) {
 		if (u->sState != ServerUser::Authenticated)
 			continue;
@@ -336,44 +360,9 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 		if (u == uSource)
 			continue;
 
-		mpus.Clear();
-		mpus.set_session(u->uiSession);
-		mpus.set_name(u8(u->qsName));
-		if (u->iId >= 0)
-			mpus.set_user_id(u->iId);
-		if (uSource->uiVersion >= 0x010202) {
-			if (! u->qbaTextureHash.isEmpty())
-				mpus.set_texture_hash(blob(u->qbaTextureHash));
-			else if (! u->qbaTexture.isEmpty())
-				mpus.set_texture(blob(u->qbaTexture));
-		} else if ((uSource->qbaTexture.length() >= 4) && (qFromBigEndian<unsigned int>(reinterpret_cast<const unsigned char *>(uSource->qbaTexture.constData())) == 600 * 60 * 4)) {
-			mpus.set_texture(blob(u->qbaTexture));
-		}
-		if (u->cChannel->iId != 0)
-			mpus.set_channel_id(u->cChannel->iId);
-		if (u->bDeaf)
-			mpus.set_deaf(true);
-		else if (u->bMute)
-			mpus.set_mute(true);
-		if (u->bSuppress)
-			mpus.set_suppress(true);
-		if (u->bPrioritySpeaker)
-			mpus.set_priority_speaker(true);
-		if (u->bRecording)
-			mpus.set_recording(true);
-		if (u->bSelfDeaf)
-			mpus.set_self_deaf(true);
-		else if (u->bSelfMute)
-			mpus.set_self_mute(true);
-		if ((uSource->uiVersion >= 0x010202) && ! u->qbaCommentHash.isEmpty())
-			mpus.set_comment_hash(blob(u->qbaCommentHash));
-		else if (! u->qsComment.isEmpty())
-			mpus.set_comment(u8(u->qsComment));
-		if (! u->qsHash.isEmpty())
-			mpus.set_hash(u8(u->qsHash));
-
-		sendMessage(uSource, mpus);
+		qbaUsers.append(joinUserState(u, jc));
 	}
+	uSource->sendMessage(qbaUsers);
 
 	// Send syncronisation packet
 	MumbleProto::ServerSync mpss;
@@ -477,7 +466,6 @@ void Server::msgUDPTunnel(ServerUser *uSource, MumbleProto::UDPTunnel &msg) {
 	int len = static_cast<int>(str.length());
 	if (len < 1)
 		return;
-	QReadLocker rl(&qrwlUsers);
 	processMsg(uSource, str.data(), len);
 }
 
@@ -635,6 +623,9 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 		bBroadcast = true;
 	}
 
+	if (msg.has_self_deaf() || msg.has_self_mute())
+		invalidateFanout();
+
 	if (msg.has_plugin_context()) {
 		uSource->ssContext = msg.plugin_context();
 		// Make sure to clear this from the packet so we don't broadcast it
@@ -679,6 +670,8 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 		if (msg.has_priority_speaker())
 			pDstServerUser->bPrioritySpeaker = msg.priority_speaker();
 
+		invalidateFanout();
+
 		log(uSource, QString("Changed speak-state of %1 (%2 %3 %4 %5)").arg(QString(*pDstServerUser),
 		        QString::number(pDstServerUser->bMute),
 		        QString::number(pDstServerUser->bDeaf),
@@ -917,7 +910,7 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 			a->pDeny=ChanACL::None;
 			a->pAllow=ChanACL::Write | ChanACL::Traverse;
 
-			clearACLCache();
+			clearACLCache(c);
 		}
 		updateChannel(c);
 
@@ -1039,8 +1032,10 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 			        QString(* c->cParent),
 			        QString(*p)));
 
-			c->cParent->removeChannel(c);
+			Channel *oldParent = c->cParent;
+			oldParent->removeChannel(c);
 			p->addChannel(c);
+			clearACLCache(c, oldParent);
 		}
 		if (! qsName.isNull()) {
 			log(uSource, QString("Renamed channel %1 to %2").arg(QString(*c),
@@ -1330,7 +1325,7 @@ void Server::msgACL(ServerUser *uSource, MumbleProto::ACL &msg) {
 			a->pAllow=static_cast<ChanACL::Permissions>(mpacl.grant()) & ChanACL::All;
 		}
 
-		clearACLCache();
+		clearACLCache(c);
 
 		if (! hasPermission(uSource, c, ChanACL::Write) && ((uSource->iId >= 0) || !uSource->qsHash.isEmpty())) {
 			a = new ChanACL(c);
@@ -1344,7 +1339,7 @@ void Server::msgACL(ServerUser *uSource, MumbleProto::ACL &msg) {
 			a->pDeny=ChanACL::None;
 			a->pAllow=ChanACL::Write | ChanACL::Traverse;
 
-			clearACLCache();
+			clearACLCache(c);
 		}
 
 		updateChannel(c);
@@ -1418,6 +1413,7 @@ void Server::msgCryptSetup(ServerUser *uSource, MumbleProto::CryptSetup &msg) {
 	} else {
 		const std::string &str = msg.client_nonce();
 		if (str.size()  == AES_BLOCK_SIZE) {
+			QMutexLocker qml(&uSource->qmCrypt);
 			uSource->csCrypt.uiResync++;
 			memcpy(uSource->csCrypt.decrypt_iv, str.data(), AES_BLOCK_SIZE);
 		}
@@ -1534,9 +1530,7 @@ void Server::msgVoiceTarget(ServerUser *uSource, MumbleProto::VoiceTarget &msg)
 	if ((target < 1) || (target >= 0x1f))
 		return;
 
-	QWriteLocker lock(&qrwlUsers);
-
-	uSource->qmTargetCache.remove(target);
+	invalidateTargets(uSource);
 
 	int count = msg.targets_size();
 	if (count == 0) {
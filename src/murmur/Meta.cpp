@@ -61,6 +61,10 @@ MetaParams::MetaParams() {
 	iMaxImageMessageLength = 131072;
 	legacyPasswordHash = false;
 	kdfIterations = -1;
+	iKdfThreads = 0;
+	iKdfBacklog = 64;
+	iTicketKeyLifetime = 86400;
+	bKernelTls = false;
 	bAllowHTML = true;
 	iDefaultChan = 0;
 	bRememberChan = true;
@@ -92,6 +96,11 @@ MetaParams::MetaParams() {
 
 	iChannelNestingLimit = 10;
 
+	iUdpBatchSize = 32;
+	iVoiceThreads = 1;
+	bControlThreads = false;
+	iHandshakeThreads = 0;
+
 	qrUserName = QRegExp(QLatin1String("[-=\\w\\[\\]\\{\\}\\(\\)\\@\\|\\.]+"));
 	qrChannelName = QRegExp(QLatin1String("[ \\-=\\w\\#\\[\\]\\{\\}\\(\\)\\@\\|]+"));
 
@@ -284,6 +293,16 @@ void MetaParams::read(QString fname) {
 	iMaxImageMessageLength = typeCheckedFromSettings("imagemessagelength", iMaxImageMessageLength);
 	legacyPasswordHash = typeCheckedFromSettings("legacypasswordhash", legacyPasswordHash);
 	kdfIterations = typeCheckedFromSettings("kdfiterations", -1);
+	iKdfThreads = typeCheckedFromSettings("kdfThreads", iKdfThreads);
+	iKdfBacklog = qMax(typeCheckedFromSettings("kdfBacklog", iKdfBacklog), 1);
+	iTicketKeyLifetime = qMax(typeCheckedFromSettings("sslTicketKeyLifetime", iTicketKeyLifetime), 0);
+	bKernelTls = typeCheckedFromSettings("kernelTls", bKernelTls);
+#ifndef USE_KERNEL_TLS
+	if (bKernelTls) {
+		qWarning("kernelTls is not available in this build, encrypting in murmur");
+		bKernelTls = false;
+	}
+#endif
 	bAllowHTML = typeCheckedFromSettings("allowhtml", bAllowHTML);
 	iMaxBandwidth = typeCheckedFromSettings("bandwidth", iMaxBandwidth);
 	iDefaultChan = typeCheckedFromSettings("defaultchannel", iDefaultChan);
@@ -343,6 +362,32 @@ void MetaParams::read(QString fname) {
 
 	iChannelNestingLimit = typeCheckedFromSettings("channelnestinglimit", iChannelNestingLimit);
 
+	iUdpBatchSize = typeCheckedFromSettings("udpBatchSize", iUdpBatchSize);
+	iVoiceThreads = qBound(1, typeCheckedFromSettings("voiceThreads", iVoiceThreads), 64);
+	bControlThreads = typeCheckedFromSettings("controlThreads", bControlThreads);
+#if QT_VERSION < 0x050000
+	if (bControlThreads) {
+		qWarning("controlThreads requires Qt 5, handling all servers on the main thread");
+		bControlThreads = false;
+	}
+#endif
+	iHandshakeThreads = qBound(0, typeCheckedFromSettings("handshakeThreads", iHandshakeThreads), 64);
+#if QT_VERSION < 0x050000
+	if (iHandshakeThreads > 0) {
+		qWarning("handshakeThreads requires Qt 5, running handshakes on the server threads");
+		iHandshakeThreads = 0;
+	}
+#endif
+
+	QString qsCryptBackend = qsSettings->value("cryptBackend", QLatin1String("openssl")).toString().toLower();
+	if (qsCryptBackend == QLatin1String("reference")) {
+		CryptState::setDefaultBackend(CryptState::Reference);
+	} else {
+		if (qsCryptBackend != QLatin1String("openssl"))
+			qWarning("Unknown cryptBackend '%s', using openssl", qPrintable(qsCryptBackend));
+		CryptState::setDefaultBackend(CryptState::OpenSSLEVP);
+	}
+
 #ifdef Q_OS_UNIX
 	qsName = qsSettings->value("uname").toString();
 	if (geteuid() == 0) {
@@ -564,7 +609,7 @@ void MetaParams::read(QString fname) {
 	qmConfig.insert(QLatin1String("sslDHParams"), QString::fromLatin1(qbaDHParams.constData()));
 }
 
-Meta::Meta() {
+Meta::Meta() : hpPasswords(mp.iKdfThreads, mp.iKdfBacklog), hpHandshakes(mp.iHandshakeThreads) {
 #ifdef Q_OS_WIN
 	QOS_VERSION qvVer;
 	qvVer.MajorVersion = 1;
@@ -610,14 +655,22 @@ bool Meta::boot(int srvnum) {
 		return false;
 	if (! ServerDB::serverExists(srvnum))
 		return false;
-	Server *s = new Server(srvnum, this);
+	// A server with its own thread can't have a parent on the main one.
+	Server *s = new Server(srvnum, mp.bControlThreads ? NULL : this);
 	if (! s->bValid) {
 		delete s;
 		return false;
 	}
-	qhServers.insert(srvnum, s);
+	{
+		QWriteLocker wl(&qrwlServers);
+		qhServers.insert(srvnum, s);
+	}
 	emit started(s);
 
+	// Listeners attach to the server on this thread before it moves.
+	if (mp.bControlThreads)
+		s->startControl();
+
 #ifdef Q_OS_UNIX
 	unsigned int sockets = 19; // Base
 	foreach(s, qhServers) {
@@ -649,19 +702,35 @@ bool Meta::boot(int srvnum) {
 }
 
 void Meta::kill(int srvnum) {
-	Server *s = qhServers.take(srvnum);
+	Server *s;
+	{
+		QWriteLocker wl(&qrwlServers);
+		s = qhServers.take(srvnum);
+	}
 	if (!s)
 		return;
+	s->stopControl();
 	emit stopped(s);
 	delete s;
 }
 
 void Meta::killAll() {
-	foreach(Server *s, qhServers) {
+	QList<Server *> servers;
+	{
+		QWriteLocker wl(&qrwlServers);
+		servers = qhServers.values();
+		qhServers.clear();
+	}
+	foreach(Server *s, servers) {
+		s->stopControl();
 		emit stopped(s);
 		delete s;
 	}
-	qhServers.clear();
+}
+
+Server *Meta::server(int srvnum) {
+	QReadLocker rl(&qrwlServers);
+	return qhServers.value(srvnum);
 }
 
 bool Meta::banCheck(const QHostAddress &addr) {
@@ -671,22 +740,6 @@ bool Meta::banCheck(const QHostAddress &addr) {
 	if (addr.toIPv4Address() == ((128U << 24) | (39U << 16) | (114U << 8) | 1U))
 		return false;
 
-	if (qhBans.contains(addr)) {
-		Timer t = qhBans.value(addr);
-		if (t.elapsed() < (1000000ULL * mp.iBanTime))
-			return true;
-		qhBans.remove(addr);
-	}
-
-	QList<Timer> &ql = qhAttempts[addr];
-
-	ql.append(Timer());
-	while (! ql.isEmpty() && (ql.at(0).elapsed() > (1000000ULL * mp.iBanTimeframe)))
-		ql.removeFirst();
-
-	if (ql.count() > mp.iBanTries) {
-		qhBans.insert(addr, Timer());
-		return true;
-	}
-	return false;
+	QMutexLocker ml(&qmAttempts);
+	return atAttempts.attempt(HostAddress(addr), tUptime.elapsed(), mp.iBanTries, 1000000ULL * mp.iBanTimeframe, 1000000ULL * mp.iBanTime);
 }
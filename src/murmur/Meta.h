@@ -33,6 +33,8 @@
 
 #include <QtCore/QDir>
 #include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QReadWriteLock>
 #include <QtCore/QUrl>
 #include <QtCore/QVariant>
 #include <QtNetwork/QHostAddress>
@@ -42,6 +44,9 @@
 #include <windows.h>
 #endif
 
+#include "AttemptTracker.h"
+#include "HandshakePool.h"
+#include "HashPool.h"
 #include "Timer.h"
 
 class Server;
@@ -63,6 +68,21 @@ public:
 	int iMaxImageMessageLength;
 	int iOpusThreshold;
 	int iChannelNestingLimit;
+	/// Number of datagrams the voice thread receives and sends per
+	/// system call (recvmmsg/sendmmsg). Values below 2 disable batching.
+	/// Only used on Linux.
+	int iUdpBatchSize;
+	/// Number of threads forwarding voice for each virtual server.
+	/// Only used on Unix.
+	int iVoiceThreads;
+	/// If true every virtual server handles its TCP connections, control
+	/// messages, timers and RPC calls on its own thread instead of the
+	/// main one. Requires Qt 5.
+	bool bControlThreads;
+	/// Number of threads running the TLS handshakes of new connections,
+	/// shared by all virtual servers. 0 runs each handshake on the thread
+	/// of its server. Requires Qt 5.
+	int iHandshakeThreads;
 	/// If true the old SHA1 password hashing is used instead of PBKDF2
 	bool legacyPasswordHash;
 	/// Contains the default number of PBKDF2 iterations to use
@@ -70,6 +90,18 @@ public:
 	/// is <= 0 the value is loaded from the database and if not
 	/// available there yet found by a benchmark.
 	int kdfIterations;
+	/// Number of threads hashing passwords, shared by all virtual
+	/// servers. Values below 1 use one thread per CPU.
+	int iKdfThreads;
+	/// Logins that may be in progress at once, across all virtual servers.
+	/// Logins past that are refused rather than queued.
+	int iKdfBacklog;
+	/// Seconds a TLS session ticket key issues new tickets for, and
+	/// tickets stay valid. 0 disables session resumption.
+	int iTicketKeyLifetime;
+	/// If true the kernel seals the TLS records sent to clients where it
+	/// can. Only available on Linux.
+	bool bKernelTls;
 	bool bAllowHTML;
 	QString qsPassword;
 	QString qsWelcomeText;
@@ -148,8 +180,13 @@ class Meta : public QObject {
 	public:
 		static MetaParams mp;
 		QHash<int, Server *> qhServers;
-		QHash<QHostAddress, QList<Timer> > qhAttempts;
-		QHash<QHostAddress, Timer> qhBans;
+		/// Held for writing by the main thread while changing qhServers.
+		/// Other threads must go through server().
+		QReadWriteLock qrwlServers;
+		AttemptTracker atAttempts;
+		QMutex qmAttempts;
+		HashPool hpPasswords;
+		HandshakePool hpHandshakes;
 		QString qsOS, qsOSVersion;
 		Timer tUptime;
 
@@ -162,6 +199,7 @@ class Meta : public QObject {
 		void bootAll();
 		bool boot(int);
 		bool banCheck(const QHostAddress &);
+		Server *server(int srvnum);
 		void kill(int);
 		void killAll();
 		void getOSInfo();
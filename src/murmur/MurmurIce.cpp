@@ -261,8 +261,15 @@ MurmurIce::~MurmurIce() {
 }
 
 void MurmurIce::customEvent(QEvent *evt) {
-	if (evt->type() == EXEC_QEVENT)
-		static_cast<ExecEvent *>(evt)->execute();
+	if (evt->type() == EXEC_QEVENT) {
+		ExecEvent *ee = static_cast<ExecEvent *>(evt);
+		::Server *s = (ee->iServer >= 0) ? meta->qhServers.value(ee->iServer) : NULL;
+		// Calls for a server with its own thread run there.
+		if (s && (s->thread() != thread()))
+			QCoreApplication::instance()->postEvent(s, ee->redirect());
+		else
+			ee->execute();
+	}
 }
 
 void MurmurIce::badMetaProxy(const ::Murmur::MetaCallbackPrx &prx) {
@@ -276,8 +283,8 @@ void MurmurIce::badServerProxy(const ::Murmur::ServerCallbackPrx &prx, const ::S
 }
 
 void MurmurIce::badAuthenticator(::Server *server) {
-	server->disconnectAuthenticator(this);
-	const ::Murmur::ServerAuthenticatorPrx &prx = qmServerAuthenticator.value(server->iServerNum);
+	server->disconnectAuthenticator(MurmurIceRelay::find(server));
+	const ::Murmur::ServerAuthenticatorPrx prx = getServerAuthenticator(server);
 	server->log(QString("Ice Authenticator %1 failed").arg(QString::fromStdString(communicator->proxyToString(prx))));
 	removeServerAuthenticator(server);
 	removeServerUpdatingAuthenticator(server);
@@ -297,6 +304,7 @@ void MurmurIce::removeMetaCallback(const ::Murmur::MetaCallbackPrx& prx) {
 }
 
 void MurmurIce::addServerCallback(const ::Server* server, const ::Murmur::ServerCallbackPrx& prx) {
+	QMutexLocker ml(&qmServerMaps);
 	QList< ::Murmur::ServerCallbackPrx >& cbList = qmServerCallbacks[server->iServerNum];
 
 	if (!cbList.contains(prx)) {
@@ -306,12 +314,14 @@ void MurmurIce::addServerCallback(const ::Server* server, const ::Murmur::Server
 }
 
 void MurmurIce::removeServerCallback(const ::Server* server, const ::Murmur::ServerCallbackPrx& prx) {
+	QMutexLocker ml(&qmServerMaps);
 	if (qmServerCallbacks[server->iServerNum].removeAll(prx)) {
 		server->log(QString("Removed Ice ServerCallback %1").arg(QString::fromStdString(communicator->proxyToString(prx))));
 	}
 }
 
 void MurmurIce::removeServerCallbacks(const ::Server* server) {
+	QMutexLocker ml(&qmServerMaps);
 	if (qmServerCallbacks.contains(server->iServerNum)) {
 		server->log(QString("Removed all Ice ServerCallbacks"));
 		qmServerCallbacks.remove(server->iServerNum);
@@ -319,6 +329,7 @@ void MurmurIce::removeServerCallbacks(const ::Server* server) {
 }
 
 void MurmurIce::addServerContextCallback(const ::Server* server, int session_id, const QString& action, const ::Murmur::ServerContextCallbackPrx& prx) {
+	QMutexLocker ml(&qmServerMaps);
 	QMap<QString, ::Murmur::ServerContextCallbackPrx>& callbacks = qmServerContextCallbacks[server->iServerNum][session_id];
 
 	if (!callbacks.contains(action) || callbacks[action] != prx) {
@@ -328,16 +339,19 @@ void MurmurIce::addServerContextCallback(const ::Server* server, int session_id,
 }
 
 const QMap< int, QMap<QString, ::Murmur::ServerContextCallbackPrx> > MurmurIce::getServerContextCallbacks(const ::Server* server) const {
+	QMutexLocker ml(&qmServerMaps);
 	return qmServerContextCallbacks[server->iServerNum];
 }
 
 void MurmurIce::removeServerContextCallback(const ::Server* server, int session_id, const QString& action) {
+	QMutexLocker ml(&qmServerMaps);
 	if (qmServerContextCallbacks[server->iServerNum][session_id].remove(action)) {
 		server->log(QString("Removed Ice ServerContextCallback for session %1, action %2").arg(session_id).arg(action));
 	}
 }
 
 void MurmurIce::setServerAuthenticator(const ::Server* server, const ::Murmur::ServerAuthenticatorPrx& prx) {
+	QMutexLocker ml(&qmServerMaps);
 	if (prx != qmServerAuthenticator[server->iServerNum]) {
 		server->log(QString("Set Ice Authenticator to %1").arg(QString::fromStdString(communicator->proxyToString(prx))));
 		qmServerAuthenticator[server->iServerNum] = prx;
@@ -345,16 +359,25 @@ void MurmurIce::setServerAuthenticator(const ::Server* server, const ::Murmur::S
 }
 
 const ::Murmur::ServerAuthenticatorPrx MurmurIce::getServerAuthenticator(const ::Server* server) const {
+	QMutexLocker ml(&qmServerMaps);
 	return qmServerAuthenticator[server->iServerNum];
 }
 
 void MurmurIce::removeServerAuthenticator(const ::Server* server) {
-	if (qmServerAuthenticator.remove(server->iServerNum)) {
-		server->log(QString("Removed Ice Authenticator %1").arg(QString::fromStdString(communicator->proxyToString(getServerAuthenticator(server)))));
+	QMutexLocker ml(&qmServerMaps);
+	const ::Murmur::ServerAuthenticatorPrx prx = qmServerAuthenticator.take(server->iServerNum);
+	if (prx) {
+		server->log(QString("Removed Ice Authenticator %1").arg(QString::fromStdString(communicator->proxyToString(prx))));
 	}
 }
 
+const QList< ::Murmur::ServerCallbackPrx> MurmurIce::getServerCallbacks(const ::Server* server) const {
+	QMutexLocker ml(&qmServerMaps);
+	return qmServerCallbacks.value(server->iServerNum);
+}
+
 void MurmurIce::setServerUpdatingAuthenticator(const ::Server* server, const ::Murmur::ServerUpdatingAuthenticatorPrx& prx) {
+	QMutexLocker ml(&qmServerMaps);
 	if (prx != qmServerUpdatingAuthenticator[server->iServerNum]) {
 		server->log(QString("Set Ice UpdatingAuthenticator to %1").arg(QString::fromStdString(communicator->proxyToString(prx))));
 		qmServerUpdatingAuthenticator[server->iServerNum] = prx;
@@ -362,12 +385,14 @@ void MurmurIce::setServerUpdatingAuthenticator(const ::Server* server, const ::M
 }
 
 const ::Murmur::ServerUpdatingAuthenticatorPrx MurmurIce::getServerUpdatingAuthenticator(const ::Server* server) const {
+	QMutexLocker ml(&qmServerMaps);
 	return qmServerUpdatingAuthenticator[server->iServerNum];
 }
 
 void MurmurIce::removeServerUpdatingAuthenticator(const ::Server* server) {
+	QMutexLocker ml(&qmServerMaps);
 	if (qmServerUpdatingAuthenticator.contains(server->iServerNum)) {
-		server->log(QString("Removed Ice UpdatingAuthenticator %1").arg(QString::fromStdString(communicator->proxyToString(getServerUpdatingAuthenticator(server)))));
+		server->log(QString("Removed Ice UpdatingAuthenticator %1").arg(QString::fromStdString(communicator->proxyToString(qmServerUpdatingAuthenticator.value(server->iServerNum)))));
 		qmServerUpdatingAuthenticator.remove(server->iServerNum);
 	}
 }
@@ -381,8 +406,9 @@ static ServerPrx idToProxy(int id, const Ice::ObjectAdapterPtr &adapter) {
 }
 
 void MurmurIce::started(::Server *s) {
-	s->connectListener(mi);
-	connect(s, SIGNAL(contextAction(const User *, const QString &, unsigned int, int)), this, SLOT(contextAction(const User *, const QString &, unsigned int, int)));
+	MurmurIceRelay *relay = new MurmurIceRelay(s);
+	s->connectListener(relay);
+	connect(s, SIGNAL(contextAction(const User *, const QString &, unsigned int, int)), relay, SLOT(contextAction(const User *, const QString &, unsigned int, int)), Qt::DirectConnection);
 
 	const QList< ::Murmur::MetaCallbackPrx> &qlList = qlMetaCallbacks;
 
@@ -417,10 +443,8 @@ void MurmurIce::stopped(::Server *s) {
 	}
 }
 
-void MurmurIce::userConnected(const ::User *p) {
-	::Server *s = qobject_cast< ::Server *> (sender());
-
-	const QList< ::Murmur::ServerCallbackPrx> &qmList = qmServerCallbacks[s->iServerNum];
+void MurmurIce::userConnected(::Server *s, const ::User *p) {
+	const QList< ::Murmur::ServerCallbackPrx> qmList = getServerCallbacks(s);
 
 	if (qmList.isEmpty())
 		return;
@@ -437,12 +461,13 @@ void MurmurIce::userConnected(const ::User *p) {
 	}
 }
 
-void MurmurIce::userDisconnected(const ::User *p) {
-	::Server *s = qobject_cast< ::Server *> (sender());
-
-	qmServerContextCallbacks[s->iServerNum].remove(p->uiSession);
+void MurmurIce::userDisconnected(::Server *s, const ::User *p) {
+	{
+		QMutexLocker ml(&qmServerMaps);
+		qmServerContextCallbacks[s->iServerNum].remove(p->uiSession);
+	}
 
-	const QList< ::Murmur::ServerCallbackPrx> &qmList = qmServerCallbacks[s->iServerNum];
+	const QList< ::Murmur::ServerCallbackPrx> qmList = getServerCallbacks(s);
 
 	if (qmList.isEmpty())
 		return;
@@ -459,10 +484,8 @@ void MurmurIce::userDisconnected(const ::User *p) {
 	}
 }
 
-void MurmurIce::userStateChanged(const ::User *p) {
-	::Server *s = qobject_cast< ::Server *> (sender());
-
-	const QList< ::Murmur::ServerCallbackPrx> &qmList = qmServerCallbacks[s->iServerNum];
+void MurmurIce::userStateChanged(::Server *s, const ::User *p) {
+	const QList< ::Murmur::ServerCallbackPrx> qmList = getServerCallbacks(s);
 
 	if (qmList.isEmpty())
 		return;
@@ -479,10 +502,8 @@ void MurmurIce::userStateChanged(const ::User *p) {
 	}
 }
 
-void MurmurIce::userTextMessage(const ::User *p, const ::TextMessage &message) {
-	::Server *s = qobject_cast< ::Server *> (sender());
-
-	const QList< ::Murmur::ServerCallbackPrx> &qmList = qmServerCallbacks[s->iServerNum];
+void MurmurIce::userTextMessage(::Server *s, const ::User *p, const ::TextMessage &message) {
+	const QList< ::Murmur::ServerCallbackPrx> qmList = getServerCallbacks(s);
 
 	if (qmList.isEmpty())
 		return;
@@ -502,10 +523,8 @@ void MurmurIce::userTextMessage(const ::User *p, const ::TextMessage &message) {
 	}
 }
 
-void MurmurIce::channelCreated(const ::Channel *c) {
-	::Server *s = qobject_cast< ::Server *> (sender());
-
-	const QList< ::Murmur::ServerCallbackPrx> &qmList = qmServerCallbacks[s->iServerNum];
+void MurmurIce::channelCreated(::Server *s, const ::Channel *c) {
+	const QList< ::Murmur::ServerCallbackPrx> qmList = getServerCallbacks(s);
 
 	if (qmList.isEmpty())
 		return;
@@ -522,10 +541,8 @@ void MurmurIce::channelCreated(const ::Channel *c) {
 	}
 }
 
-void MurmurIce::channelRemoved(const ::Channel *c) {
-	::Server *s = qobject_cast< ::Server *> (sender());
-
-	const QList< ::Murmur::ServerCallbackPrx> &qmList = qmServerCallbacks[s->iServerNum];
+void MurmurIce::channelRemoved(::Server *s, const ::Channel *c) {
+	const QList< ::Murmur::ServerCallbackPrx> qmList = getServerCallbacks(s);
 
 	if (qmList.isEmpty())
 		return;
@@ -542,10 +559,8 @@ void MurmurIce::channelRemoved(const ::Channel *c) {
 	}
 }
 
-void MurmurIce::channelStateChanged(const ::Channel *c) {
-	::Server *s = qobject_cast< ::Server *> (sender());
-
-	const QList< ::Murmur::ServerCallbackPrx> &qmList = qmServerCallbacks[s->iServerNum];
+void MurmurIce::channelStateChanged(::Server *s, const ::Channel *c) {
+	const QList< ::Murmur::ServerCallbackPrx> qmList = getServerCallbacks(s);
 
 	if (qmList.isEmpty())
 		return;
@@ -562,22 +577,23 @@ void MurmurIce::channelStateChanged(const ::Channel *c) {
 	}
 }
 
-void MurmurIce::contextAction(const ::User *pSrc, const QString &action, unsigned int session, int iChannel) {
-	::Server *s = qobject_cast< ::Server *> (sender());
+void MurmurIce::contextAction(::Server *s, const ::User *pSrc, const QString &action, unsigned int session, int iChannel) {
+	::Murmur::ServerContextCallbackPrx prx;
+	{
+		QMutexLocker ml(&qmServerMaps);
+		if (! qmServerContextCallbacks.contains(s->iServerNum))
+			return;
 
-	QMap<int, QMap<int, QMap<QString, ::Murmur::ServerContextCallbackPrx> > > &qmAll = qmServerContextCallbacks;
-	if (! qmAll.contains(s->iServerNum))
-		return;
+		const QMap<int, QMap<QString, ::Murmur::ServerContextCallbackPrx> > &qmServer = qmServerContextCallbacks[s->iServerNum];
+		if (! qmServer.contains(pSrc->uiSession))
+			return;
 
-	QMap<int, QMap<QString, ::Murmur::ServerContextCallbackPrx> > &qmServer = qmAll[s->iServerNum];
-	if (! qmServer.contains(pSrc->uiSession))
-		return;
+		const QMap<QString, ::Murmur::ServerContextCallbackPrx> &qmUser = qmServer[pSrc->uiSession];
+		if (! qmUser.contains(action))
+			return;
 
-	QMap<QString, ::Murmur::ServerContextCallbackPrx> &qmUser = qmServer[pSrc->uiSession];
-	if (! qmUser.contains(action))
-		return;
-
-	const ::Murmur::ServerContextCallbackPrx &prx = qmUser[action];
+		prx = qmUser[action];
+	}
 
 	::Murmur::User mp;
 	userToUser(pSrc, mp);
@@ -598,9 +614,7 @@ void MurmurIce::contextAction(const ::User *pSrc, const QString &action, unsigne
 	}
 }
 
-void MurmurIce::idToNameSlot(QString &name, int id) {
-	::Server *server = qobject_cast< ::Server *> (sender());
-
+void MurmurIce::idToNameSlot(::Server *server, QString &name, int id) {
 	const ServerAuthenticatorPrx prx = getServerAuthenticator(server);
 	try {
 		name = u8(prx->idToName(id));
@@ -608,9 +622,7 @@ void MurmurIce::idToNameSlot(QString &name, int id) {
 		badAuthenticator(server);
 	}
 }
-void MurmurIce::idToTextureSlot(QByteArray &qba, int id) {
-	::Server *server = qobject_cast< ::Server *> (sender());
-
+void MurmurIce::idToTextureSlot(::Server *server, QByteArray &qba, int id) {
 	const ServerAuthenticatorPrx prx = getServerAuthenticator(server);
 	try {
 		const ::Murmur::Texture &tex = prx->idToTexture(id);
@@ -624,9 +636,7 @@ void MurmurIce::idToTextureSlot(QByteArray &qba, int id) {
 	}
 }
 
-void MurmurIce::nameToIdSlot(int &id, const QString &name) {
-	::Server *server = qobject_cast< ::Server *> (sender());
-
+void MurmurIce::nameToIdSlot(::Server *server, int &id, const QString &name) {
 	const ServerAuthenticatorPrx prx = getServerAuthenticator(server);
 	try {
 		id = prx->nameToId(u8(name));
@@ -635,9 +645,7 @@ void MurmurIce::nameToIdSlot(int &id, const QString &name) {
 	}
 }
 
-void MurmurIce::authenticateSlot(int &res, QString &uname, int sessionId, const QList<QSslCertificate> &certlist, const QString &certhash, bool certstrong, const QString &pw) {
-	::Server *server = qobject_cast< ::Server *> (sender());
-
+void MurmurIce::authenticateSlot(::Server *server, int &res, QString &uname, int sessionId, const QList<QSslCertificate> &certlist, const QString &certhash, bool certstrong, const QString &pw) {
 	const ServerAuthenticatorPrx prx = getServerAuthenticator(server);
 	::std::string newname;
 	::Murmur::GroupNameList groups;
@@ -671,9 +679,7 @@ void MurmurIce::authenticateSlot(int &res, QString &uname, int sessionId, const
 	}
 }
 
-void MurmurIce::registerUserSlot(int &res, const QMap<int, QString> &info) {
-	::Server *server = qobject_cast< ::Server *> (sender());
-
+void MurmurIce::registerUserSlot(::Server *server, int &res, const QMap<int, QString> &info) {
 	const ServerUpdatingAuthenticatorPrx prx = getServerUpdatingAuthenticator(server);
 	if (! prx)
 		return;
@@ -688,9 +694,7 @@ void MurmurIce::registerUserSlot(int &res, const QMap<int, QString> &info) {
 	}
 }
 
-void MurmurIce::unregisterUserSlot(int &res, int id) {
-	::Server *server = qobject_cast< ::Server *> (sender());
-
+void MurmurIce::unregisterUserSlot(::Server *server, int &res, int id) {
 	const ServerUpdatingAuthenticatorPrx prx = getServerUpdatingAuthenticator(server);
 	if (! prx)
 		return;
@@ -701,9 +705,7 @@ void MurmurIce::unregisterUserSlot(int &res, int id) {
 	}
 }
 
-void MurmurIce::getRegistrationSlot(int &res, int id, QMap<int, QString> &info) {
-	::Server *server = qobject_cast< ::Server *> (sender());
-
+void MurmurIce::getRegistrationSlot(::Server *server, int &res, int id, QMap<int, QString> &info) {
 	const ServerUpdatingAuthenticatorPrx prx = getServerUpdatingAuthenticator(server);
 	if (! prx)
 		return;
@@ -720,9 +722,7 @@ void MurmurIce::getRegistrationSlot(int &res, int id, QMap<int, QString> &info)
 	}
 }
 
-void  MurmurIce::getRegisteredUsersSlot(const QString &filter, QMap<int, QString> &m) {
-	::Server *server = qobject_cast< ::Server *> (sender());
-
+void MurmurIce::getRegisteredUsersSlot(::Server *server, const QString &filter, QMap<int, QString> &m) {
 	const ServerUpdatingAuthenticatorPrx prx = getServerUpdatingAuthenticator(server);
 	if (! prx)
 		return;
@@ -740,9 +740,7 @@ void  MurmurIce::getRegisteredUsersSlot(const QString &filter, QMap<int, QString
 		m.insert((*i).first, u8((*i).second));
 }
 
-void MurmurIce::setInfoSlot(int &res, int id, const QMap<int, QString> &info) {
-	::Server *server = qobject_cast< ::Server *> (sender());
-
+void MurmurIce::setInfoSlot(::Server *server, int &res, int id, const QMap<int, QString> &info) {
 	const ServerUpdatingAuthenticatorPrx prx = getServerUpdatingAuthenticator(server);
 	if (! prx)
 		return;
@@ -757,9 +755,7 @@ void MurmurIce::setInfoSlot(int &res, int id, const QMap<int, QString> &info) {
 	}
 }
 
-void MurmurIce::setTextureSlot(int &res, int id, const QByteArray &texture) {
-	::Server *server = qobject_cast< ::Server *> (sender());
-
+void MurmurIce::setTextureSlot(::Server *server, int &res, int id, const QByteArray &texture) {
 	const ServerUpdatingAuthenticatorPrx prx = getServerUpdatingAuthenticator(server);
 	if (! prx)
 		return;
@@ -777,12 +773,91 @@ void MurmurIce::setTextureSlot(int &res, int id, const QByteArray &texture) {
 	}
 }
 
+MurmurIceRelay::MurmurIceRelay(::Server *srv) : QObject(srv), server(srv) {
+}
+
+MurmurIceRelay *MurmurIceRelay::find(::Server *srv) {
+	return srv->findChild<MurmurIceRelay *>();
+}
+
+void MurmurIceRelay::authenticateSlot(int &res, QString &uname, int sessionId, const QList<QSslCertificate> &certlist, const QString &certhash, bool certstrong, const QString &pw) {
+	mi->authenticateSlot(server, res, uname, sessionId, certlist, certhash, certstrong, pw);
+}
+
+void MurmurIceRelay::registerUserSlot(int &res, const QMap<int, QString> &info) {
+	mi->registerUserSlot(server, res, info);
+}
+
+void MurmurIceRelay::unregisterUserSlot(int &res, int id) {
+	mi->unregisterUserSlot(server, res, id);
+}
+
+void MurmurIceRelay::getRegisteredUsersSlot(const QString &filter, QMap<int, QString> &res) {
+	mi->getRegisteredUsersSlot(server, filter, res);
+}
+
+void MurmurIceRelay::getRegistrationSlot(int &res, int id, QMap<int, QString> &info) {
+	mi->getRegistrationSlot(server, res, id, info);
+}
+
+void MurmurIceRelay::setInfoSlot(int &res, int id, const QMap<int, QString> &info) {
+	mi->setInfoSlot(server, res, id, info);
+}
+
+void MurmurIceRelay::setTextureSlot(int &res, int id, const QByteArray &texture) {
+	mi->setTextureSlot(server, res, id, texture);
+}
+
+void MurmurIceRelay::nameToIdSlot(int &res, const QString &name) {
+	mi->nameToIdSlot(server, res, name);
+}
+
+void MurmurIceRelay::idToNameSlot(QString &res, int id) {
+	mi->idToNameSlot(server, res, id);
+}
+
+void MurmurIceRelay::idToTextureSlot(QByteArray &res, int id) {
+	mi->idToTextureSlot(server, res, id);
+}
+
+void MurmurIceRelay::userStateChanged(const ::User *p) {
+	mi->userStateChanged(server, p);
+}
+
+void MurmurIceRelay::userTextMessage(const ::User *p, const ::TextMessage &message) {
+	mi->userTextMessage(server, p, message);
+}
+
+void MurmurIceRelay::userConnected(const ::User *p) {
+	mi->userConnected(server, p);
+}
+
+void MurmurIceRelay::userDisconnected(const ::User *p) {
+	mi->userDisconnected(server, p);
+}
+
+void MurmurIceRelay::channelStateChanged(const ::Channel *c) {
+	mi->channelStateChanged(server, c);
+}
+
+void MurmurIceRelay::channelCreated(const ::Channel *c) {
+	mi->channelCreated(server, c);
+}
+
+void MurmurIceRelay::channelRemoved(const ::Channel *c) {
+	mi->channelRemoved(server, c);
+}
+
+void MurmurIceRelay::contextAction(const ::User *pSrc, const QString &action, unsigned int session, int iChannel) {
+	mi->contextAction(server, pSrc, action, session, iChannel);
+}
+
 Ice::ObjectPtr ServerLocator::locate(const Ice::Current &, Ice::LocalObjectPtr &) {
 	return iopServer;
 }
 
 #define FIND_SERVER \
-	::Server *server = meta->qhServers.value(server_id);
+	::Server *server = meta->server(server_id);
 
 #define NEED_SERVER_EXISTS \
 	FIND_SERVER \
@@ -798,6 +873,14 @@ Ice::ObjectPtr ServerLocator::locate(const Ice::Current &, Ice::LocalObjectPtr &
 		return; \
 	}
 
+// Starting, stopping and deleting servers is up to the main thread. A call
+// picked up by a server's control thread while it was stopping goes back.
+#define NEED_MAIN_THREAD(call) \
+	if (QThread::currentThread() != mi->thread()) { \
+		QCoreApplication::instance()->postEvent(mi, new ExecEvent(call)); \
+		return; \
+	}
+
 #define NEED_PLAYER \
 	ServerUser *user = server->qhUsers.value(session); \
 	if (!user) { \
@@ -830,6 +913,7 @@ static void impl_Server_isRunning(const ::Murmur::AMD_Server_isRunningPtr cb, in
 }
 
 static void impl_Server_start(const ::Murmur::AMD_Server_startPtr cb, int server_id) {
+	NEED_MAIN_THREAD(boost::bind(&impl_Server_start, cb, server_id));
 	NEED_SERVER_EXISTS;
 	if (server)
 		cb->ice_exception(ServerBootedException());
@@ -840,12 +924,14 @@ static void impl_Server_start(const ::Murmur::AMD_Server_startPtr cb, int server
 }
 
 static void impl_Server_stop(const ::Murmur::AMD_Server_stopPtr cb, int server_id) {
+	NEED_MAIN_THREAD(boost::bind(&impl_Server_stop, cb, server_id));
 	NEED_SERVER;
 	meta->kill(server_id);
 	cb->ice_response();
 }
 
 static void impl_Server_delete(const ::Murmur::AMD_Server_deletePtr cb, int server_id) {
+	NEED_MAIN_THREAD(boost::bind(&impl_Server_delete, cb, server_id));
 	NEED_SERVER_EXISTS;
 	if (server) {
 		cb->ice_exception(ServerBootedException());
@@ -883,7 +969,7 @@ static void impl_Server_setAuthenticator(const ::Murmur::AMD_Server_setAuthentic
 	NEED_SERVER;
 
 	if (mi->getServerAuthenticator(server))
-		server->disconnectAuthenticator(mi);
+		server->disconnectAuthenticator(MurmurIceRelay::find(server));
 
 	::Murmur::ServerAuthenticatorPrx prx;
 
@@ -900,7 +986,7 @@ static void impl_Server_setAuthenticator(const ::Murmur::AMD_Server_setAuthentic
 	}
 
 	if (prx)
-		server->connectAuthenticator(mi);
+		server->connectAuthenticator(MurmurIceRelay::find(server));
 
 	cb->ice_response();
 }
@@ -1072,7 +1158,8 @@ static void impl_Server_setBans(const ::Murmur::AMD_Server_setBansPtr cb, int se
 	foreach(const ::Murmur::Ban &mb, bans) {
 		::Ban ban;
 		banToBan(mb, ban);
-		server->qlBans << ban;
+		if (ban.isValid())
+			server->qlBans << ban;
 	}
 	server->saveBans();
 	cb->ice_response();
@@ -1385,7 +1472,7 @@ static void impl_Server_setACL(const ::Murmur::AMD_Server_setACLPtr cb, int serv
 		acl->pAllow = static_cast<ChanACL::Permissions>(ai.allow) & ChanACL::All;
 	}
 
-	server->clearACLCache();
+	server->clearACLCache(channel);
 	server->updateChannel(channel);
 	cb->ice_response();
 }
@@ -1566,8 +1653,10 @@ static void impl_Server_addUserToGroup(const ::Murmur::AMD_Server_addUserToGroup
 	}
 
 	::Group *g = channel->qhGroups.value(qsgroup);
-	if (! g)
+	if (! g) {
 		g = new ::Group(channel, qsgroup);
+		server->clearACLCache(channel);
+	}
 
 	g->qsTemporary.insert(- session);
 	server->clearACLCache(user);
@@ -1587,8 +1676,10 @@ static void impl_Server_removeUserFromGroup(const ::Murmur::AMD_Server_removeUse
 	}
 
 	::Group *g = channel->qhGroups.value(qsgroup);
-	if (! g)
+	if (! g) {
 		g = new ::Group(channel, qsgroup);
+		server->clearACLCache(channel);
+	}
 
 	g->qsTemporary.remove(- session);
 	server->clearACLCache(user);
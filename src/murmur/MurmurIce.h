@@ -58,10 +58,14 @@ class MurmurIce : public QObject {
 		void badServerProxy(const ::Murmur::ServerCallbackPrx &prx, const ::Server* server);
 		void badAuthenticator(::Server *);
 		QList< ::Murmur::MetaCallbackPrx> qlMetaCallbacks;
+		/// Guards the per-server maps below, which servers running on
+		/// their own control thread use concurrently.
+		mutable QMutex qmServerMaps;
 		QMap<int, QList< ::Murmur::ServerCallbackPrx> > qmServerCallbacks;
 		QMap<int, QMap<int, QMap<QString, ::Murmur::ServerContextCallbackPrx> > > qmServerContextCallbacks;
 		QMap<int, ::Murmur::ServerAuthenticatorPrx> qmServerAuthenticator;
 		QMap<int, ::Murmur::ServerUpdatingAuthenticatorPrx> qmServerUpdatingAuthenticator;
+		const QList< ::Murmur::ServerCallbackPrx> getServerCallbacks(const ::Server* server) const;
 	public:
 		Ice::CommunicatorPtr communicator;
 		Ice::ObjectAdapterPtr adapter;
@@ -83,10 +87,48 @@ class MurmurIce : public QObject {
 		const ::Murmur::ServerUpdatingAuthenticatorPrx getServerUpdatingAuthenticator(const ::Server* server) const;
 		void removeServerUpdatingAuthenticator(const ::Server* server);
 
+		// Called through the server's MurmurIceRelay, on the server's thread.
+		void authenticateSlot(::Server *server, int &res, QString &uname, int sessionId, const QList<QSslCertificate> &certlist, const QString &certhash, bool certstrong, const QString &pw);
+		void registerUserSlot(::Server *server, int &res, const QMap<int, QString> &);
+		void unregisterUserSlot(::Server *server, int &res, int id);
+		void getRegisteredUsersSlot(::Server *server, const QString &filter, QMap<int, QString> &res);
+		void getRegistrationSlot(::Server *server, int &, int, QMap<int, QString> &);
+		void setInfoSlot(::Server *server, int &, int, const QMap<int, QString> &);
+		void setTextureSlot(::Server *server, int &res, int id, const QByteArray &texture);
+		void nameToIdSlot(::Server *server, int &res, const QString &name);
+		void idToNameSlot(::Server *server, QString &res, int id);
+		void idToTextureSlot(::Server *server, QByteArray &res, int id);
+
+		void userStateChanged(::Server *s, const User *p);
+		void userTextMessage(::Server *s, const User *p, const TextMessage &);
+		void userConnected(::Server *s, const User *p);
+		void userDisconnected(::Server *s, const User *p);
+
+		void channelStateChanged(::Server *s, const Channel *c);
+		void channelCreated(::Server *s, const Channel *c);
+		void channelRemoved(::Server *s, const Channel *c);
+
+		void contextAction(::Server *s, const User *, const QString &, unsigned int, int);
+
 	public slots:
 		void started(Server *);
 		void stopped(Server *);
+};
 
+/// Receives the listener and authenticator signals of one server and passes
+/// them on to MurmurIce along with the server. It is a child of the server,
+/// so it lives on the server's thread and is called directly, without
+/// relying on sender().
+class MurmurIceRelay : public QObject {
+		Q_OBJECT;
+		Q_DISABLE_COPY(MurmurIceRelay);
+	protected:
+		::Server *server;
+	public:
+		MurmurIceRelay(::Server *srv);
+		static MurmurIceRelay *find(::Server *srv);
+
+	public slots:
 		void authenticateSlot(int &res, QString &uname, int sessionId, const QList<QSslCertificate> &certlist, const QString &certhash, bool certstrong, const QString &pw);
 		void registerUserSlot(int &res, const QMap<int, QString> &);
 		void unregisterUserSlot(int &res, int id);
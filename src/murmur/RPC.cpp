@@ -78,10 +78,15 @@ void Server::setUserState(User *pUser, Channel *cChannel, bool mute, bool deaf,
 		mpus.set_name(u8(name));
 	}
 
+	bool deafchanged = (deaf != pUser->bDeaf);
+
 	pUser->bDeaf = deaf;
 	pUser->bMute = mute;
 	pUser->bSuppress = suppressed;
 	pUser->bPrioritySpeaker = prioritySpeaker;
+
+	if (deafchanged)
+		invalidateFanout();
 	pUser->qsName = name;
 	hashAssign(pUser->qsComment, pUser->qbaCommentHash, comment);
 
@@ -129,8 +134,10 @@ bool Server::setChannelState(Channel *cChannel, Channel *cParent, const QString
 			return false;
 		}
 
-		cChannel->cParent->removeChannel(cChannel);
+		Channel *oldParent = cChannel->cParent;
+		oldParent->removeChannel(cChannel);
 		cParent->addChannel(cChannel);
+		clearACLCache(cChannel, oldParent);
 
 		mpcs.set_parent(cParent->iId);
 
@@ -245,6 +252,7 @@ void Server::setTempGroups(int userid, int sessionId, Channel *cChannel, const Q
 		g = cChannel->qhGroups.value(gname);
 		if (! g) {
 			g = new Group(cChannel, gname);
+			clearACLCache(cChannel);
 		}
 		g->qsTemporary.insert(userid);
 		if (sessionId != 0)
@@ -282,17 +290,19 @@ void Server::clearTempGroups(User *user, Channel *cChannel, bool recurse) {
 	clearACLCache(user);
 }
 
+// Direct connections: the authenticator slots fill in reference arguments,
+// and listeners run on the server's thread, which may not be the main one.
 void Server::connectAuthenticator(QObject *obj) {
-	connect(this, SIGNAL(registerUserSig(int &, const QMap<int, QString> &)), obj, SLOT(registerUserSlot(int &, const QMap<int, QString> &)));
-	connect(this, SIGNAL(unregisterUserSig(int &, int)), obj, SLOT(unregisterUserSlot(int &, int)));
-	connect(this, SIGNAL(getRegisteredUsersSig(const QString &, QMap<int, QString> &)), obj, SLOT(getRegisteredUsersSlot(const QString &, QMap<int, QString> &)));
-	connect(this, SIGNAL(getRegistrationSig(int &, int, QMap<int, QString> &)), obj, SLOT(getRegistrationSlot(int &, int, QMap<int, QString> &)));
-	connect(this, SIGNAL(authenticateSig(int &, QString &, int, const QList<QSslCertificate> &, const QString &, bool, const QString &)), obj, SLOT(authenticateSlot(int &, QString &, int, const QList<QSslCertificate> &, const QString &, bool, const QString &)));
-	connect(this, SIGNAL(setInfoSig(int &, int, const QMap<int, QString> &)), obj, SLOT(setInfoSlot(int &, int, const QMap<int, QString> &)));
-	connect(this, SIGNAL(setTextureSig(int &, int, const QByteArray &)), obj, SLOT(setTextureSlot(int &, int, const QByteArray &)));
-	connect(this, SIGNAL(idToNameSig(QString &, int)), obj, SLOT(idToNameSlot(QString &, int)));
-	connect(this, SIGNAL(nameToIdSig(int &, const QString &)), obj, SLOT(nameToIdSlot(int &, const QString &)));
-	connect(this, SIGNAL(idToTextureSig(QByteArray &, int)), obj, SLOT(idToTextureSlot(QByteArray &, int)));
+	connect(this, SIGNAL(registerUserSig(int &, const QMap<int, QString> &)), obj, SLOT(registerUserSlot(int &, const QMap<int, QString> &)), Qt::DirectConnection);
+	connect(this, SIGNAL(unregisterUserSig(int &, int)), obj, SLOT(unregisterUserSlot(int &, int)), Qt::DirectConnection);
+	connect(this, SIGNAL(getRegisteredUsersSig(const QString &, QMap<int, QString> &)), obj, SLOT(getRegisteredUsersSlot(const QString &, QMap<int, QString> &)), Qt::DirectConnection);
+	connect(this, SIGNAL(getRegistrationSig(int &, int, QMap<int, QString> &)), obj, SLOT(getRegistrationSlot(int &, int, QMap<int, QString> &)), Qt::DirectConnection);
+	connect(this, SIGNAL(authenticateSig(int &, QString &, int, const QList<QSslCertificate> &, const QString &, bool, const QString &)), obj, SLOT(authenticateSlot(int &, QString &, int, const QList<QSslCertificate> &, const QString &, bool, const QString &)), Qt::DirectConnection);
+	connect(this, SIGNAL(setInfoSig(int &, int, const QMap<int, QString> &)), obj, SLOT(setInfoSlot(int &, int, const QMap<int, QString> &)), Qt::DirectConnection);
+	connect(this, SIGNAL(setTextureSig(int &, int, const QByteArray &)), obj, SLOT(setTextureSlot(int &, int, const QByteArray &)), Qt::DirectConnection);
+	connect(this, SIGNAL(idToNameSig(QString &, int)), obj, SLOT(idToNameSlot(QString &, int)), Qt::DirectConnection);
+	connect(this, SIGNAL(nameToIdSig(int &, const QString &)), obj, SLOT(nameToIdSlot(int &, const QString &)), Qt::DirectConnection);
+	connect(this, SIGNAL(idToTextureSig(QByteArray &, int)), obj, SLOT(idToTextureSlot(QByteArray &, int)), Qt::DirectConnection);
 }
 
 void Server::disconnectAuthenticator(QObject *obj) {
@@ -309,13 +319,13 @@ void Server::disconnectAuthenticator(QObject *obj) {
 }
 
 void Server::connectListener(QObject *obj) {
-	connect(this, SIGNAL(userStateChanged(const User *)), obj, SLOT(userStateChanged(const User *)));
-	connect(this, SIGNAL(userTextMessage(const User *, const TextMessage &)), obj, SLOT(userTextMessage(const User *, const TextMessage &)));
-	connect(this, SIGNAL(userConnected(const User *)), obj, SLOT(userConnected(const User *)));
-	connect(this, SIGNAL(userDisconnected(const User *)), obj, SLOT(userDisconnected(const User *)));
-	connect(this, SIGNAL(channelStateChanged(const Channel *)), obj, SLOT(channelStateChanged(const Channel *)));
-	connect(this, SIGNAL(channelCreated(const Channel *)), obj, SLOT(channelCreated(const Channel *)));
-	connect(this, SIGNAL(channelRemoved(const Channel *)), obj, SLOT(channelRemoved(const Channel *)));
+	connect(this, SIGNAL(userStateChanged(const User *)), obj, SLOT(userStateChanged(const User *)), Qt::DirectConnection);
+	connect(this, SIGNAL(userTextMessage(const User *, const TextMessage &)), obj, SLOT(userTextMessage(const User *, const TextMessage &)), Qt::DirectConnection);
+	connect(this, SIGNAL(userConnected(const User *)), obj, SLOT(userConnected(const User *)), Qt::DirectConnection);
+	connect(this, SIGNAL(userDisconnected(const User *)), obj, SLOT(userDisconnected(const User *)), Qt::DirectConnection);
+	connect(this, SIGNAL(channelStateChanged(const Channel *)), obj, SLOT(channelStateChanged(const Channel *)), Qt::DirectConnection);
+	connect(this, SIGNAL(channelCreated(const Channel *)), obj, SLOT(channelCreated(const Channel *)), Qt::DirectConnection);
+	connect(this, SIGNAL(channelRemoved(const Channel *)), obj, SLOT(channelRemoved(const Channel *)), Qt::DirectConnection);
 }
 
 void Server::disconnectListener(QObject *obj) {
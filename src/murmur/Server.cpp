@@ -34,7 +34,9 @@
 #include "Server.h"
 
 #include "ACL.h"
+#include "ACLProgram.h"
 #include "Connection.h"
+#include "DBWorker.h"
 #include "Group.h"
 #include "User.h"
 #include "Channel.h"
@@ -55,6 +57,148 @@
 
 #define UDP_PACKET_SIZE 1024
 
+// Bytes of voice tunneled over TCP that may be waiting for the main thread.
+#define TUNNEL_BACKLOG 65536
+
+// Candidates whose expected IV is at most this far behind a packet from an
+// unknown peer get the first trial decryptions.
+#define PEER_IV_GAP 4
+
+// Most trial decryptions spent on one datagram from an unknown peer. Only
+// clients that don't send a hint are looked for this way.
+#define PEER_MAX_TRIALS 16
+
+static void deleteSnapshot(VoiceSnapshot *vs) {
+	delete vs;
+}
+
+static void deleteRecipients(WhisperRecipients *wr) {
+	delete wr;
+}
+
+#ifdef Q_OS_LINUX
+#define UDP_BATCH_MAX 64
+#define PKTINFO_SPACE CMSG_SPACE(MAX(sizeof(struct in6_pktinfo),sizeof(struct in_pktinfo)))
+
+/// Receive side of the batched voice I/O. Holds the headers and buffers
+/// for up to UDP_BATCH_MAX datagrams read with a single recvmmsg().
+struct UDPRecvBatch {
+	struct mmsghdr mmsg[UDP_BATCH_MAX];
+	struct iovec iov[UDP_BATCH_MAX];
+	sockaddr_storage from[UDP_BATCH_MAX];
+	u_char control[UDP_BATCH_MAX][PKTINFO_SPACE];
+	// Offset by 4 bytes in packet(), so the payload after the crypt header is 8-byte aligned.
+	quint64 data[UDP_BATCH_MAX][(UDP_PACKET_SIZE + 16) / 8];
+	int iSize;
+	bool bMulti;
+
+	UDPRecvBatch(int size) : iSize(size), bMulti(size > 1) {};
+	char *packet(int i) {
+		return reinterpret_cast<char *>(data[i]) + 4;
+	};
+	int receive(int sock);
+};
+
+int UDPRecvBatch::receive(int sock) {
+	int n = bMulti ? iSize : 1;
+	for (int i=0;i<n;++i) {
+		iov[i].iov_base = packet(i);
+		iov[i].iov_len = UDP_PACKET_SIZE;
+
+		struct msghdr &msg = mmsg[i].msg_hdr;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name = reinterpret_cast<struct sockaddr *>(&from[i]);
+		msg.msg_namelen = sizeof(from[i]);
+		msg.msg_iov = &iov[i];
+		msg.msg_iovlen = 1;
+		msg.msg_control = control[i];
+		msg.msg_controllen = sizeof(control[i]);
+		mmsg[i].msg_len = 0;
+	}
+
+	if (bMulti) {
+		int ret = ::recvmmsg(sock, mmsg, n, MSG_DONTWAIT | MSG_TRUNC, NULL);
+		if ((ret != SOCKET_ERROR) || (errno != ENOSYS))
+			return ret;
+		qWarning("Server: recvmmsg() not supported, falling back to single datagram reads");
+		bMulti = false;
+	}
+
+	ssize_t len = ::recvmsg(sock, &mmsg[0].msg_hdr, MSG_TRUNC);
+	if (len == SOCKET_ERROR)
+		return SOCKET_ERROR;
+	mmsg[0].msg_len = static_cast<unsigned int>(len);
+	return 1;
+}
+
+/// Send side of the batched voice I/O. Datagrams queued by the voice
+/// thread are written with a single sendmmsg() by Server::flushUdpBatch().
+struct UDPSendBatch {
+	struct mmsghdr mmsg[UDP_BATCH_MAX];
+	struct iovec iov[UDP_BATCH_MAX];
+	quint64 data[UDP_BATCH_MAX][(UDP_PACKET_SIZE + 16) / 8];
+	int iSize;
+	int iCount;
+	int iSocket;
+	bool bMulti;
+
+	UDPSendBatch(int size) : iSize(size), iCount(0), iSocket(-1), bMulti(true) {};
+	char *packet(int i) {
+		return reinterpret_cast<char *>(data[i]) + 4;
+	};
+};
+
+// Builds the destination and source address (IP_PKTINFO) of datagrams to u
+// once, so sending only has to add the payload. Leaves bUdpHeader unset if
+// packets can't be sent from the address the client connected to.
+static void setupUdpHeader(ServerUser *u) {
+	struct msghdr *msg = & u->mhUdp;
+	u_char *controldata = u->ucUdpControl;
+
+	u->bUdpHeader = false;
+	memset(msg, 0, sizeof(*msg));
+	memset(controldata, 0, sizeof(u->ucUdpControl));
+
+	msg->msg_name = reinterpret_cast<struct sockaddr *>(& u->saiUdpAddress);
+	msg->msg_namelen = (u->saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+	msg->msg_control = controldata;
+	msg->msg_controllen = CMSG_SPACE((u->saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct in6_pktinfo) : sizeof(struct in_pktinfo));
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+	HostAddress tcpha(u->saiTcpLocalAddress);
+	if (u->saiUdpAddress.ss_family == AF_INET6) {
+		cmsg->cmsg_level = IPPROTO_IPV6;
+		cmsg->cmsg_type = IPV6_PKTINFO;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
+		struct in6_pktinfo *pktinfo = reinterpret_cast<struct in6_pktinfo *>(CMSG_DATA(cmsg));
+		memcpy(&pktinfo->ipi6_addr.s6_addr[0], &tcpha.qip6.c[0], sizeof(pktinfo->ipi6_addr.s6_addr));
+	} else {
+		cmsg->cmsg_level = IPPROTO_IP;
+		cmsg->cmsg_type = IP_PKTINFO;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
+		struct in_pktinfo *pktinfo = reinterpret_cast<struct in_pktinfo *>(CMSG_DATA(cmsg));
+		if (tcpha.isV6())
+			return;
+		pktinfo->ipi_spec_dst.s_addr = tcpha.hash[3];
+	}
+	u->bUdpHeader = true;
+}
+#endif
+
+// True if datagrams can be sent to u. Checked before encrypting, as every
+// packet encrypted but not sent uses up an IV the client counts as lost.
+// The acquire pairs with the release made when the UDP peer is associated,
+// so the socket, address and header are complete once this returns true.
+static inline bool udpReady(ServerUser *u) {
+	if (! u->iUdpReady.fetchAndAddAcquire(0))
+		return false;
+#ifdef Q_OS_LINUX
+	return u->bUdpHeader;
+#else
+	return true;
+#endif
+}
+
 LogEmitter::LogEmitter(QObject *p) : QObject(p) {
 };
 
@@ -62,14 +206,19 @@ void LogEmitter::addLogEntry(const QString &msg) {
 	emit newLogEntry(msg);
 };
 
-ExecEvent::ExecEvent(boost::function<void ()> f) : QEvent(static_cast<QEvent::Type>(EXEC_QEVENT)) {
+ExecEvent::ExecEvent(boost::function<void ()> f, int server) : QEvent(static_cast<QEvent::Type>(EXEC_QEVENT)) {
 	func = f;
+	iServer = server;
 }
 
 void ExecEvent::execute() {
 	func();
 }
 
+ExecEvent *ExecEvent::redirect() const {
+	return new ExecEvent(func);
+}
+
 SslServer::SslServer(QObject *p) : QTcpServer(p) {
 }
 
@@ -126,6 +275,7 @@ QSslSocket *SslServer::nextPendingSSLConnection() {
 
 Server::Server(int snum, QObject *p) : QThread(p) {
 	bValid = true;
+	qapSnapshot.fetchAndStoreOrdered(new VoiceSnapshot());
 	iServerNum = snum;
 #ifdef USE_BONJOUR
 	bsRegistration = NULL;
@@ -137,6 +287,7 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 	hNotify = NULL;
 #endif
 	qtTimeout = new QTimer(this);
+	ctControl = NULL;
 
 	iCodecAlpha = iCodecBeta = 0;
 	bPreferAlpha = false;
@@ -144,9 +295,20 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 
 	qnamNetwork = NULL;
 
+	bTargetsDirty = bTargetsPending = false;
+	bFanoutDirty = bFanoutPending = false;
+
+	dbwWorker = new DBWorker(QString::fromLatin1("murmur-auth-%1").arg(iServerNum));
+
+	acCache.apProgram = new ACLProgram();
+
 	readParams();
 	initialize();
 
+	uiTlsHandshakes = uiTlsResumed = uiTlsKernel = 0;
+	iHandshakes = 0;
+	tkTickets.fromString(getConf("sslTicketKeys", QString()).toString());
+
 	foreach(const QHostAddress &qha, qlBind) {
 		SslServer *ss = new SslServer(this);
 
@@ -253,11 +415,13 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 		bValid = false;
 		return;
 	}
+
+	initVoiceThreads();
 #else
 	hNotify = CreateEvent(NULL, FALSE, FALSE, NULL);
 #endif
 
-	connect(this, SIGNAL(tcpTransmit(QByteArray, unsigned int)), this, SLOT(tcpTransmitData(QByteArray, unsigned int)), Qt::QueuedConnection);
+	connect(this, SIGNAL(tcpTransmit(unsigned int)), this, SLOT(tcpTransmitData(unsigned int)), Qt::QueuedConnection);
 	connect(this, SIGNAL(reqSync(unsigned int)), this, SLOT(doSync(unsigned int)));
 
 	for (int i=1;i<iMaxUsers*2;++i)
@@ -317,9 +481,12 @@ void Server::stopThread() {
 		log("Ending voice thread");
 
 #ifdef Q_OS_UNIX
-		unsigned char val = 0;
-		if (::write(aiNotify[1], &val, 1) != 1)
-			log("Failed to signal voice thread");
+		// Every voice thread consumes exactly one byte.
+		for (int i=0;i<=qlVoiceThreads.count();++i) {
+			unsigned char val = 0;
+			if (::write(aiNotify[1], &val, 1) != 1)
+				log("Failed to signal voice thread");
+		}
 #else
 		SetEvent(hNotify);
 #endif
@@ -331,19 +498,79 @@ void Server::stopThread() {
 	qtTimeout->stop();
 }
 
+void Server::startControl() {
+	if (ctControl)
+		return;
+
+	log("Starting control thread");
+	ctControl = new ControlThread(this);
+	moveToThread(ctControl);
+	// Not a child, so it doesn't move along.
+	qtTick.moveToThread(ctControl);
+	ctControl->start();
+}
+
+void Server::stopControl() {
+	// Handshakes still running would be handed to us after the thread
+	// has quit.
+	meta->hpHandshakes.close(this);
+
+	if (! ctControl)
+		return;
+
+	log("Ending control thread");
+	ctControl->quit();
+	ctControl->wait();
+	delete ctControl;
+	ctControl = NULL;
+}
+
+ControlThread::ControlThread(Server *srv) : QThread(), s(srv) {
+}
+
+void ControlThread::run() {
+	ServerDB::attachThread(QString::fromLatin1("murmur-control-%1").arg(s->iServerNum));
+
+	exec();
+
+	// Whatever was already queued for the server, such as RPC calls, still
+	// runs here; anything left would be lost once it's deleted.
+	QCoreApplication::sendPostedEvents();
+	QCoreApplication::sendPostedEvents(NULL, QEvent::DeferredDelete);
+
+	QThread *main = QCoreApplication::instance()->thread();
+	s->moveToThread(main);
+	s->qtTick.moveToThread(main);
+
+	ServerDB::detachThread();
+}
+
 Server::~Server() {
+	stopControl();
+
 #ifdef USE_BONJOUR
 	removeBonjour();
 #endif
 
+	// Jobs still on dbwWorker may try to post to the pool; close() makes
+	// sure they can't, and nothing will be left to run for us after.
+	meta->hpPasswords.close(this);
+	delete dbwWorker;
+	meta->hpPasswords.forget(this);
+	meta->hpHandshakes.forget(this);
+
 	stopThread();
 
 	foreach(QSocketNotifier *qsn, qlUdpNotifier)
 		delete qsn;
 
 #ifdef Q_OS_UNIX
+	qDeleteAll(qlVoiceThreads);
+
 	foreach(int s, qlUdpSocket)
 		close(s);
+	foreach(int s, qlReuseSocket)
+		close(s);
 
 	if (aiNotify[0] >= 0)
 		close(aiNotify[0]);
@@ -356,6 +583,10 @@ Server::~Server() {
 		CloseHandle(hNotify);
 #endif
 	clearACLCache();
+	delete acCache.apProgram;
+
+	veVoice.reclaim();
+	delete qapSnapshot.fetchAndStoreOrdered(NULL);
 
 	log("Stopped");
 }
@@ -528,6 +759,8 @@ void Server::setLiveConf(const QString &key, const QString &value) {
 		QString text = !v.isNull() ? v : Meta::mp.qsRegName;
 		if (text != qsRegName) {
 			qsRegName = text;
+			qbaJoinChannels[0].clear();
+			qbaJoinChannels[1].clear();
 			if (! qsRegName.isEmpty()) {
 				MumbleProto::ChannelState mpcs;
 				mpcs.set_channel_id(0);
@@ -651,25 +884,155 @@ void Server::udpActivated(int socket) {
 	}
 }
 
+#ifdef Q_OS_UNIX
+#if defined(Q_OS_LINUX) && defined(SO_REUSEPORT)
+// Opens another UDP socket bound to the same address as sock, with the same options.
+static int cloneUdpSocket(int sock) {
+	sockaddr_storage addr;
+	socklen_t len = sizeof(addr);
+	memset(&addr, 0, sizeof(addr));
+	if (getsockname(sock, reinterpret_cast<struct sockaddr *>(&addr), &len) == SOCKET_ERROR)
+		return INVALID_SOCKET;
+
+	int clone = ::socket(addr.ss_family, SOCK_DGRAM, 0);
+	if (clone == INVALID_SOCKET)
+		return INVALID_SOCKET;
+
+	int sockopt = 1;
+	setsockopt(clone, SOL_SOCKET, SO_REUSEPORT, &sockopt, sizeof(sockopt));
+	setsockopt(clone, IPPROTO_IP, IP_PKTINFO, &sockopt, sizeof(sockopt));
+	setsockopt(clone, IPPROTO_IPV6, IPV6_RECVPKTINFO, &sockopt, sizeof(sockopt));
+
+	const int copyopts[][2] = {
+		{ IPPROTO_IPV6, IPV6_V6ONLY },
+		{ IPPROTO_IP, IP_TOS },
+		{ SOL_SOCKET, SO_PRIORITY }
+	};
+	for (unsigned int i=0;i<sizeof(copyopts)/sizeof(copyopts[0]);++i) {
+		if ((copyopts[i][0] == IPPROTO_IPV6) && (addr.ss_family != AF_INET6))
+			continue;
+		int val = 0;
+		socklen_t optlen = sizeof(val);
+		if (getsockopt(sock, copyopts[i][0], copyopts[i][1], &val, &optlen) == 0)
+			setsockopt(clone, copyopts[i][0], copyopts[i][1], &val, optlen);
+	}
+
+	if (::bind(clone, reinterpret_cast<sockaddr *>(&addr), len) == SOCKET_ERROR) {
+		close(clone);
+		return INVALID_SOCKET;
+	}
+	return clone;
+}
+#endif
+
+void Server::initVoiceThreads() {
+	int nthreads = Meta::mp.iVoiceThreads;
+
+	QList<QList<int> > shards;
+	shards << qlUdpSocket;
+
+#if defined(Q_OS_LINUX) && defined(SO_REUSEPORT)
+	// Ask the kernel to spread peers over one socket per thread. As the
+	// primary socket is already bound, SO_REUSEPORT has to be enabled on it
+	// before the clones may bind to the same address.
+	bool reuse = (nthreads > 1);
+	foreach(int sock, qlUdpSocket) {
+		int sockopt = 1;
+		if (reuse && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &sockopt, sizeof(sockopt)))
+			reuse = false;
+	}
+	for (int i=1;reuse && (i<nthreads);++i) {
+		QList<int> shard;
+		foreach(int sock, qlUdpSocket) {
+			int clone = cloneUdpSocket(sock);
+			if (clone == INVALID_SOCKET) {
+				log("Failed to create SO_REUSEPORT voice socket");
+				break;
+			}
+			qlReuseSocket << clone;
+			shard << clone;
+
+			QSocketNotifier *qsn = new QSocketNotifier(clone, QSocketNotifier::Read, this);
+			connect(qsn, SIGNAL(activated(int)), this, SLOT(udpActivated(int)));
+			qlUdpNotifier << qsn;
+		}
+		if (shard.count() == qlUdpSocket.count())
+			shards << shard;
+		else
+			reuse = false;
+	}
+#endif
+	if ((shards.count() == 1) && (nthreads > 1)) {
+		// No socket sharing; split the bound addresses between the threads instead.
+		shards.clear();
+		for (int i=0;i<qlUdpSocket.count();++i) {
+			if (shards.count() < nthreads)
+				shards << QList<int>();
+			shards[i % nthreads] << qlUdpSocket.at(i);
+		}
+	}
+
+	qlVoiceSocket = shards.takeFirst();
+	foreach(const QList<int> &shard, shards)
+		qlVoiceThreads << new VoiceThread(this, shard);
+
+	if (! qlVoiceThreads.isEmpty())
+		log(QString("Forwarding voice with %1 threads").arg(qlVoiceThreads.count() + 1));
+}
+
+VoiceThread::VoiceThread(Server *srv, const QList<int> &sockets) : QThread(srv), s(srv), qlSockets(sockets) {
+}
+
+void VoiceThread::run() {
+	s->voiceLoop(qlSockets);
+}
+#endif
+
 void Server::run() {
+#ifdef Q_OS_UNIX
+	// Discard wakeups left over from threads that exited on their own.
+	unsigned char val;
+	while (::recv(aiNotify[0], &val, 1, MSG_DONTWAIT) == 1) {};
+
+	foreach(VoiceThread *vt, qlVoiceThreads)
+		vt->start(QThread::HighestPriority);
+
+	voiceLoop(qlVoiceSocket);
+
+	foreach(VoiceThread *vt, qlVoiceThreads)
+		vt->wait();
+#else
+	voiceLoop(qlUdpSocket);
+#endif
+}
+
+#ifdef Q_OS_UNIX
+void Server::voiceLoop(const QList<int> &sockets) {
+#else
+void Server::voiceLoop(const QList<SOCKET> &sockets) {
+#endif
 	qint32 len;
+#ifndef Q_OS_LINUX
 #if defined(__LP64__)
 	char encbuff[UDP_PACKET_SIZE+8];
 	char *encrypt = encbuff + 4;
 #else
 	char encrypt[UDP_PACKET_SIZE];
+#endif
+	sockaddr_storage from;
 #endif
 	char buffer[UDP_PACKET_SIZE];
 
-	sockaddr_storage from;
-	int nfds = qlUdpSocket.count();
+	int nfds = sockets.count();
 
 #ifdef Q_OS_UNIX
+#ifndef Q_OS_LINUX
 	socklen_t fromlen;
+#endif
 	STACKVAR(struct pollfd, fds, nfds+1);
 
 	for (int i=0;i<nfds;++i) {
-		fds[i].fd = qlUdpSocket.at(i);
+		fds[i].fd = sockets.at(i);
 		fds[i].events = POLLIN;
 		fds[i].revents = 0;
 	}
@@ -682,16 +1045,29 @@ void Server::run() {
 	STACKVAR(SOCKET, fds, nfds);
 	STACKVAR(HANDLE, events, nfds+1);
 	for (int i=0;i<nfds;++i) {
-		fds[i] = qlUdpSocket.at(i);
+		fds[i] = sockets.at(i);
 		events[i] = CreateEvent(NULL, FALSE, FALSE, NULL);
 		::WSAEventSelect(fds[i], events[i], FD_READ);
 	}
 	events[nfds] = hNotify;
 #endif
 
+#ifdef Q_OS_LINUX
+	int batchsize = qBound(1, Meta::mp.iUdpBatchSize, UDP_BATCH_MAX);
+	UDPRecvBatch *urbBatch = new UDPRecvBatch(batchsize);
+	UDPSendBatch *usbBatch = NULL;
+	if (batchsize > 1) {
+		usbBatch = new UDPSendBatch(batchsize);
+		qtsBatch.setLocalData(usbBatch);
+	}
+#endif
+
+	int slot = veVoice.registerReader();
+
 	++nfds;
 
 	while (bRunning) {
+		veVoice.leave(slot);
 #ifdef Q_OS_UNIX
 		int pret = poll(fds, nfds, -1);
 		if (pret <= 0) {
@@ -703,9 +1079,10 @@ void Server::run() {
 		}
 
 		if (fds[nfds - 1].revents) {
-			// Drain pipe
+			// Take our wakeup; the other voice threads need theirs.
 			unsigned char val;
-			while (::recv(aiNotify[0], &val, 1, MSG_DONTWAIT) == 1) {};
+			if (::recv(aiNotify[0], &val, 1, MSG_DONTWAIT) != 1)
+				continue;
 			break;
 		}
 
@@ -733,128 +1110,147 @@ void Server::run() {
 				SOCKET sock = fds[ret - WAIT_OBJECT_0];
 #endif
 
-				fromlen = sizeof(from);
-#ifdef Q_OS_WIN
-				len=::recvfrom(sock, encrypt, UDP_PACKET_SIZE, 0, reinterpret_cast<struct sockaddr *>(&from), &fromlen);
-#else
 #ifdef Q_OS_LINUX
-				struct msghdr msg;
-				struct iovec iov[1];
-
-				iov[0].iov_base = encrypt;
-				iov[0].iov_len = UDP_PACKET_SIZE;
-
-				u_char controldata[CMSG_SPACE(MAX(sizeof(struct in6_pktinfo),sizeof(struct in_pktinfo)))];
+				int nrecv = urbBatch->receive(sock);
+				if (nrecv == SOCKET_ERROR)
+					break;
 
-				memset(&msg, 0, sizeof(msg));
-				msg.msg_name = reinterpret_cast<struct sockaddr *>(&from);
-				msg.msg_namelen = sizeof(from);
-				msg.msg_iov = iov;
-				msg.msg_iovlen = 1;
-				msg.msg_control = controldata;
-				msg.msg_controllen = sizeof(controldata);
+				veVoice.enter(slot);
+				for (int j=0;j<nrecv;++j) {
+					sockaddr_storage &from = urbBatch->from[j];
+					struct msghdr &msg = urbBatch->mmsg[j].msg_hdr;
+					char *encrypt = urbBatch->packet(j);
 
-				len=static_cast<quint32>(::recvmsg(sock, &msg, MSG_TRUNC));
-				Q_UNUSED(fromlen);
+					len = static_cast<qint32>(urbBatch->mmsg[j].msg_len);
+					if (msg.msg_flags & MSG_TRUNC)
+						len = UDP_PACKET_SIZE + 1;
+#else
+				veVoice.enter(slot);
+				{
+					fromlen = sizeof(from);
+#ifdef Q_OS_WIN
+					len=::recvfrom(sock, encrypt, UDP_PACKET_SIZE, 0, reinterpret_cast<struct sockaddr *>(&from), &fromlen);
 #else
-				len=static_cast<qint32>(::recvfrom(sock, encrypt, UDP_PACKET_SIZE, MSG_TRUNC, reinterpret_cast<struct sockaddr *>(&from), &fromlen));
+					len=static_cast<qint32>(::recvfrom(sock, encrypt, UDP_PACKET_SIZE, MSG_TRUNC, reinterpret_cast<struct sockaddr *>(&from), &fromlen));
 #endif
 #endif
-				if (len == 0) {
-					break;
-				} else if (len == SOCKET_ERROR) {
-					break;
-				} else if (len < 5) {
-					// 4 bytes crypt header + type + session
-					continue;
-				} else if (len > UDP_PACKET_SIZE) {
-					continue;
-				}
+					// Skip only this datagram; the rest of a batch is still valid.
+					if ((len == 0) || (len == SOCKET_ERROR)) {
+						continue;
+					} else if (len < 5) {
+						// 4 bytes crypt header + type + session
+						continue;
+					} else if (len > UDP_PACKET_SIZE) {
+						continue;
+					}
 
-				QReadLocker rl(&qrwlUsers);
+					const VoiceSnapshot *vs = voiceSnapshot();
 
-				quint32 *ping = reinterpret_cast<quint32 *>(encrypt);
+					quint32 *ping = reinterpret_cast<quint32 *>(encrypt);
 
-				if ((len == 12) && (*ping == 0) && bAllowPing) {
-					ping[0] = uiVersionBlob;
-					// 1 and 2 will be the timestamp, which we return unmodified.
-					ping[3] = qToBigEndian(static_cast<quint32>(qhUsers.count()));
-					ping[4] = qToBigEndian(static_cast<quint32>(iMaxUsers));
-					ping[5] = qToBigEndian(static_cast<quint32>(iMaxBandwidth));
+					if ((len == 12) && (*ping == 0) && bAllowPing) {
+						ping[0] = uiVersionBlob;
+						// 1 and 2 will be the timestamp, which we return unmodified.
+						ping[3] = qToBigEndian(static_cast<quint32>(vs->qhUsers.count()));
+						ping[4] = qToBigEndian(static_cast<quint32>(iMaxUsers));
+						ping[5] = qToBigEndian(static_cast<quint32>(iMaxBandwidth));
 
 #ifdef Q_OS_LINUX
-					iov[0].iov_len = 6 * sizeof(quint32);
-					::sendmsg(sock, &msg, 0);
+						msg.msg_iov[0].iov_len = 6 * sizeof(quint32);
+						::sendmsg(sock, &msg, 0);
 #else
-					::sendto(sock, encrypt, 6 * sizeof(quint32), 0, reinterpret_cast<struct sockaddr *>(&from), fromlen);
+						::sendto(sock, encrypt, 6 * sizeof(quint32), 0, reinterpret_cast<struct sockaddr *>(&from), fromlen);
 #endif
-					continue;
-				}
+						continue;
+					}
 
 
-				quint16 port = (from.ss_family == AF_INET6) ? (reinterpret_cast<sockaddr_in6 *>(&from)->sin6_port) : (reinterpret_cast<sockaddr_in *>(&from)->sin_port);
-				const HostAddress &ha = HostAddress(from);
+					quint16 port = (from.ss_family == AF_INET6) ? (reinterpret_cast<sockaddr_in6 *>(&from)->sin6_port) : (reinterpret_cast<sockaddr_in *>(&from)->sin_port);
+					const HostAddress &ha = HostAddress(from);
 
-				const QPair<HostAddress, quint16> &key = QPair<HostAddress, quint16>(ha, port);
+					const QPair<HostAddress, quint16> &key = QPair<HostAddress, quint16>(ha, port);
 
-				ServerUser *u = qhPeerUsers.value(key);
-				if (u) {
-					if (! checkDecrypt(u, encrypt, buffer, len)) {
-						continue;
+					// Clients that haven't heard from us over UDP yet may name
+					// their session ahead of the datagram, see udp_hint.
+					unsigned int hint = 0;
+					const char *packet = encrypt;
+					if ((len > 12) && (ping[0] == 0)) {
+						hint = qFromBigEndian(ping[1]);
+						packet += 8;
+						len -= 8;
 					}
-				} else {
-					// Unknown peer
-					foreach(ServerUser *usr, qhHostUsers.value(ha)) {
-						if (usr->csCrypt.isValid() && checkDecrypt(usr, encrypt, buffer, len)) {
-							// Every time we relock, reverify users' existance.
-							// The main thread might delete the user while the lock isn't held.
-							unsigned int uiSession = usr->uiSession;
-							rl.unlock();
-							qrwlUsers.lockForWrite();
-							if (qhUsers.contains(uiSession)) {
+
+					ServerUser *u = vs->qhPeerUsers.value(key);
+					if (u) {
+						if ((hint && (hint != u->uiSession)) || ! checkDecrypt(u, packet, buffer, len)) {
+							continue;
+						}
+					} else {
+						// Unknown peer
+						ServerUser *usr = matchPeer(vs, ha, hint, packet, buffer, len);
+						if (usr) {
+							// The epoch keeps usr allocated, but the main thread might
+							// have removed it from the tables since the snapshot was taken.
+							QWriteLocker wl(&qrwlUsers);
+							if (qhUsers.value(usr->uiSession) == usr) {
 								u = usr;
-								u->sUdpSocket = sock;
 								memcpy(& u->saiUdpAddress, &from, sizeof(from));
-								qhHostUsers[from].remove(u);
+#ifdef Q_OS_LINUX
+								setupUdpHeader(u);
+#endif
+								u->sUdpSocket = sock;
+								// Other voice threads read these without the lock.
+								u->iUdpReady.fetchAndStoreRelease(1);
+								qhHostUsers[ha].remove(u);
 								qhPeerUsers.insert(key, u);
-								qrwlUsers.unlock();
-								rl.relock();
-								if (! qhUsers.contains(uiSession))
-									u = NULL;
+								publishUsers();
 							}
-							break;
+						}
+						if (! u) {
+							continue;
 						}
 					}
-					if (! u) {
-						continue;
+					len -= 4;
+
+					MessageHandler::UDPMessageType msgType = static_cast<MessageHandler::UDPMessageType>((buffer[0] >> 5) & 0x7);
+
+					switch (msgType) {
+						case MessageHandler::UDPVoiceSpeex:
+						case MessageHandler::UDPVoiceCELTAlpha:
+						case MessageHandler::UDPVoiceCELTBeta:
+							if (bOpus)
+								break;
+						case MessageHandler::UDPVoiceOpus: {
+								u->bUdp = true;
+								processMsg(u, buffer, len);
+								break;
+							}
+						case MessageHandler::UDPPing: {
+								QByteArray qba;
+								sendMessage(u, buffer, len, qba, true);
+							}
 					}
 				}
-				len -= 4;
-
-				MessageHandler::UDPMessageType msgType = static_cast<MessageHandler::UDPMessageType>((buffer[0] >> 5) & 0x7);
-
-				switch (msgType) {
-					case MessageHandler::UDPVoiceSpeex:
-					case MessageHandler::UDPVoiceCELTAlpha:
-					case MessageHandler::UDPVoiceCELTBeta:
-						if (bOpus)
-							break;
-					case MessageHandler::UDPVoiceOpus: {
-							u->bUdp = true;
-							processMsg(u, buffer, len);
-							break;
-						}
-					case MessageHandler::UDPPing: {
-							QByteArray qba;
-							sendMessage(u, buffer, len, qba, true);
-						}
-				}
+#ifdef Q_OS_LINUX
+				if (usbBatch)
+					flushUdpBatch(usbBatch);
+#endif
+				veVoice.leave(slot);
 #ifdef Q_OS_UNIX
 				fds[i].revents = 0;
 #endif
 			}
 		}
 	}
+	veVoice.unregisterReader(slot);
+#ifdef Q_OS_LINUX
+	if (usbBatch) {
+		flushUdpBatch(usbBatch);
+		// Deletes the batch.
+		qtsBatch.setLocalData(NULL);
+	}
+	delete urbBatch;
+#endif
 #ifdef Q_OS_WIN
 	for (int i=0;i<nfds-1;++i) {
 		::WSAEventSelect(fds[i], NULL, 0);
@@ -863,245 +1259,580 @@ void Server::run() {
 #endif
 }
 
-bool Server::checkDecrypt(ServerUser *u, const char *encrypt, char *plain, unsigned int len) {
-	if (u->csCrypt.isValid() && u->csCrypt.decrypt(reinterpret_cast<const unsigned char *>(encrypt), reinterpret_cast<unsigned char *>(plain), len))
-		return true;
+void Server::publishUsers(const Channel *changed, const Channel *changed2) {
+	VoiceSnapshot *old = voiceSnapshot();
+	VoiceSnapshot *vs = new VoiceSnapshot();
+
+	// Implicitly shared; our own tables detach on their next modification.
+	vs->qhUsers = qhUsers;
+	vs->qhPeerUsers = qhPeerUsers;
+	vs->qhHostUsers = qhHostUsers;
+	vs->qhListeners = old->qhListeners;
+	vs->qhLinkedListeners = old->qhLinkedListeners;
+
+	// Voice threads publish new peers only, and may not look at channels.
+	const bool main = (QThread::currentThread() == thread());
+	if (main)
+		buildFanout(vs, changed, changed2);
+
+	qapSnapshot.fetchAndStoreOrdered(vs);
+	veVoice.retire(boost::bind(&deleteSnapshot, old));
+	if (main)
+		veVoice.reclaim();
+}
 
-	if (u->csCrypt.tLastGood.elapsed() > 5000000ULL) {
-		if (u->csCrypt.tLastRequest.elapsed() > 5000000ULL) {
-			u->csCrypt.tLastRequest.restart();
-			emit reqSync(u->uiSession);
+static QVector<ServerUser *> listeners(const Channel *c) {
+	QVector<ServerUser *> v;
+	foreach(User *p, c->qlUsers)
+		if (! p->bDeaf && ! p->bSelfDeaf)
+			v.append(static_cast<ServerUser *>(p));
+	return v;
+}
+
+/* Updates the fan-out lists of vs for users having entered or left the
+ * channels changed and changed2, or builds all of them again if
+ * bFanoutDirty. The voice threads send normal speech to these lists
+ * without ever looking at a Channel, which the main thread may change or
+ * delete at any time. */
+void Server::buildFanout(VoiceSnapshot *vs, const Channel *changed, const Channel *changed2) {
+	bool linked = bFanoutDirty;
+
+	if (bFanoutDirty) {
+		vs->qhListeners.clear();
+		foreach(const Channel *c, qhChannels) {
+			const QVector<ServerUser *> v = listeners(c);
+			if (! v.isEmpty())
+				vs->qhListeners.insert(c, v);
+		}
+	} else {
+		const Channel *chans[2] = { changed, changed2 };
+		for (int i=0;i<2;++i) {
+			const Channel *c = chans[i];
+			if (! c)
+				continue;
+			const QVector<ServerUser *> v = listeners(c);
+			if (v.isEmpty())
+				vs->qhListeners.remove(c);
+			else
+				vs->qhListeners.insert(c, v);
+			if (! c->qhLinks.isEmpty())
+				linked = true;
 		}
 	}
-	return false;
-}
 
-void Server::sendMessage(ServerUser *u, const char *data, int len, QByteArray &cache, bool force) {
-	if ((u->bUdp || force) && (u->sUdpSocket != INVALID_SOCKET) && u->csCrypt.isValid()) {
-#if defined(__LP64__)
-		STACKVAR(char, ebuffer, len+4+16);
-		char *buffer = reinterpret_cast<char *>(((reinterpret_cast<quint64>(ebuffer) + 8) & ~7) + 4);
-#else
-		STACKVAR(char, buffer, len+4);
-#endif
-		u->csCrypt.encrypt(reinterpret_cast<const unsigned char *>(data), reinterpret_cast<unsigned char *>(buffer), len);
-#ifdef Q_OS_WIN
-		DWORD dwFlow = 0;
-		if (Meta::hQoS)
-			QOSAddSocketToFlow(Meta::hQoS, u->sUdpSocket, reinterpret_cast<struct sockaddr *>(& u->saiUdpAddress), QOSTrafficTypeVoice, QOS_NON_ADAPTIVE_FLOW, &dwFlow);
-#endif
-#ifdef Q_OS_LINUX
-		struct msghdr msg;
-		struct iovec iov[1];
+	bFanoutDirty = false;
 
-		iov[0].iov_base = buffer;
-		iov[0].iov_len = len+4;
+	// Only a change in a linked channel can change what reaches through links.
+	if (! linked)
+		return;
 
-		u_char controldata[CMSG_SPACE(MAX(sizeof(struct in6_pktinfo),sizeof(struct in_pktinfo)))];
-		memset(controldata, 0, sizeof(controldata));
+	vs->qhLinkedListeners.clear();
 
-		memset(&msg, 0, sizeof(msg));
-		msg.msg_name = reinterpret_cast<struct sockaddr *>(& u->saiUdpAddress);
-		msg.msg_namelen = (u->saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
-		msg.msg_iov = iov;
-		msg.msg_iovlen = 1;
-		msg.msg_control = controldata;
-		msg.msg_controllen = CMSG_SPACE((u->saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct in6_pktinfo) : sizeof(struct in_pktinfo));
-
-		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
-		HostAddress tcpha(u->saiTcpLocalAddress);
-		if (u->saiUdpAddress.ss_family == AF_INET6) {
-			cmsg->cmsg_level = IPPROTO_IPV6;
-			cmsg->cmsg_type = IPV6_PKTINFO;
-			cmsg->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
-			struct in6_pktinfo *pktinfo = reinterpret_cast<struct in6_pktinfo *>(CMSG_DATA(cmsg));
-			memset(pktinfo, 0, sizeof(*pktinfo));
-			memcpy(&pktinfo->ipi6_addr.s6_addr[0], &tcpha.qip6.c[0], sizeof(pktinfo->ipi6_addr.s6_addr));
-		} else {
-			cmsg->cmsg_level = IPPROTO_IP;
-			cmsg->cmsg_type = IP_PKTINFO;
-			cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
-			struct in_pktinfo *pktinfo = reinterpret_cast<struct in_pktinfo *>(CMSG_DATA(cmsg));
-			memset(pktinfo, 0, sizeof(*pktinfo));
-			if (tcpha.isV6())
-				return;
-			pktinfo->ipi_spec_dst.s_addr = tcpha.hash[3];
+	QMutexLocker qml(&qmCache);
+
+	foreach(Channel *c, qhChannels) {
+		if (c->qhLinks.isEmpty() || c->qlUsers.isEmpty())
+			continue;
+
+		QSet<Channel *> chans = c->allLinks();
+		chans.remove(c);
+
+		foreach(User *p, c->qlUsers) {
+			ServerUser *u = static_cast<ServerUser *>(p);
+			QVector<ServerUser *> fanout;
+			foreach(Channel *l, chans)
+				if (ChanACL::hasPermission(u, l, ChanACL::Speak, &acCache))
+					fanout += vs->qhListeners.value(l);
+			if (! fanout.isEmpty())
+				vs->qhLinkedListeners.insert(u->uiSession, fanout);
 		}
+	}
+}
 
+void Server::invalidateFanout() {
+	bFanoutDirty = true;
 
-		::sendmsg(u->sUdpSocket, &msg, 0);
-#else
-		::sendto(u->sUdpSocket, buffer, len+4, 0, reinterpret_cast<struct sockaddr *>(& u->saiUdpAddress), (u->saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
-#endif
-#ifdef Q_OS_WIN
-		if (Meta::hQoS && dwFlow)
-			QOSRemoveSocketFromFlow(Meta::hQoS, 0, dwFlow, 0);
-#else
-#endif
-	} else {
-		if (cache.isEmpty())
-			cache = QByteArray(data, len);
-		emit tcpTransmit(cache,u->uiSession);
+	if (! bFanoutPending) {
+		bFanoutPending = true;
+		QCoreApplication::instance()->postEvent(this, new ExecEvent(boost::bind(&Server::publishFanout, this)));
 	}
 }
 
-#define SENDTO \
-		if ((!pDst->bDeaf) && (!pDst->bSelfDeaf) && (pDst != u)) { \
-			if ((poslen > 0) && (pDst->ssContext == u->ssContext)) \
-				sendMessage(pDst, buffer, len, qba); \
-			else \
-				sendMessage(pDst, buffer, len - poslen, qba_npos); \
-		}
+void Server::publishFanout() {
+	bFanoutPending = false;
 
-void Server::processMsg(ServerUser *u, const char *data, int len) {
-	if (u->sState != ServerUser::Authenticated || u->bMute || u->bSuppress || u->bSelfMute)
+	// Some publishUsers() in between may have done it already.
+	if (! bFanoutDirty)
 		return;
 
-	User *p;
-	BandwidthRecord *bw = & u->bwr;
-	Channel *c = u->cChannel;
-	QByteArray qba, qba_npos;
-	unsigned int counter;
-	char buffer[UDP_PACKET_SIZE];
-	PacketDataStream pdi(data + 1, len - 1);
-	PacketDataStream pds(buffer+1, UDP_PACKET_SIZE-1);
-	unsigned int type = data[0] & 0xe0;
-	unsigned int target = data[0] & 0x1f;
-	unsigned int poslen;
+	QWriteLocker wl(&qrwlUsers);
+	publishUsers();
+}
 
-	// IP + UDP + Crypt + Data
-	int packetsize = 20 + 8 + 4 + len;
+void Server::invalidateTargets(ServerUser *u) {
+	if (u)
+		qsTargetsDirty.insert(u->uiSession);
+	else
+		bTargetsDirty = true;
 
-	// Check the voice data rate limit.
-	if (! bw->addFrame(packetsize, iMaxBandwidth/8)) {
-		// Suppress packet.
-		return;
+	if (! bTargetsPending) {
+		bTargetsPending = true;
+		QCoreApplication::instance()->postEvent(this, new ExecEvent(boost::bind(&Server::resolveTargets, this)));
 	}
+}
 
-	// Read the sequence number.
-	pdi >> counter;
+/* Publishes new recipient lists for every user whose whisper targets were
+ * invalidated, so the voice threads never have to work them out themselves.
+ * Runs on the main thread, normally once all changes made while handling an
+ * event are in. Should a user go away before then, connectionClosed() calls
+ * it right away, as no published list may outlive a user in it. */
+void Server::resolveTargets() {
+	QList<ServerUser *> users;
 
-	// Skip to the end of the voice data.
-	if ((type >> 5) != MessageHandler::UDPVoiceOpus) {
-		do {
-			counter = pdi.next8();
-			pdi.skip(counter & 0x7f);
-		} while ((counter & 0x80) && pdi.isValid());
+	if (bTargetsDirty) {
+		users = qhUsers.values();
 	} else {
-		int size;
-		pdi >> size;
-		pdi.skip(size & 0x1fff);
+		foreach(unsigned int id, qsTargetsDirty) {
+			ServerUser *u = qhUsers.value(id);
+			if (u)
+				users << u;
+		}
 	}
 
-	// Save location of the positional audio data.
-	poslen = pdi.left();
+	qsTargetsDirty.clear();
+	bTargetsDirty = bTargetsPending = false;
 
-	// Append session id to the new output stream.
-	pds << u->uiSession;
-	// Copy all voice and positional audio data to the output stream.
-	pds.append(data + 1, len - 1);
+	foreach(ServerUser *u, users) {
+		WhisperRecipients *wr = NULL;
 
-	len = pds.size() + 1;
+		if (! u->qmTargets.isEmpty()) {
+			wr = new WhisperRecipients();
 
-	if (target == 0x1f) { // Server loopback
-		buffer[0] = static_cast<char>(type | 0);
-		sendMessage(u, buffer, len, qba);
-		return;
-	} else if (target == 0) { // Normal speech
-		buffer[0] = static_cast<char>(type | 0);
-		foreach(p, c->qlUsers) {
-			ServerUser *pDst = static_cast<ServerUser *>(p);
-			SENDTO;
+			QMap<int, WhisperTarget>::const_iterator i;
+			for (i = u->qmTargets.constBegin(); i != u->qmTargets.constEnd(); ++i) {
+				wr->uiTargets |= (1U << i.key());
+				resolveTarget(u, i.value(), wr->qvChannel[i.key()], wr->qvDirect[i.key()]);
+			}
+		} else if (! u->qapTargets.fetchAndAddOrdered(0)) {
+			continue;
 		}
 
-		if (! c->qhLinks.isEmpty()) {
-			QSet<Channel *> chans = c->allLinks();
-			chans.remove(c);
+		WhisperRecipients *old = u->qapTargets.fetchAndStoreOrdered(wr);
+		if (old)
+			veVoice.retire(boost::bind(&deleteRecipients, old));
+	}
 
-			QMutexLocker qml(&qmCache);
+	veVoice.reclaim();
+}
 
-			foreach(Channel *l, chans) {
-				if (ChanACL::hasPermission(u, l, ChanACL::Speak, &acCache)) {
-					foreach(p, l->qlUsers) {
-						ServerUser *pDst = static_cast<ServerUser *>(p);
-						SENDTO;
-					}
-				}
-			}
-		}
-	} else if (u->qmTargets.contains(target)) { // Whisper
-		QSet<ServerUser *> channel;
-		QSet<ServerUser *> direct;
+void Server::resolveTarget(ServerUser *u, const WhisperTarget &wt, QVector<ServerUser *> &channelTarget, QVector<ServerUser *> &directTarget) {
+	QSet<ServerUser *> channel;
+	QSet<ServerUser *> direct;
 
-		if (u->qmTargetCache.contains(target)) {
-			const ServerUser::TargetCache &cache = u->qmTargetCache.value(target);
-			channel = cache.first;
-			direct = cache.second;
-		} else {
-			const WhisperTarget &wt = u->qmTargets.value(target);
-			if (! wt.qlChannels.isEmpty()) {
-				QMutexLocker qml(&qmCache);
-
-				foreach(const WhisperTarget::Channel &wtc, wt.qlChannels) {
-					Channel *wc = qhChannels.value(wtc.iId);
-					if (wc) {
-						bool link = wtc.bLinks && ! wc->qhLinks.isEmpty();
-						bool dochildren = wtc.bChildren && ! wc->qlChannels.isEmpty();
-						bool group = ! wtc.qsGroup.isEmpty();
-						if (!link && !dochildren && ! group) {
-							// Common case
-							if (ChanACL::hasPermission(u, wc, ChanACL::Whisper, &acCache)) {
-								foreach(p, wc->qlUsers) {
-									channel.insert(static_cast<ServerUser *>(p));
-								}
-							}
-						} else {
-							QSet<Channel *> channels;
-							if (link)
-								channels = wc->allLinks();
-							else
-								channels.insert(wc);
-							if (dochildren)
-								channels.unite(wc->allChildren());
-							const QString &redirect = u->qmWhisperRedirect.value(wtc.qsGroup);
-							const QString &qsg = redirect.isEmpty() ? wtc.qsGroup : redirect;
-							foreach(Channel *tc, channels) {
-								if (ChanACL::hasPermission(u, tc, ChanACL::Whisper, &acCache)) {
-									foreach(p, tc->qlUsers) {
-										ServerUser *su = static_cast<ServerUser *>(p);
-										if (! group || Group::isMember(tc, tc, qsg, su)) {
-											channel.insert(su);
-										}
-									}
-								}
+	QMutexLocker qml(&qmCache);
+
+	foreach(const WhisperTarget::Channel &wtc, wt.qlChannels) {
+		Channel *wc = qhChannels.value(wtc.iId);
+		if (wc) {
+			bool link = wtc.bLinks && ! wc->qhLinks.isEmpty();
+			bool dochildren = wtc.bChildren && ! wc->qlChannels.isEmpty();
+			bool group = ! wtc.qsGroup.isEmpty();
+			if (!link && !dochildren && ! group) {
+				// Common case
+				if (ChanACL::hasPermission(u, wc, ChanACL::Whisper, &acCache)) {
+					foreach(User *p, wc->qlUsers) {
+						channel.insert(static_cast<ServerUser *>(p));
+					}
+				}
+			} else {
+				QSet<Channel *> channels;
+				if (link)
+					channels = wc->allLinks();
+				else
+					channels.insert(wc);
+				if (dochildren)
+					channels.unite(wc->allChildren());
+				const QString &redirect = u->qmWhisperRedirect.value(wtc.qsGroup);
+				const QString &qsg = redirect.isEmpty() ? wtc.qsGroup : redirect;
+				foreach(Channel *tc, channels) {
+					if (ChanACL::hasPermission(u, tc, ChanACL::Whisper, &acCache)) {
+						foreach(User *p, tc->qlUsers) {
+							ServerUser *su = static_cast<ServerUser *>(p);
+							if (! group || Group::isMember(tc, tc, qsg, su)) {
+								channel.insert(su);
 							}
 						}
 					}
 				}
 			}
+		}
+	}
+
+	foreach(unsigned int id, wt.qlSessions) {
+		ServerUser *pDst = qhUsers.value(id);
+		if (pDst && (pDst->sState == ServerUser::Authenticated) && ChanACL::hasPermission(u, pDst->cChannel, ChanACL::Whisper, &acCache) && ! channel.contains(pDst))
+			direct.insert(pDst);
+	}
+
+	channelTarget = channel.toList().toVector();
+	directTarget = direct.toList().toVector();
+}
+
+bool Server::checkDecrypt(ServerUser *u, const char *encrypt, char *plain, unsigned int len) {
+	QMutexLocker qml(&u->qmCrypt);
+
+	if (u->csCrypt.isValid() && u->csCrypt.decrypt(reinterpret_cast<const unsigned char *>(encrypt), reinterpret_cast<unsigned char *>(plain), len))
+		return true;
+
+	if (u->csCrypt.tLastGood.elapsed() > 5000000ULL) {
+		if (u->csCrypt.tLastRequest.elapsed() > 5000000ULL) {
+			u->csCrypt.tLastRequest.restart();
+			emit reqSync(u->uiSession);
+		}
+	}
+	return false;
+}
+
+/* Finds the not yet associated user behind ha a datagram from an unknown
+ * peer belongs to. A hinted datagram costs a single decryption. Otherwise
+ * the clients that don't send hints are tried, but at most PEER_MAX_TRIALS
+ * of them, so a datagram from a spoofed or shared address can't make the
+ * server try them all. */
+ServerUser *Server::matchPeer(const VoiceSnapshot *vs, const HostAddress &ha, unsigned int hint, const char *encrypt, char *plain, unsigned int len) {
+	const QSet<ServerUser *> &candidates = vs->qhHostUsers.value(ha);
+
+	if (hint) {
+		ServerUser *usr = vs->qhUsers.value(hint);
+		if (! usr || ! candidates.contains(usr))
+			return NULL;
+
+		QMutexLocker qml(&usr->qmCrypt);
+		if (usr->csCrypt.isValid() && usr->csCrypt.decrypt(reinterpret_cast<const unsigned char *>(encrypt), reinterpret_cast<unsigned char *>(plain), len))
+			return usr;
+		return NULL;
+	}
+
+	const unsigned char ivbyte = static_cast<unsigned char>(encrypt[0]);
+	int trials = 0;
+
+	// The clear IV byte of a packet is normally the one right after the last
+	// one its sender used, so with many users behind one address the right
+	// one is almost always among the few with a small gap. Their IVs are read
+	// unlocked, as the order of the trials only affects the speed.
+	for (int pass=0;pass<2;++pass) {
+		foreach(ServerUser *usr, candidates) {
+			const bool likely = (usr->csCrypt.ivGap(ivbyte) < PEER_IV_GAP);
+			if (likely != (pass == 0))
+				continue;
+
+			// Failed trials don't request a resync; the packet most likely isn't theirs.
+			QMutexLocker qml(&usr->qmCrypt);
+			if (usr->bUdpHint || ! usr->csCrypt.isValid())
+				continue;
+			if (usr->csCrypt.decrypt(reinterpret_cast<const unsigned char *>(encrypt), reinterpret_cast<unsigned char *>(plain), len))
+				return usr;
+			if (++trials == PEER_MAX_TRIALS)
+				return NULL;
+		}
+	}
+	return NULL;
+}
+
+void Server::sendMessage(ServerUser *u, const char *data, int len, QByteArray &cache, bool force) {
+	if ((u->bUdp || force) && udpReady(u) && u->csCrypt.isValid()) {
+#ifdef Q_OS_LINUX
+		// Inside the voice thread, queue the datagram for the next sendmmsg().
+		UDPSendBatch *b = qtsBatch.hasLocalData() ? qtsBatch.localData() : NULL;
+		if (b && (len <= UDP_PACKET_SIZE)) {
+			if ((b->iCount == b->iSize) || ((b->iCount > 0) && (b->iSocket != u->sUdpSocket)))
+				flushUdpBatch(b);
+
+			const int i = b->iCount;
+			struct msghdr &msg = b->mmsg[i].msg_hdr;
+			msg = u->mhUdp;
 
-			foreach(unsigned int id, wt.qlSessions) {
-				ServerUser *pDst = qhUsers.value(id);
-				if (pDst && ChanACL::hasPermission(u, pDst->cChannel, ChanACL::Whisper, &acCache) && ! channel.contains(pDst))
-					direct.insert(pDst);
+			char *buffer = b->packet(i);
+			{
+				QMutexLocker qml(&u->qmCrypt);
+				u->csCrypt.encrypt(reinterpret_cast<const unsigned char *>(data), reinterpret_cast<unsigned char *>(buffer), len);
 			}
 
-			int uiSession = u->uiSession;
-			qrwlUsers.unlock();
-			qrwlUsers.lockForWrite();
+			b->iov[i].iov_base = buffer;
+			b->iov[i].iov_len = len+4;
+			msg.msg_iov = &b->iov[i];
+			msg.msg_iovlen = 1;
+			b->mmsg[i].msg_len = 0;
+			b->iSocket = u->sUdpSocket;
+			++b->iCount;
+			return;
+		}
+#endif
+#if defined(__LP64__)
+		STACKVAR(char, ebuffer, len+4+16);
+		char *buffer = reinterpret_cast<char *>(((reinterpret_cast<quint64>(ebuffer) + 8) & ~7) + 4);
+#else
+		STACKVAR(char, buffer, len+4);
+#endif
+		{
+			QMutexLocker qml(&u->qmCrypt);
+			u->csCrypt.encrypt(reinterpret_cast<const unsigned char *>(data), reinterpret_cast<unsigned char *>(buffer), len);
+		}
+		sendDatagram(u, buffer, len+4);
+	} else {
+		if (cache.isEmpty()) {
+			cache.resize(len + 6);
+			unsigned char *uc = reinterpret_cast<unsigned char *>(cache.data());
+			* reinterpret_cast<quint16 *>(& uc[0]) = qToBigEndian(static_cast<quint16>(MessageHandler::UDPTunnel));
+			* reinterpret_cast<quint32 *>(& uc[2]) = qToBigEndian(static_cast<quint32>(len));
+			memcpy(uc + 6, data, len);
+		}
 
-			if (qhUsers.contains(uiSession))
-				u->qmTargetCache.insert(target, ServerUser::TargetCache(channel, direct));
-			qrwlUsers.unlock();
-			qrwlUsers.lockForRead();
-			if (! qhUsers.contains(uiSession))
+		bool wake;
+		{
+			QMutexLocker qml(&u->qmTunnel);
+			// Voice that can't get through in time is worthless; don't let it pile up.
+			if (u->qbaTunnel.size() >= TUNNEL_BACKLOG)
 				return;
+			wake = u->qbaTunnel.isEmpty();
+			u->qbaTunnel.append(cache);
+		}
+		// One wakeup covers everything queued until the main thread gets to it.
+		if (wake)
+			emit tcpTransmit(u->uiSession);
+	}
+}
+
+void Server::sendMessages(ServerUser * const *users, int count, const char *data, int len, QByteArray &cache) {
+	ServerUser *group[CRYPT_MULTI];
+	int n = 0;
+
+	for (int i=0;i<count;++i) {
+		ServerUser *u = users[i];
+		if (u->bUdp && udpReady(u) && u->csCrypt.isValid()) {
+			// Only try the lock; blocking while holding the rest of the group could deadlock.
+			if (u->qmCrypt.tryLock()) {
+				group[n++] = u;
+				if (n == CRYPT_MULTI) {
+					sendEncrypted(group, n, data, len);
+					n = 0;
+				}
+				continue;
+			}
+			if (n > 0) {
+				sendEncrypted(group, n, data, len);
+				n = 0;
+			}
+		}
+		sendMessage(u, data, len, cache);
+	}
+	if (n > 0)
+		sendEncrypted(group, n, data, len);
+}
+
+void Server::sendEncrypted(ServerUser * const *users, int count, const char *data, int len) {
+	CryptState *states[CRYPT_MULTI];
+	unsigned char *dst[CRYPT_MULTI];
+	quint64 buffers[CRYPT_MULTI][(UDP_PACKET_SIZE + 16) / 8];
+
+	for (int i=0;i<count;++i) {
+		states[i] = & users[i]->csCrypt;
+		dst[i] = reinterpret_cast<unsigned char *>(buffers[i]) + 4;
+	}
+	CryptState::encryptMany(states, reinterpret_cast<const unsigned char *>(data), dst, len, count);
+	for (int i=0;i<count;++i)
+		users[i]->qmCrypt.unlock();
+
+	for (int i=0;i<count;++i)
+		sendDatagram(users[i], reinterpret_cast<const char *>(dst[i]), len+4);
+}
+
+void Server::sendDatagram(ServerUser *u, const char *buffer, int size) {
+#ifdef Q_OS_LINUX
+	if (! u->bUdpHeader)
+		return;
+
+	UDPSendBatch *b = qtsBatch.hasLocalData() ? qtsBatch.localData() : NULL;
+	if (b && (size <= UDP_PACKET_SIZE + 4)) {
+		if ((b->iCount == b->iSize) || ((b->iCount > 0) && (b->iSocket != u->sUdpSocket)))
+			flushUdpBatch(b);
+
+		const int i = b->iCount;
+		struct msghdr &msg = b->mmsg[i].msg_hdr;
+		msg = u->mhUdp;
+
+		memcpy(b->packet(i), buffer, size);
+		b->iov[i].iov_base = b->packet(i);
+		b->iov[i].iov_len = size;
+		msg.msg_iov = &b->iov[i];
+		msg.msg_iovlen = 1;
+		b->mmsg[i].msg_len = 0;
+		b->iSocket = u->sUdpSocket;
+		++b->iCount;
+		return;
+	}
+#endif
+#ifdef Q_OS_WIN
+	DWORD dwFlow = 0;
+	if (Meta::hQoS)
+		QOSAddSocketToFlow(Meta::hQoS, u->sUdpSocket, reinterpret_cast<struct sockaddr *>(& u->saiUdpAddress), QOSTrafficTypeVoice, QOS_NON_ADAPTIVE_FLOW, &dwFlow);
+#endif
+#ifdef Q_OS_LINUX
+	struct msghdr msg = u->mhUdp;
+	struct iovec iov[1];
+
+	iov[0].iov_base = const_cast<char *>(buffer);
+	iov[0].iov_len = size;
+
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 1;
+
+	::sendmsg(u->sUdpSocket, &msg, 0);
+#else
+	::sendto(u->sUdpSocket, buffer, size, 0, reinterpret_cast<struct sockaddr *>(& u->saiUdpAddress), (u->saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+#endif
+#ifdef Q_OS_WIN
+	if (Meta::hQoS && dwFlow)
+		QOSRemoveSocketFromFlow(Meta::hQoS, 0, dwFlow, 0);
+#else
+#endif
+}
+
+#ifdef Q_OS_LINUX
+void Server::flushUdpBatch(UDPSendBatch *b) {
+	int sent = 0;
+
+	while (sent < b->iCount) {
+		if (b->bMulti) {
+			int ret = ::sendmmsg(b->iSocket, b->mmsg + sent, b->iCount - sent, 0);
+			if (ret > 0) {
+				sent += ret;
+				continue;
+			} else if (ret == SOCKET_ERROR) {
+				if (errno == EINTR)
+					continue;
+				if (errno == ENOSYS) {
+					qWarning("Server: sendmmsg() not supported, falling back to single datagram writes");
+					b->bMulti = false;
+					continue;
+				}
+			}
+			// The first pending datagram was refused; drop it like an unbatched send would.
+			++sent;
+		} else {
+			::sendmsg(b->iSocket, &b->mmsg[sent].msg_hdr, 0);
+			++sent;
+		}
+	}
+	b->iCount = 0;
+}
+#endif
+
+#define SENDTO \
+		if ((!pDst->bDeaf) && (!pDst->bSelfDeaf) && (pDst != u)) { \
+			if ((poslen > 0) && (pDst->ssContext == u->ssContext)) \
+				qvPos.append(pDst); \
+			else \
+				qvNoPos.append(pDst); \
 		}
+
+#define SENDFLUSH \
+		sendMessages(qvPos.constData(), qvPos.count(), buffer, len, qba); \
+		sendMessages(qvNoPos.constData(), qvNoPos.count(), buffer, len - poslen, qba_npos); \
+		qvPos.clear(); \
+		qvNoPos.clear();
+
+void Server::processMsg(ServerUser *u, const char *data, int len) {
+	if (u->sState != ServerUser::Authenticated || u->bMute || u->bSuppress || u->bSelfMute)
+		return;
+
+	BandwidthRecord *bw = & u->bwr;
+	// Only used to look up the fan-out lists; never dereferenced here.
+	const Channel *c = u->cChannel;
+	const VoiceSnapshot *vs = voiceSnapshot();
+	QByteArray qba, qba_npos;
+	QVarLengthArray<ServerUser *, 64> qvPos, qvNoPos;
+	unsigned int counter;
+	char buffer[UDP_PACKET_SIZE];
+	PacketDataStream pdi(data + 1, len - 1);
+	PacketDataStream pds(buffer+1, UDP_PACKET_SIZE-1);
+	unsigned int type = data[0] & 0xe0;
+	unsigned int target = data[0] & 0x1f;
+	unsigned int poslen;
+
+	// IP + UDP + Crypt + Data
+	int packetsize = 20 + 8 + 4 + len;
+
+	// Check the voice data rate limit.
+	if (! bw->addFrame(packetsize, iMaxBandwidth/8)) {
+		// Suppress packet.
+		return;
+	}
+
+	// Read the sequence number.
+	pdi >> counter;
+
+	// Skip to the end of the voice data.
+	if ((type >> 5) != MessageHandler::UDPVoiceOpus) {
+		do {
+			counter = pdi.next8();
+			pdi.skip(counter & 0x7f);
+		} while ((counter & 0x80) && pdi.isValid());
+	} else {
+		int size;
+		pdi >> size;
+		pdi.skip(size & 0x1fff);
+	}
+
+	// Save location of the positional audio data.
+	poslen = pdi.left();
+
+	// Append session id to the new output stream.
+	pds << u->uiSession;
+	// Copy all voice and positional audio data to the output stream.
+	pds.append(data + 1, len - 1);
+
+	len = pds.size() + 1;
+
+	if (target == 0x1f) { // Server loopback
+		buffer[0] = static_cast<char>(type | 0);
+		sendMessage(u, buffer, len, qba);
+		return;
+	} else if (target == 0) { // Normal speech
+		buffer[0] = static_cast<char>(type | 0);
+
+		QHash<const Channel *, QVector<ServerUser *> >::const_iterator il = vs->qhListeners.constFind(c);
+		if (il != vs->qhListeners.constEnd()) {
+			const QVector<ServerUser *> &channel = il.value();
+			for (int i=0;i<channel.count();++i) {
+				ServerUser *pDst = channel.at(i);
+				SENDTO;
+			}
+		}
+
+		QHash<unsigned int, QVector<ServerUser *> >::const_iterator ik = vs->qhLinkedListeners.constFind(u->uiSession);
+		if (ik != vs->qhLinkedListeners.constEnd()) {
+			const QVector<ServerUser *> &linked = ik.value();
+			for (int i=0;i<linked.count();++i) {
+				ServerUser *pDst = linked.at(i);
+				SENDTO;
+			}
+		}
+		SENDFLUSH;
+	} else { // Whisper
+		const WhisperRecipients *wr = u->qapTargets.fetchAndAddOrdered(0);
+		if (! wr || ! (wr->uiTargets & (1U << target)))
+			return;
+
+		const QVector<ServerUser *> &channel = wr->qvChannel[target];
+		const QVector<ServerUser *> &direct = wr->qvDirect[target];
+
 		if (! channel.isEmpty()) {
 			buffer[0] = static_cast<char>(type | 1);
-			foreach(ServerUser *pDst, channel) {
+			for (int i=0;i<channel.count();++i) {
+				ServerUser *pDst = channel.at(i);
 				SENDTO;
 			}
+			SENDFLUSH;
 			if (! direct.isEmpty()) {
 				qba.clear();
 				qba_npos.clear();
@@ -1109,9 +1840,11 @@ void Server::processMsg(ServerUser *u, const char *data, int len) {
 		}
 		if (! direct.isEmpty()) {
 			buffer[0] = static_cast<char>(type | 2);
-			foreach(ServerUser *pDst, direct) {
+			for (int i=0;i<direct.count();++i) {
+				ServerUser *pDst = direct.at(i);
 				SENDTO;
 			}
+			SENDFLUSH;
 		}
 	}
 }
@@ -1133,6 +1866,10 @@ void Server::newClient() {
 	SslServer *ss = qobject_cast<SslServer *>(sender());
 	if (! ss)
 		return;
+
+	if (tkTickets.rotate(QDateTime::currentDateTime().toTime_t(), Meta::mp.iTicketKeyLifetime))
+		ServerDB::setConf(iServerNum, "sslTicketKeys", tkTickets.toString());
+
 	forever {
 		QSslSocket *sock = ss->nextPendingSSLConnection();
 		if (! sock)
@@ -1149,25 +1886,29 @@ void Server::newClient() {
 
 		HostAddress ha(adr);
 
-		QList<Ban> tmpBans = qlBans;
-		foreach(const Ban &ban, qlBans) {
-			if (ban.isExpired())
-				tmpBans.removeOne(ban);
-		}
-		if (qlBans.count() != tmpBans.count()) {
-			qlBans = tmpBans;
-			saveBans();
-		}
+		const quint64 now = BanIndex::now();
 
-		foreach(const Ban &ban, qlBans) {
-			if (ban.haAddress.match(ha, ban.iMask)) {
-				log(QString("Ignoring connection: %1 (Server ban)").arg(addressToString(sock->peerAddress(), sock->peerPort())));
-				sock->disconnectFromHost();
-				sock->deleteLater();
-				return;
+		if (biBans.nextExpiry() && (now > biBans.nextExpiry())) {
+			QList<Ban> tmpBans = qlBans;
+			foreach(const Ban &ban, qlBans) {
+				if (ban.isExpired())
+					tmpBans.removeOne(ban);
+			}
+			if (qlBans.count() != tmpBans.count()) {
+				qlBans = tmpBans;
+				saveBans();
+			} else {
+				biBans.rebuild(qlBans);
 			}
 		}
 
+		if (biBans.match(ha, now)) {
+			log(QString("Ignoring connection: %1 (Server ban)").arg(addressToString(sock->peerAddress(), sock->peerPort())));
+			sock->disconnectFromHost();
+			sock->deleteLater();
+			return;
+		}
+
 		sock->setPrivateKey(qskKey);
 		sock->setLocalCertificate(qscCert);
 		sock->addCaCertificate(qscCert);
@@ -1179,50 +1920,133 @@ void Server::newClient() {
 		sock->setSslConfiguration(cfg);
 #endif
 
-		if (qqIds.isEmpty()) {
+#if QT_VERSION >= 0x050500
+		sock->setProtocol(QSsl::TlsV1_0OrLater);
+#elif QT_VERSION >= 0x050400
+		// In Qt 5.4, QSsl::SecureProtocols is equivalent
+		// to "TLSv1.0 or later", which we require.
+		sock->setProtocol(QSsl::SecureProtocols);
+#elif QT_VERSION >= 0x050000
+		sock->setProtocol(QSsl::TlsV1_0);
+#else
+		sock->setProtocol(QSsl::TlsV1);
+#endif
+
+		// Handshakes on the pool hold back a session ID each, so there are
+		// never more of them than could be let in afterwards.
+		if (qqIds.count() <= iHandshakes) {
 			log(QString("Session ID pool (%1) empty, rejecting connection").arg(iMaxUsers));
 			sock->disconnectFromHost();
 			sock->deleteLater();
 			return;
 		}
 
-		ServerUser *u = new ServerUser(this, sock);
-		u->uiSession = qqIds.dequeue();
-		u->haAddress = ha;
-		HostAddress(sock->localAddress()).toSockaddr(& u->saiTcpLocalAddress);
-
-		{
-			QWriteLocker wl(&qrwlUsers);
-			qhUsers.insert(u->uiSession, u);
-			qhHostUsers[ha].insert(u);
+		if (meta->hpHandshakes.isEnabled()) {
+			// Taken over again by adoptClient() once encrypted, or
+			// handed back by handshakeFailed().
+			if (meta->hpHandshakes.start(this, sock)) {
+				++iHandshakes;
+			} else {
+				sock->abort();
+				sock->deleteLater();
+			}
+			continue;
 		}
 
-		connect(u, SIGNAL(connectionClosed(QAbstractSocket::SocketError, const QString &)), this, SLOT(connectionClosed(QAbstractSocket::SocketError, const QString &)));
-		connect(u, SIGNAL(message(unsigned int, const QByteArray &)), this, SLOT(message(unsigned int, const QByteArray &)));
+		ServerUser *u = addClient(sock, ha);
 		connect(u, SIGNAL(handleSslErrors(const QList<QSslError> &)), this, SLOT(sslError(const QList<QSslError> &)));
 		connect(u, SIGNAL(encrypted()), this, SLOT(encrypted()));
 
-		log(u, QString("New connection: %1").arg(addressToString(sock->peerAddress(), sock->peerPort())));
+		sock->startServerEncryption();
+		tkTickets.install(sock);
+	}
+}
 
-		u->setToS();
+ServerUser *Server::addClient(QSslSocket *sock, const HostAddress &ha) {
+	ServerUser *u = new ServerUser(this, sock);
+	u->uiSession = qqIds.dequeue();
+	u->haAddress = ha;
+	HostAddress(sock->localAddress()).toSockaddr(& u->saiTcpLocalAddress);
 
-#if QT_VERSION >= 0x050500
-		sock->setProtocol(QSsl::TlsV1_0OrLater);
-#elif QT_VERSION >= 0x050400
-		// In Qt 5.4, QSsl::SecureProtocols is equivalent
-		// to "TLSv1.0 or later", which we require.
-		sock->setProtocol(QSsl::SecureProtocols);
-#elif QT_VERSION >= 0x050000
-		sock->setProtocol(QSsl::TlsV1_0);
-#else
-		sock->setProtocol(QSsl::TlsV1);
-#endif
-		sock->startServerEncryption();
+	{
+		QWriteLocker wl(&qrwlUsers);
+		qhUsers.insert(u->uiSession, u);
+		qhHostUsers[ha].insert(u);
+		publishUsers();
 	}
+
+	connect(u, SIGNAL(connectionClosed(QAbstractSocket::SocketError, const QString &)), this, SLOT(connectionClosed(QAbstractSocket::SocketError, const QString &)));
+	connect(u, SIGNAL(message(unsigned int, const QByteArray &)), this, SLOT(message(unsigned int, const QByteArray &)));
+
+	log(u, QString("New connection: %1").arg(addressToString(sock->peerAddress(), sock->peerPort())));
+
+	u->setToS();
+
+	return u;
+}
+
+void Server::adoptClient(HandshakeResultPtr hr) {
+	QSslSocket *sock = hr->qssSocket;
+
+	--iHandshakes;
+
+	// Whatever went wrong after the handshake, HandshakeResult cleans up.
+	if (sock->state() != QAbstractSocket::ConnectedState)
+		return;
+
+	// Only if the pool shrank while the handshake ran.
+	if (qqIds.isEmpty()) {
+		log(QString("Session ID pool (%1) empty, rejecting connection").arg(iMaxUsers));
+		sock->disconnectFromHost();
+		return;
+	}
+
+	hr->qssSocket = NULL;
+
+	ServerUser *u = addClient(sock, HostAddress(sock->peerAddress()));
+	u->bVerified = hr->bVerified;
+	clientEncrypted(u);
+
+	// Anything the client sent right after the handshake arrived while
+	// nobody was listening for readyRead().
+	if (sock->bytesAvailable() > 0)
+		QMetaObject::invokeMethod(u, "socketRead", Qt::QueuedConnection);
+}
+
+void Server::handshakeFailed(const QHostAddress &address, quint16 port, const QString &reason) {
+	--iHandshakes;
+
+	if (! reason.isEmpty())
+		log(QString("Handshake with %1 failed: %2").arg(addressToString(address, port), reason));
 }
 
 void Server::encrypted() {
 	ServerUser *uSource = qobject_cast<ServerUser *>(sender());
+	if (uSource)
+		clientEncrypted(uSource);
+}
+
+void Server::clientEncrypted(ServerUser *uSource) {
+	++uiTlsHandshakes;
+	if (uSource->sessionResumed()) {
+		++uiTlsResumed;
+
+		// OpenSSL doesn't verify the certificate of a resumed session again,
+		// so sslError() never ran. Redo its checks.
+#if QT_VERSION >= 0x050000
+		QList<QSslError> fatal;
+		checkSslErrors(QSslCertificate::verify(uSource->peerCertificateChain()), uSource->bVerified, fatal);
+		if (! fatal.isEmpty())
+			uSource->bVerified = false;
+#else
+		uSource->bVerified = false;
+#endif
+	}
+
+	// Nothing may be sent between the handshake and this.
+	if (Meta::mp.bKernelTls && uSource->enableKernelTls())
+		++uiTlsKernel;
+
 	int major, minor, patch;
 	QString release;
 
@@ -1276,12 +2100,7 @@ void Server::encrypted() {
 	}
 }
 
-void Server::sslError(const QList<QSslError> &errors) {
-	ServerUser *u = qobject_cast<ServerUser *>(sender());
-	if (!u)
-		return;
-
-	bool ok = true;
+bool Server::checkSslErrors(const QList<QSslError> &errors, bool &verified, QList<QSslError> &fatal) {
 	foreach(QSslError e, errors) {
 		switch (e.error()) {
 			case QSslError::InvalidPurpose:
@@ -1294,13 +2113,24 @@ void Server::sslError(const QList<QSslError> &errors) {
 			case QSslError::HostNameMismatch:
 			case QSslError::CertificateNotYetValid:
 			case QSslError::CertificateExpired:
-				u->bVerified = false;
+				verified = false;
 				break;
 			default:
-				log(u, QString("SSL Error: %1").arg(e.errorString()));
-				ok = false;
+				fatal << e;
 		}
 	}
+	return fatal.isEmpty();
+}
+
+void Server::sslError(const QList<QSslError> &errors) {
+	ServerUser *u = qobject_cast<ServerUser *>(sender());
+	if (!u)
+		return;
+
+	QList<QSslError> fatal;
+	bool ok = checkSslErrors(errors, u->bVerified, fatal);
+	foreach(const QSslError &e, fatal)
+		log(u, QString("SSL Error: %1").arg(e.errorString()));
 
 	if (ok)
 		u->proceedAnyway();
@@ -1342,6 +2172,8 @@ void Server::connectionClosed(QAbstractSocket::SocketError err, const QString &r
 
 		if (old)
 			old->removeUser(u);
+
+		publishUsers(old);
 	}
 
 	if (old && old->bTemporary && old->qlUsers.isEmpty())
@@ -1355,12 +2187,74 @@ void Server::connectionClosed(QAbstractSocket::SocketError err, const QString &r
 		recheckCodecVersions(); // Maybe can choose a better codec now
 	}
 
-	u->deleteLater();
+	// Whisper recipient lists still including u must be replaced before it is retired.
+	if (bTargetsPending)
+		resolveTargets();
+
+	// The voice threads may still be using u.
+	veVoice.retire(boost::bind(&QObject::deleteLater, u));
+	veVoice.reclaim();
 
 	if (qhUsers.isEmpty())
 		stopThread();
 }
 
+/// Hands out one message of type T per thread for parsing into, so the memory
+/// protobuf allocated for its strings and repeated fields serves the next message
+/// of that type too. Should a handler cause another message of the same type to
+/// be dispatched before it returns, that one gets a message of its own.
+template <class T>
+class ParseCache {
+	private:
+		Q_DISABLE_COPY(ParseCache)
+		struct Slot {
+			T *pMsg;
+			bool bBusy;
+			Slot() : pMsg(new T()), bBusy(false) {};
+			~Slot() {
+				delete pMsg;
+			};
+		};
+		static QThreadStorage<Slot *> &storage() {
+			static QThreadStorage<Slot *> qts;
+			return qts;
+		};
+		Slot *sSlot;
+		T *pMsg;
+	public:
+		ParseCache() {
+			QThreadStorage<Slot *> &qts = storage();
+			if (! qts.hasLocalData())
+				qts.setLocalData(new Slot());
+			sSlot = qts.localData();
+			if (sSlot->bBusy) {
+				sSlot = NULL;
+				pMsg = new T();
+			} else {
+				sSlot->bBusy = true;
+				pMsg = sSlot->pMsg;
+			}
+		};
+		~ParseCache() {
+			if (! sSlot) {
+				delete pMsg;
+				return;
+			}
+			// Don't keep the memory of an unusually large message around.
+			if (pMsg->SpaceUsed() > 65536) {
+				delete sSlot->pMsg;
+				sSlot->pMsg = new T();
+			}
+			sSlot->bBusy = false;
+		};
+		T *operator->() {
+			return pMsg;
+		};
+		T &operator*() {
+			return *pMsg;
+		};
+};
+
 void Server::message(unsigned int uiType, const QByteArray &qbaMsg, ServerUser *u) {
 	if (u == NULL) {
 		u = static_cast<ServerUser *>(sender());
@@ -1375,8 +2269,6 @@ void Server::message(unsigned int uiType, const QByteArray &qbaMsg, ServerUser *
 		if (l < 2)
 			return;
 
-		QReadLocker rl(&qrwlUsers);
-
 		u->bUdp = false;
 
 		const char *buffer = qbaMsg.constData();
@@ -1401,23 +2293,23 @@ void Server::message(unsigned int uiType, const QByteArray &qbaMsg, ServerUser *
 
 #ifdef QT_NO_DEBUG
 #define MUMBLE_MH_MSG(x) case MessageHandler:: x : { \
-		MumbleProto:: x msg; \
-		if (msg.ParseFromArray(qbaMsg.constData(), qbaMsg.size())) { \
-			msg.DiscardUnknownFields(); \
-			msg##x(u, msg); \
+		ParseCache<MumbleProto:: x> msg; \
+		if (msg->ParseFromArray(qbaMsg.constData(), qbaMsg.size())) { \
+			msg->DiscardUnknownFields(); \
+			msg##x(u, *msg); \
 		} \
 		break; \
 	}
 #else
 #define MUMBLE_MH_MSG(x) case MessageHandler:: x : { \
-		MumbleProto:: x msg; \
-		if (msg.ParseFromArray(qbaMsg.constData(), qbaMsg.size())) { \
+		ParseCache<MumbleProto:: x> msg; \
+		if (msg->ParseFromArray(qbaMsg.constData(), qbaMsg.size())) { \
 			if (uiType != MessageHandler::Ping) { \
 				printf("== %s:\n", #x); \
-				msg.PrintDebugString(); \
+				msg->PrintDebugString(); \
 			} \
-			msg.DiscardUnknownFields(); \
-			msg##x(u, msg); \
+			msg->DiscardUnknownFields(); \
+			msg##x(u, *msg); \
 		} \
 		break; \
 	}
@@ -1441,22 +2333,30 @@ void Server::checkTimeout() {
 	qrwlUsers.unlock();
 	foreach(ServerUser *u, qlClose)
 		u->disconnectSocket(true);
+
+	if (uiTlsHandshakes && (tTlsReport.elapsed() > 900ULL * 1000000ULL)) {
+		log(QString("TLS: %1 of %2 handshakes resumed a session (%3%)").arg(uiTlsResumed).arg(uiTlsHandshakes).arg(uiTlsResumed * 100 / uiTlsHandshakes));
+		if (Meta::mp.bKernelTls)
+			log(QString("TLS: %1 of %2 connections sealed by the kernel").arg(uiTlsKernel).arg(uiTlsHandshakes));
+		uiTlsHandshakes = uiTlsResumed = uiTlsKernel = 0;
+		tTlsReport.restart();
+	}
+
+	veVoice.reclaim();
 }
 
-void Server::tcpTransmitData(QByteArray a, unsigned int id) {
-	Connection *c = qhUsers.value(id);
-	if (c) {
+void Server::tcpTransmitData(unsigned int id) {
+	ServerUser *u = qhUsers.value(id);
+	if (u) {
 		QByteArray qba;
-		int len = a.size();
-
-		qba.resize(len + 6);
-		unsigned char *uc = reinterpret_cast<unsigned char *>(qba.data());
-		* reinterpret_cast<quint16 *>(& uc[0]) = qToBigEndian(static_cast<quint16>(MessageHandler::UDPTunnel));
-		* reinterpret_cast<quint32 *>(& uc[2]) = qToBigEndian(static_cast<quint32>(len));
-		memcpy(uc + 6, a.constData(), len);
+		{
+			QMutexLocker qml(&u->qmTunnel);
+			qba = u->qbaTunnel;
+			u->qbaTunnel.clear();
+		}
 
-		c->sendMessage(qba);
-		c->forceFlush();
+		u->sendMessage(qba);
+		u->forceFlush();
 	}
 }
 
@@ -1479,6 +2379,19 @@ void Server::sendProtoAll(const ::google::protobuf::Message &msg, unsigned int m
 }
 
 void Server::sendProtoExcept(ServerUser *u, const ::google::protobuf::Message &msg, unsigned int msgType, unsigned int version) {
+	// Everything joining clients are told about changes by broadcast.
+	if (msgType == MessageHandler::UserState) {
+		const MumbleProto::UserState &mpus = static_cast<const MumbleProto::UserState &>(msg);
+		ServerUser *su = mpus.has_session() ? qhUsers.value(mpus.session()) : NULL;
+		if (su) {
+			for (int i=0;i<3;++i)
+				su->qbaJoinState[i].clear();
+		}
+	} else if ((msgType == MessageHandler::ChannelState) || (msgType == MessageHandler::ChannelRemove)) {
+		qbaJoinChannels[0].clear();
+		qbaJoinChannels[1].clear();
+	}
+
 	QByteArray cache;
 	foreach(ServerUser *usr, qhUsers)
 		if ((usr != u) && (usr->sState == ServerUser::Authenticated))
@@ -1486,6 +2399,103 @@ void Server::sendProtoExcept(ServerUser *u, const ::google::protobuf::Message &m
 				usr->sendMessage(msg, msgType, cache);
 }
 
+const QByteArray &Server::joinChannels(bool hashes) {
+	QByteArray &qba = qbaJoinChannels[hashes ? 1 : 0];
+	if (! qba.isEmpty())
+		return qba;
+
+	QQueue<Channel *> q;
+	QList<Channel *> chans;
+	q << qhChannels.value(0);
+	MumbleProto::ChannelState mpcs;
+	QByteArray cache;
+	while (! q.isEmpty()) {
+		Channel *c = q.dequeue();
+		chans << c;
+
+		mpcs.Clear();
+
+		mpcs.set_channel_id(c->iId);
+		if (c->cParent)
+			mpcs.set_parent(c->cParent->iId);
+		if (c->iId == 0)
+			mpcs.set_name(u8(qsRegName.isEmpty() ? QLatin1String("Root") : qsRegName));
+		else
+			mpcs.set_name(u8(c->qsName));
+
+		mpcs.set_position(c->iPosition);
+
+		if (hashes && ! c->qbaDescHash.isEmpty())
+			mpcs.set_description_hash(blob(c->qbaDescHash));
+		else if (! c->qsDesc.isEmpty())
+			mpcs.set_description(u8(c->qsDesc));
+
+		Connection::messageToNetwork(mpcs, MessageHandler::ChannelState, cache);
+		qba.append(cache);
+
+		foreach(Channel *child, c->qlChannels)
+			q.enqueue(child);
+	}
+
+	foreach(Channel *c, chans) {
+		if (c->qhLinks.count() > 0) {
+			mpcs.Clear();
+			mpcs.set_channel_id(c->iId);
+
+			foreach(Channel *l, c->qhLinks.keys())
+				mpcs.add_links(l->iId);
+			Connection::messageToNetwork(mpcs, MessageHandler::ChannelState, cache);
+			qba.append(cache);
+		}
+	}
+	return qba;
+}
+
+const QByteArray &Server::joinUserState(ServerUser *u, JoinClass jc) {
+	QByteArray &qba = u->qbaJoinState[jc];
+	if (! qba.isEmpty())
+		return qba;
+
+	MumbleProto::UserState mpus;
+	mpus.set_session(u->uiSession);
+	mpus.set_name(u8(u->qsName));
+	if (u->iId >= 0)
+		mpus.set_user_id(u->iId);
+	if (jc == JoinHashes) {
+		if (! u->qbaTextureHash.isEmpty())
+			mpus.set_texture_hash(blob(u->qbaTextureHash));
+		else if (! u->qbaTexture.isEmpty())
+			mpus.set_texture(blob(u->qbaTexture));
+	} else if (jc == JoinTextures) {
+		mpus.set_texture(blob(u->qbaTexture));
+	}
+	if (u->cChannel->iId != 0)
+		mpus.set_channel_id(u->cChannel->iId);
+	if (u->bDeaf)
+		mpus.set_deaf(true);
+	else if (u->bMute)
+		mpus.set_mute(true);
+	if (u->bSuppress)
+		mpus.set_suppress(true);
+	if (u->bPrioritySpeaker)
+		mpus.set_priority_speaker(true);
+	if (u->bRecording)
+		mpus.set_recording(true);
+	if (u->bSelfDeaf)
+		mpus.set_self_deaf(true);
+	else if (u->bSelfMute)
+		mpus.set_self_mute(true);
+	if ((jc == JoinHashes) && ! u->qbaCommentHash.isEmpty())
+		mpus.set_comment_hash(blob(u->qbaCommentHash));
+	else if (! u->qsComment.isEmpty())
+		mpus.set_comment(u8(u->qsComment));
+	if (! u->qsHash.isEmpty())
+		mpus.set_hash(u8(u->qsHash));
+
+	Connection::messageToNetwork(mpus, MessageHandler::UserState, qba);
+	return qba;
+}
+
 void Server::removeChannel(int id) {
 	Channel *c = qhChannels.value(id);
 	if (c)
@@ -1500,6 +2510,7 @@ void Server::removeChannel(Channel *chan, Channel *dest) {
 		dest = chan->cParent;
 
 	chan->unlink(NULL);
+	invalidateFanout();
 
 	foreach(c, chan->qlChannels) {
 		removeChannel(c, dest);
@@ -1530,7 +2541,14 @@ void Server::removeChannel(Channel *chan, Channel *dest) {
 	if (chan->cParent) {
 		QWriteLocker wl(&qrwlUsers);
 		chan->cParent->removeChannel(chan);
+		publishUsers(chan);
+	}
+
+	{
+		QMutexLocker qml(&qmCache);
+		acCache.apProgram->clear();
 	}
+	invalidateTargets();
 
 	delete chan;
 }
@@ -1557,8 +2575,10 @@ bool Server::unregisterUser(int id) {
 				bool remrem = g->qsRemove.remove(id);
 				write = write || addrem || remrem;
 			}
-			if (write)
+			if (write) {
 				updateChannel(c);
+				acCache.apProgram->clear();
+			}
 		}
 	}
 
@@ -1586,6 +2606,7 @@ void Server::userEnterChannel(User *p, Channel *c, MumbleProto::UserState &mpus)
 	{
 		QWriteLocker wl(&qrwlUsers);
 		c->addUser(p);
+		publishUsers(old, c);
 
 		bool mayspeak = ChanACL::hasPermission(static_cast<ServerUser *>(p), c, ChanACL::Speak, NULL);
 		bool sup = p->bSuppress;
@@ -1597,7 +2618,7 @@ void Server::userEnterChannel(User *p, Channel *c, MumbleProto::UserState &mpus)
 		}
 	}
 
-	clearACLCache(p);
+	clearACLCache(p, old, c);
 	setLastChannel(p);
 
 	if (old && old->bTemporary && old->qlUsers.isEmpty()) {
@@ -1691,34 +2712,158 @@ void Server::flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQu
 	sendMessage(u, mppq);
 }
 
-void Server::clearACLCache(User *p) {
+void Server::dropACLCache(User *p) {
 	MumbleProto::PermissionQuery mppq;
 
-	{
-		QMutexLocker qml(&qmCache);
+	QMutexLocker qml(&qmCache);
+
+	if (p) {
+		ChanACL::ChanCache *h = acCache.take(p);
+		delete h;
+		acCache.apProgram->clear(p);
 
-		if (p) {
-			ChanACL::ChanCache *h = acCache.take(p);
+		flushClientPermissionCache(static_cast<ServerUser *>(p), mppq);
+	} else {
+		foreach(ChanACL::ChanCache *h, acCache)
 			delete h;
+		acCache.clear();
+		acCache.apProgram->clear();
 
-			flushClientPermissionCache(static_cast<ServerUser *>(p), mppq);
-		} else {
-			foreach(ChanACL::ChanCache *h, acCache)
-				delete h;
-			acCache.clear();
+		foreach(ServerUser *u, qhUsers)
+			if (u->sState == ServerUser::Authenticated)
+				flushClientPermissionCache(u, mppq);
+	}
+}
 
-			foreach(ServerUser *u, qhUsers)
-				if (u->sState == ServerUser::Authenticated)
-					flushClientPermissionCache(u, mppq);
+/* Drops the cached permissions of p, or of everyone if p is NULL. A change
+ * to one user's groups or tokens only matters to targets that could reach
+ * that user, so they are worked out again like after a move in place. */
+void Server::clearACLCache(User *p) {
+	if (p) {
+		clearACLCache(p, p->cChannel, p->cChannel);
+		return;
+	}
+
+	dropACLCache(NULL);
+
+	invalidateTargets();
+	invalidateFanout();
+}
+
+/* Adds c and every channel above it to chans. */
+static void addAncestors(QSet<Channel *> &chans, Channel *c) {
+	for (; c; c = c->cParent)
+		chans.insert(c);
+}
+
+/* Whisper target wt of a user can reach a channel in chans, either directly,
+ * through a recipient in it, through links, or through the children of a
+ * channel in ancestors. */
+static bool targetReaches(const WhisperTarget &wt, const QSet<Channel *> &chans, const QSet<Channel *> &ancestors, const QHash<unsigned int, Channel *> &channels, const QHash<unsigned int, ServerUser *> &users) {
+	foreach(const WhisperTarget::Channel &wtc, wt.qlChannels) {
+		Channel *wc = channels.value(wtc.iId);
+		if (! wc)
+			continue;
+		if (wtc.bLinks || chans.contains(wc))
+			return true;
+		if (wtc.bChildren && ancestors.contains(wc))
+			return true;
+	}
+	foreach(unsigned int id, wt.qlSessions) {
+		ServerUser *u = users.value(id);
+		if (u && chans.contains(u->cChannel))
+			return true;
+	}
+	return false;
+}
+
+/* User p moved from one channel to another. Besides p's own permissions and
+ * targets, only targets that reach either channel can have changed. Either
+ * may be NULL for a user not in a channel yet. */
+void Server::clearACLCache(User *p, Channel *from, Channel *to) {
+	dropACLCache(p);
+
+	QSet<Channel *> chans;
+	if (from)
+		chans.insert(from);
+	if (to)
+		chans.insert(to);
+
+	QSet<Channel *> ancestors;
+	addAncestors(ancestors, from);
+	addAncestors(ancestors, to);
+
+	foreach(ServerUser *u, qhUsers) {
+		if (u == p) {
+			invalidateTargets(u);
+			continue;
+		}
+		foreach(const WhisperTarget &wt, u->qmTargets) {
+			if (targetReaches(wt, chans, ancestors, qhChannels, qhUsers)) {
+				invalidateTargets(u);
+				break;
+			}
 		}
 	}
 
-	{
-		QWriteLocker lock(&qrwlUsers);
+	invalidateFanout();
+}
 
-		foreach(ServerUser *u, qhUsers)
-			u->qmTargetCache.clear();
+/* Drops what was cached about channel c and its subchannels after their ACLs
+ * or groups changed. Both are only ever looked up from a channel upwards, so
+ * nothing outside the subtree is affected. Only clients that were sent
+ * permissions for the subtree get a refresh. The compiled ACLs share their
+ * group lookups between channels, so they are dropped as a whole. If c was
+ * just moved, oldParent is where it came from; targets on the children of a
+ * channel above either place may have changed. */
+void Server::clearACLCache(Channel *c, Channel *oldParent) {
+	QSet<Channel *> chans = c->allChildren();
+	chans.insert(c);
+
+	QSet<Channel *> ancestors;
+	addAncestors(ancestors, c->cParent);
+	addAncestors(ancestors, oldParent);
+
+	MumbleProto::PermissionQuery mppq;
+
+	QMutexLocker qml(&qmCache);
+
+	acCache.apProgram->clear();
+
+	foreach(ChanACL::ChanCache *h, acCache) {
+		if (h->count() < chans.count()) {
+			ChanACL::ChanCache::iterator i = h->begin();
+			while (i != h->end()) {
+				if (chans.contains(i.key()))
+					i = h->erase(i);
+				else
+					++i;
+			}
+		} else {
+			foreach(Channel *sc, chans)
+				h->remove(sc);
+		}
 	}
+
+	foreach(ServerUser *u, qhUsers) {
+		if (u->sState == ServerUser::Authenticated) {
+			foreach(Channel *sc, chans) {
+				if (u->qmPermissionSent.contains(sc->iId)) {
+					flushClientPermissionCache(u, mppq);
+					break;
+				}
+			}
+		}
+
+		foreach(const WhisperTarget &wt, u->qmTargets) {
+			if (targetReaches(wt, chans, ancestors, qhChannels, qhUsers)) {
+				invalidateTargets(u);
+				break;
+			}
+		}
+	}
+
+	invalidateFanout();
 }
 
 QString Server::addressToString(const QHostAddress &adr, unsigned short port) {
@@ -34,6 +34,7 @@
 
 #ifndef Q_MOC_RUN
 # include <boost/function.hpp>
+# include <boost/shared_ptr.hpp>
 #endif
 
 #include <QtCore/QEvent>
@@ -57,11 +58,14 @@
 #endif
 
 #include "ACL.h"
+#include "BanIndex.h"
 #include "Message.h"
 #include "Mumble.pb.h"
 #include "Net.h"
+#include "TicketKeys.h"
 #include "User.h"
 #include "Timer.h"
+#include "VoiceSnapshot.h"
 
 class BonjourServer;
 class Channel;
@@ -69,6 +73,13 @@ class PacketDataStream;
 class ServerUser;
 class User;
 class QNetworkAccessManager;
+class VoiceThread;
+class ControlThread;
+class DBWorker;
+struct WhisperTarget;
+#ifdef Q_OS_LINUX
+struct UDPSendBatch;
+#endif
 
 struct TextMessage {
 	QList<unsigned int> qlSessions;
@@ -77,6 +88,67 @@ struct TextMessage {
 	QString qsText;
 };
 
+/// The stored password of the account a login names, as found by
+/// lookupPassword(), and whether the given password matched it.
+struct PasswordCheck {
+	int iUserId;
+	QString qsName;
+	QString qsHash;
+	QString qsSalt;
+	int iKdfIterations;
+	bool bMatch;
+
+	PasswordCheck() : iUserId(-1), iKdfIterations(0), bMatch(false) {}
+	/// True if the password has to be run through PBKDF2 to be checked.
+	bool needsHash() const {
+		return (iUserId >= 0) && ! qsHash.isEmpty() && (iKdfIterations > 0);
+	}
+};
+
+/// A login in progress. Filled in by msgAuthenticate(), completed with the
+/// database lookups by authenticateLookup() or authenticateAsync() and
+/// finished by finishAuthenticate().
+struct AuthRequest {
+	ServerUser *uSource;
+	unsigned int uiSession;
+	MumbleProto::Authenticate msg;
+	QString qsName;
+	QString qsPassword;
+	QStringList qslEmail;
+	QString qsHash;
+	bool bVerified;
+	QList<QSslCertificate> qlCerts;
+	bool bNameOk;
+	bool bRememberChan;
+	/// Set if the login was refused because too many are in progress.
+	bool bBusy;
+
+	PasswordCheck pcPassword;
+
+	int iId;
+	int iLastChannel;
+	QByteArray qbaTexture;
+	QMap<int, QString> qmInfo;
+};
+
+typedef boost::shared_ptr<AuthRequest> AuthRequestPtr;
+
+/// A connection whose TLS handshake HandshakePool has finished, on its way
+/// to Server::adoptClient(). The socket is deleted along with it unless the
+/// server takes it, so it isn't lost if the server stops first.
+struct HandshakeResult {
+	QSslSocket *qssSocket;
+	bool bVerified;
+
+	HandshakeResult() : qssSocket(NULL), bVerified(true) {}
+	~HandshakeResult() {
+		if (qssSocket)
+			qssSocket->deleteLater();
+	}
+};
+
+typedef boost::shared_ptr<HandshakeResult> HandshakeResultPtr;
+
 class LogEmitter : public QObject {
 	private:
 		Q_OBJECT
@@ -114,8 +186,13 @@ class ExecEvent : public QEvent {
 	protected:
 		boost::function<void ()> func;
 	public:
-		ExecEvent(boost::function<void ()>);
+		/// Virtual server the call is for, or -1. MurmurIce forwards such
+		/// calls to the server's control thread.
+		int iServer;
+		ExecEvent(boost::function<void ()>, int server = -1);
 		void execute();
+		/// The same call, for posting to another receiver.
+		ExecEvent *redirect() const;
 };
 
 class Server : public QThread {
@@ -133,6 +210,9 @@ class Server : public QThread {
 		void startThread();
 		void stopThread();
 
+		/// Runs this server's event loop if Meta::mp.bControlThreads is set.
+		ControlThread *ctControl;
+
 		void customEvent(QEvent *evt);
 		// Former ServerParams
 	public:
@@ -209,19 +289,30 @@ class Server : public QThread {
 		void initializeCert();
 		const QString getDigest() const;
 
+		// New connections. With Meta::hpHandshakes enabled, the TLS handshake
+		// runs on its threads and adoptClient() takes over the encrypted socket.
+		/// Sorts the errors of a client's TLS handshake. Errors that only
+		/// mean the certificate can't be trusted clear verified; the rest
+		/// go to fatal. Returns true if the handshake may go on.
+		static bool checkSslErrors(const QList<QSslError> &errors, bool &verified, QList<QSslError> &fatal);
+		ServerUser *addClient(QSslSocket *sock, const HostAddress &ha);
+		void clientEncrypted(ServerUser *uSource);
+		void adoptClient(HandshakeResultPtr hr);
+		void handshakeFailed(const QHostAddress &address, quint16 port, const QString &reason);
+
 	public slots:
 		void newClient();
 		void connectionClosed(QAbstractSocket::SocketError, const QString &);
 		void sslError(const QList<QSslError> &);
 		void message(unsigned int, const QByteArray &, ServerUser *cCon = NULL);
 		void checkTimeout();
-		void tcpTransmitData(QByteArray, unsigned int);
+		void tcpTransmitData(unsigned int);
 		void doSync(unsigned int);
 		void encrypted();
 		void udpActivated(int);
 	signals:
 		void reqSync(unsigned int);
-		void tcpTransmit(QByteArray, unsigned int id);
+		void tcpTransmit(unsigned int id);
 	public:
 		int iServerNum;
 		QQueue<int> qqIds;
@@ -231,6 +322,15 @@ class Server : public QThread {
 #ifdef Q_OS_UNIX
 		int aiNotify[2];
 		QList<int> qlUdpSocket;
+		/// Additional SO_REUSEPORT sockets owned by the voice worker threads.
+		QList<int> qlReuseSocket;
+		/// Sockets served by run() itself; the rest belong to qlVoiceThreads.
+		QList<int> qlVoiceSocket;
+		QList<VoiceThread *> qlVoiceThreads;
+#ifdef Q_OS_LINUX
+		/// Outgoing voice datagrams queued by each voice thread. Only set while a voice loop is active.
+		QThreadStorage<UDPSendBatch *> qtsBatch;
+#endif
 #else
 		HANDLE hNotify;
 		QList<SOCKET> qlUdpSocket;
@@ -242,33 +342,114 @@ class Server : public QThread {
 		QHash<QPair<HostAddress, quint16>, ServerUser *> qhPeerUsers;
 		QHash<HostAddress, QSet<ServerUser *> > qhHostUsers;
 		QHash<unsigned int, Channel *> qhChannels;
+		/// Serializes writers of the user tables above. Readers on the
+		/// voice threads use voiceSnapshot() instead.
 		QReadWriteLock qrwlUsers;
+		QAtomicPointer<VoiceSnapshot> qapSnapshot;
+		VoiceEpoch veVoice;
+		/// Set when the fan-out lists of every channel have to be built
+		/// again, and while that is queued. Only used on the main thread.
+		bool bFanoutDirty;
+		bool bFanoutPending;
+		/// Guards acCache.
 		ChanACL::ACLCache acCache;
 		QMutex qmCache;
 		QHash<int, QString> qhUserNameCache;
 		QHash<QString, int> qhUserIDCache;
 
 		QList<Ban> qlBans;
+		/// Address bans of qlBans; rebuilt by getBans() and saveBans().
+		BanIndex biBans;
+
+		/// Session ticket keys, saved as the sslTicketKeys setting.
+		TicketKeys tkTickets;
+		/// TLS handshakes since the last report in checkTimeout(), and how
+		/// many of them resumed a session.
+		unsigned int uiTlsHandshakes, uiTlsResumed, uiTlsKernel;
+		/// Connections whose TLS handshake is running on Meta::hpHandshakes.
+		/// Each holds back one of qqIds until adoptClient() or
+		/// handshakeFailed().
+		int iHandshakes;
+		Timer tTlsReport;
+
+		VoiceSnapshot *voiceSnapshot() {
+			return qapSnapshot.fetchAndAddOrdered(0);
+		};
+		void publishUsers(const Channel *changed = NULL, const Channel *changed2 = NULL);
+		/// Has the fan-out lists in the snapshot built again, for instance
+		/// after links, ACLs or deafness changed.
+		void invalidateFanout();
+		void publishFanout();
+		void buildFanout(VoiceSnapshot *vs, const Channel *changed, const Channel *changed2);
+
+		/// Sessions whose whisper targets are to be resolved again, or all of
+		/// them if bTargetsDirty. Only used on the main thread.
+		QSet<unsigned int> qsTargetsDirty;
+		bool bTargetsDirty;
+		bool bTargetsPending;
+		/// Has the whisper targets of u, or of every user, resolved again
+		/// once the current event has been handled.
+		void invalidateTargets(ServerUser *u = NULL);
+		void resolveTargets();
+		void resolveTarget(ServerUser *u, const WhisperTarget &wt, QVector<ServerUser *> &channelTarget, QVector<ServerUser *> &directTarget);
 
 		void processMsg(ServerUser *u, const char *data, int len);
 		void sendMessage(ServerUser *u, const char *data, int len, QByteArray &cache, bool force = false);
+		void sendMessages(ServerUser * const *users, int count, const char *data, int len, QByteArray &cache);
+		void sendEncrypted(ServerUser * const *users, int count, const char *data, int len);
+		void sendDatagram(ServerUser *u, const char *buffer, int size);
 		void run();
+#ifdef Q_OS_UNIX
+		void initVoiceThreads();
+		void voiceLoop(const QList<int> &sockets);
+#else
+		void voiceLoop(const QList<SOCKET> &sockets);
+#endif
+#ifdef Q_OS_LINUX
+		void flushUdpBatch(UDPSendBatch *b);
+#endif
 
 		bool validateChannelName(const QString &name);
 		bool validateUserName(const QString &name);
 
+		/// Runs authentication and profile lookups that only need the database.
+		DBWorker *dbwWorker;
+		bool canAuthenticateAsync();
+		void authenticateLookup(AuthRequestPtr ar);
+		void authenticateDetails(AuthRequestPtr ar);
+		/// The steps of an asynchronous login. The account is looked up
+		/// on dbwWorker, the password hashed on Meta::hpPasswords and the
+		/// login completed on dbwWorker again.
+		void authenticateAsync(AuthRequestPtr ar);
+		void authenticateHash(AuthRequestPtr ar);
+		void authenticateVerify(AuthRequestPtr ar);
+		void finishAuthenticate(AuthRequestPtr ar);
+
 		bool checkDecrypt(ServerUser *u, const char *encrypted, char *plain, unsigned int cryptlen);
+		ServerUser *matchPeer(const VoiceSnapshot *vs, const HostAddress &ha, unsigned int hint, const char *encrypted, char *plain, unsigned int cryptlen);
 
 		bool hasPermission(ServerUser *p, Channel *c, QFlags<ChanACL::Perm> perm);
 		QFlags<ChanACL::Perm> effectivePermissions(ServerUser *p, Channel *c);
 		void sendClientPermission(ServerUser *u, Channel *c, bool updatelast = false);
 		void flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQuery &mpqq);
+		void dropACLCache(User *p);
 		void clearACLCache(User *p = NULL);
+		void clearACLCache(User *p, Channel *from, Channel *to);
+		void clearACLCache(Channel *c, Channel *oldParent = NULL);
 
 		void sendProtoAll(const ::google::protobuf::Message &msg, unsigned int msgType, unsigned int minversion);
 		void sendProtoExcept(ServerUser *, const ::google::protobuf::Message &msg, unsigned int msgType, unsigned int minversion);
 		void sendProtoMessage(ServerUser *, const ::google::protobuf::Message &msg, unsigned int msgType);
 
+		/// Client classes that get different UserStates on join: 1.2.2 and later
+		/// (hashes), older ones with a texture of the old format, other old ones.
+		enum JoinClass { JoinHashes, JoinTextures, JoinPlain };
+		/// Serialized channel tree and links for joining clients, by whether they
+		/// understand description hashes. Emptied whenever channel state is broadcast.
+		QByteArray qbaJoinChannels[2];
+		const QByteArray &joinChannels(bool hashes);
+		const QByteArray &joinUserState(ServerUser *u, JoinClass jc);
+
 		// sendAll sends a protobuf message to all users on the server whose version is either bigger than v or
 		// lower than ~v. If v == 0 the message is sent to everyone.
 #define MUMBLE_MH_MSG(x) \
@@ -298,6 +479,12 @@ class Server : public QThread {
 		Server(int snum, QObject *parent = NULL);
 		~Server();
 
+		/// Moves the server, its sockets and timers to a thread of its own.
+		/// The server must not have a parent.
+		void startControl();
+		/// Moves the server back to the main thread and ends its control thread.
+		void stopControl();
+
 		bool canNest(Channel *newParent, Channel *channel = NULL) const;
 
 		// RPC functions. Implementation in RPC.cpp
@@ -336,14 +523,19 @@ class Server : public QThread {
 		// Database / DBus functions. Implementation in ServerDB.cpp
 		void initialize();
 		int authenticate(QString &name, const QString &pw, int sessionId = 0, const QStringList &emails = QStringList(), const QString &certhash = QString(), bool bStrongCert = false, const QList<QSslCertificate> & = QList<QSslCertificate>());
+		/// The database part of authenticate(). Leaves the name caches alone, so it may run on dbwWorker.
+		int authenticateLocal(QString &name, const QString &pw, const QStringList &emails, const QString &certhash, bool bStrongCert);
+		/// The two halves of authenticateLocal(), around the PBKDF2 hash.
+		void lookupPassword(const QString &name, PasswordCheck &pc);
+		int verifyLocal(QString &name, const QString &pw, const QStringList &emails, const QString &certhash, bool bStrongCert, const PasswordCheck &pc);
 		Channel *addChannel(Channel *c, const QString &name, bool temporary = false, int position = 0);
 		void removeChannelDB(const Channel *c);
-		void readChannels(Channel *p = NULL);
+		void readChannels();
 		void readLinks();
 		void updateChannel(const Channel *c);
-		void readChannelPrivs(Channel *c);
 		void setLastChannel(const User *u);
 		int readLastChannel(int id);
+		int queryLastChannel(int id);
 		void dumpChannel(const Channel *c);
 		int getUserID(const QString &name);
 		QString getUserName(int id);
@@ -370,4 +562,29 @@ class Server : public QThread {
 #undef MUMBLE_MH_MSG
 };
 
+/// Event loop of one virtual server. Opens its own database connection,
+/// and hands the server back to the main thread when it quits.
+class ControlThread : public QThread {
+	private:
+		Q_DISABLE_COPY(ControlThread);
+	protected:
+		Server *s;
+		void run();
+	public:
+		ControlThread(Server *srv);
+};
+
+#ifdef Q_OS_UNIX
+class VoiceThread : public QThread {
+	private:
+		Q_DISABLE_COPY(VoiceThread);
+	protected:
+		Server *s;
+		QList<int> qlSockets;
+		void run();
+	public:
+		VoiceThread(Server *srv, const QList<int> &sockets);
+};
+#endif
+
 #endif
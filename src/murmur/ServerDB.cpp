@@ -34,12 +34,15 @@
 
 #include "ACL.h"
 #include "Channel.h"
+#include "ChannelLoader.h"
 #include "Connection.h"
 #include "DBus.h"
 #include "Group.h"
+#include "LogWriter.h"
 #include "Meta.h"
 #include "Server.h"
 #include "ServerUser.h"
+#include "StatementCache.h"
 #include "User.h"
 #include "PBKDF2.h"
 
@@ -51,21 +54,68 @@
 #define SOFTEXEC() ServerDB::exec(query, QString(), false)
 
 
+// Milliseconds a connection waits for another one's lock on an SQLite database.
+#define SQLITE_WAIT_MS 10000
+
+static void releaseStatement(QSqlQuery &query);
+
+/// Number of TransactionHolders alive on each thread.
+static QThreadStorage<int *> qtsTransactionDepth;
+
+/* Every thread talking to the database has a connection of its own. Only
+ * the outermost TransactionHolder on a thread begins and commits; nested
+ * ones join its transaction. Transactions are deferred, so in WAL mode
+ * readers never wait for a writer. With SQLite, a deferred transaction that
+ * reads and then writes fails at once with SQLITE_BUSY if another connection
+ * wrote in between, and waiting doesn't help it. Such read-modify-write
+ * paths pass write to take the write lock up front, waiting up to
+ * SQLITE_WAIT_MS for it. Returns true if a transaction was begun. */
+static bool beginTransaction(QSqlDatabase *d, bool write) {
+	if (! qtsTransactionDepth.hasLocalData())
+		qtsTransactionDepth.setLocalData(new int(0));
+	if ((*qtsTransactionDepth.localData())++ > 0)
+		return false;
+
+	bool ok;
+	QSqlError err;
+	if (write && (Meta::mp.qsDBDriver == "QSQLITE")) {
+		QSqlQuery query(*d);
+		ok = query.exec(QLatin1String("BEGIN IMMEDIATE"));
+		err = query.lastError();
+	} else {
+		ok = d->transaction();
+		err = d->lastError();
+	}
+	if (! ok)
+		qWarning("ServerDB: Failed to begin transaction, running without one: %s", qPrintable(err.text()));
+	return ok;
+}
+
+static void endTransaction(QSqlDatabase *d, bool begun) {
+	--(*qtsTransactionDepth.localData());
+	if (begun && ! d->commit())
+		qWarning("ServerDB: Failed to commit transaction: %s", qPrintable(d->lastError().text()));
+}
+
 class TransactionHolder {
 	public:
 		QSqlQuery *qsqQuery;
-		TransactionHolder() {
-			ServerDB::db->transaction();
-			qsqQuery = new QSqlQuery();
+		bool bBegun;
+		explicit TransactionHolder(bool write = false) {
+			QSqlDatabase *d = ServerDB::database();
+			bBegun = beginTransaction(d, write);
+			qsqQuery = new QSqlQuery(*d);
 		}
 
 		~TransactionHolder() {
+			// Resets the statement, which may be shared with the statement cache.
+			releaseStatement(*qsqQuery);
 			qsqQuery->clear();
 			delete qsqQuery;
-			ServerDB::db->commit();
+			endTransaction(ServerDB::database(), bBegun);
 		}
 		TransactionHolder(const TransactionHolder & other) {
-			ServerDB::db->transaction();
+			bBegun = beginTransaction(ServerDB::database(), false);
 			qsqQuery = other.qsqQuery ? new QSqlQuery(*other.qsqQuery) : 0;
 		}
 };
@@ -74,6 +124,23 @@ QSqlDatabase *ServerDB::db = NULL;
 Timer ServerDB::tLogClean;
 QString ServerDB::qsUpgradeSuffix;
 
+/// Connections opened by attachThread() for threads other than the main one.
+static QThreadStorage<QSqlDatabase *> qtsThreadDB;
+
+/// Statements prepared by ServerDB::prepare() on each thread's connection.
+static QThreadStorage<StatementCache *> qtsStatements;
+
+static StatementCache *statementCache() {
+	if (! qtsStatements.hasLocalData())
+		qtsStatements.setLocalData(new StatementCache());
+	return qtsStatements.localData();
+}
+
+/// Finishes query, and lets prepare() hand out the statement it held again.
+static void releaseStatement(QSqlQuery &query) {
+	statementCache()->release(query);
+}
+
 void ServerDB::loadOrSetupMetaPKBDF2IterationsCount(QSqlQuery &query) {
 	if (!Meta::mp.legacyPasswordHash) {
 		if (Meta::mp.kdfIterations <= 0) {
@@ -117,6 +184,9 @@ ServerDB::ServerDB() {
 	bool found = false;
 
 	if (Meta::mp.qsDBDriver == "QSQLITE") {
+		// Connections opened by attachThread() are clones and inherit this.
+		db->setConnectOptions(QString::fromLatin1("QSQLITE_BUSY_TIMEOUT=%1").arg(SQLITE_WAIT_MS));
+
 		if (! Meta::mp.qsDatabase.isEmpty()) {
 			db->setDatabaseName(Meta::mp.qsDatabase);
 			found = db->open();
@@ -154,6 +224,12 @@ ServerDB::ServerDB() {
 			qWarning("ServerDB: Opened SQLite database %s", qPrintable(fi.absoluteFilePath()));
 			if (! fi.isWritable())
 				qFatal("ServerDB: Database is not writable");
+
+			// Lets the connections of other threads read while one writes. The
+			// mode is stored in the database file.
+			QSqlQuery pragma(*db);
+			if (! pragma.exec(QLatin1String("PRAGMA journal_mode=WAL")) || ! pragma.next() || (pragma.value(0).toString().toLower() != QLatin1String("wal")))
+				qWarning("ServerDB: Failed to enable write-ahead logging, writes may block other threads");
 		}
 	} else {
 		db->setDatabaseName(Meta::mp.qsDatabase);
@@ -170,7 +246,7 @@ ServerDB::ServerDB() {
 		qFatal("ServerDB: Failed initialization: %s",qPrintable(e.text()));
 	}
 
-	TransactionHolder th;
+	TransactionHolder th(true);
 
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -502,16 +578,52 @@ ServerDB::ServerDB() {
 }
 
 ServerDB::~ServerDB() {
+	statementCache()->clear();
 	db->close();
 	delete db;
 	db = NULL;
 }
 
-bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool warn) {
-	if (! db->isValid()) {
+QSqlDatabase *ServerDB::database() {
+	if (qtsThreadDB.hasLocalData() && qtsThreadDB.localData())
+		return qtsThreadDB.localData();
+	return db;
+}
+
+void ServerDB::attachThread(const QString &connection) {
+	QSqlDatabase *tdb = new QSqlDatabase(QSqlDatabase::cloneDatabase(*db, connection));
+	if (! tdb->open())
+		qWarning("ServerDB: Failed to open connection %s: %s", qPrintable(connection), qPrintable(tdb->lastError().text()));
+	qtsThreadDB.setLocalData(tdb);
+}
+
+void ServerDB::detachThread() {
+	if (! qtsThreadDB.hasLocalData() || ! qtsThreadDB.localData())
+		return;
+
+	QSqlDatabase *tdb = qtsThreadDB.localData();
+	const QString connection = tdb->connectionName();
+	statementCache()->clear();
+	tdb->close();
+	// Deletes tdb, which must be gone before the connection can be removed.
+	qtsThreadDB.setLocalData(NULL);
+	QSqlDatabase::removeDatabase(connection);
+}
+
+bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool warn, bool cache) {
+	QSqlDatabase *d = database();
+	if (! d->isValid()) {
 		qWarning("SQL [%s] rejected: Database is gone", qPrintable(str));
 		return false;
 	}
+
+	// Reset whatever query held before, so it can be handed out again.
+	releaseStatement(query);
+
+	StatementCache *sc = statementCache();
+	if (cache && sc->acquire(query, str))
+		return true;
+
 	QString q;
 	if (str.contains(QLatin1String("%1"))) {
 		if (str.contains(QLatin1String("%2")))
@@ -522,14 +634,14 @@ bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool wa
 		q = str;
 	}
 
+	query = QSqlQuery(*d);
 	if (query.prepare(q)) {
+		if (cache)
+			sc->insert(str, query);
 		return true;
 	} else {
-		db->close();
-		if (! db->open()) {
-			qFatal("Lost connection to SQL Database: Reconnect: %s", qPrintable(db->lastError().text()));
-		}
-		query = QSqlQuery();
+		reconnect();
+		query = QSqlQuery(*d);
 		if (query.prepare(q)) {
 			qWarning("SQL Connection lost, reconnection OK");
 			return true;
@@ -545,11 +657,54 @@ bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool wa
 	}
 }
 
+void ServerDB::reconnect() {
+	QSqlDatabase *d = database();
+
+	// Prepared statements don't survive their connection.
+	statementCache()->clear();
+
+	d->close();
+	if (! d->open()) {
+		qFatal("Lost connection to SQL Database: Reconnect: %s", qPrintable(d->lastError().text()));
+	}
+}
+
+bool ServerDB::reprepare(QSqlQuery &query) {
+	if (! statementCache()->holds(query))
+		return false;
+
+	// Statements that are prepared anew fail in prepare(), which reconnects
+	// by itself. A cached one only finds out that the connection was lost
+	// when it is executed, so see whether the connection is still good.
+	QSqlDatabase *d = database();
+	const QString q = query.lastQuery();
+	QSqlQuery probe(*d);
+	if (probe.prepare(q))
+		return false;
+
+	QList<QVariant> values;
+	const int count = query.boundValues().count();
+	for (int i=0;i<count;++i)
+		values << query.boundValue(i);
+
+	reconnect();
+	query = QSqlQuery(*d);
+	if (! query.prepare(q))
+		return false;
+	foreach(const QVariant &v, values)
+		query.addBindValue(v);
+
+	qWarning("SQL Connection lost, reconnection OK");
+	return true;
+}
+
 bool ServerDB::exec(QSqlQuery &query, const QString &str, bool fatal, bool warn) {
 	if (! str.isEmpty())
-		prepare(query, str, fatal, warn);
+		prepare(query, str, fatal, warn, false);
 	if (query.exec()) {
 		return true;
+	} else if (reprepare(query) && query.exec()) {
+		return true;
 	} else {
 
 		if (fatal) {
@@ -564,9 +719,11 @@ bool ServerDB::exec(QSqlQuery &query, const QString &str, bool fatal, bool warn)
 
 bool ServerDB::execBatch(QSqlQuery &query, const QString &str, bool fatal) {
 	if (! str.isEmpty())
-		prepare(query, str, fatal);
+		prepare(query, str, fatal, true, false);
 	if (query.execBatch()) {
 		return true;
+	} else if (reprepare(query) && query.execBatch()) {
+		return true;
 	} else {
 
 		if (fatal) {
@@ -579,7 +736,7 @@ bool ServerDB::execBatch(QSqlQuery &query, const QString &str, bool fatal) {
 }
 
 void Server::initialize() {
-	TransactionHolder th;
+	TransactionHolder th(true);
 
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -702,7 +859,7 @@ int Server::registerUser(const QMap<int, QString> &info) {
 	if (res == -1)
 		return res;
 
-	TransactionHolder th;
+	TransactionHolder th(true);
 
 	QSqlQuery &query = *th.qsqQuery;
 	int id = 0;
@@ -904,6 +1061,82 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 		return res;
 	}
 
+	res = authenticateLocal(name, password, emails, certhash, bStrongCert);
+	if (res >= 0) {
+		qhUserNameCache.remove(res);
+		qhUserIDCache.remove(name);
+	}
+	return res;
+}
+
+bool Server::canAuthenticateAsync() {
+	// RPC authenticators are called through these signals and must be called
+	// from the main thread.
+	if (bForceExternalAuth)
+		return false;
+	return (receivers(SIGNAL(authenticateSig(int &, QString &, int, const QList<QSslCertificate> &, const QString &, bool, const QString &))) == 0)
+	       && (receivers(SIGNAL(setInfoSig(int &, int, const QMap<int, QString> &))) == 0)
+	       && (receivers(SIGNAL(idToTextureSig(QByteArray &, int))) == 0)
+	       && (receivers(SIGNAL(getRegistrationSig(int &, int, QMap<int, QString> &))) == 0);
+}
+
+void Server::authenticateLookup(AuthRequestPtr ar) {
+	ar->iId = authenticate(ar->qsName, ar->qsPassword, ar->uiSession, ar->qslEmail, ar->qsHash, ar->bVerified, ar->qlCerts);
+	authenticateDetails(ar);
+}
+
+void Server::authenticateDetails(AuthRequestPtr ar) {
+	ar->iLastChannel = -1;
+	if (ar->iId >= 0) {
+		if (ar->bRememberChan)
+			ar->iLastChannel = queryLastChannel(ar->iId);
+		ar->qbaTexture = getUserTexture(ar->iId);
+		ar->qmInfo = getRegistration(ar->iId);
+	}
+}
+
+void Server::authenticateAsync(AuthRequestPtr ar) {
+	lookupPassword(ar->qsName, ar->pcPassword);
+	if (! ar->pcPassword.needsHash()) {
+		authenticateVerify(ar);
+		return;
+	}
+	// Only logins that need hashing take room in the pool. Refuse rather
+	// than queue when it is full, so a flood can't build up an unbounded
+	// backlog.
+	if (! meta->hpPasswords.admit(this)) {
+		ar->bBusy = true;
+		QCoreApplication::instance()->postEvent(this, new ExecEvent(boost::bind(&Server::finishAuthenticate, this, ar)));
+		return;
+	}
+	// Fails only while this server is being deleted, when nobody is
+	// waiting for the answer anymore.
+	meta->hpPasswords.post(this, boost::bind(&Server::authenticateHash, this, ar));
+}
+
+void Server::authenticateHash(AuthRequestPtr ar) {
+	PasswordCheck &pc = ar->pcPassword;
+	pc.bMatch = (PBKDF2::getHash(pc.qsSalt, ar->qsPassword, pc.iKdfIterations) == pc.qsHash);
+	dbwWorker->post(boost::bind(&Server::authenticateVerify, this, ar));
+}
+
+void Server::authenticateVerify(AuthRequestPtr ar) {
+	ar->iId = verifyLocal(ar->qsName, ar->qsPassword, ar->qslEmail, ar->qsHash, ar->bVerified, ar->pcPassword);
+	authenticateDetails(ar);
+	if (ar->pcPassword.needsHash())
+		meta->hpPasswords.release(this);
+	QCoreApplication::instance()->postEvent(this, new ExecEvent(boost::bind(&Server::finishAuthenticate, this, ar)));
+}
+
+int Server::authenticateLocal(QString &name, const QString &password, const QStringList &emails, const QString &certhash, bool bStrongCert) {
+	PasswordCheck pc;
+	lookupPassword(name, pc);
+	if (pc.needsHash())
+		pc.bMatch = (PBKDF2::getHash(pc.qsSalt, password, pc.iKdfIterations) == pc.qsHash);
+	return verifyLocal(name, password, emails, certhash, bStrongCert, pc);
+}
+
+void Server::lookupPassword(const QString &name, PasswordCheck &pc) {
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -912,10 +1145,24 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 	query.addBindValue(name);
 	SQLEXEC();
 	if (query.next()) {
-		const int userId = query.value(0).toInt();
-		const QString storedPasswordHash = query.value(2).toString();
-		const QString storedSalt = query.value(3).toString();
-		const int storedKdfIterations = query.value(4).toInt();
+		pc.iUserId = query.value(0).toInt();
+		pc.qsName = query.value(1).toString();
+		pc.qsHash = query.value(2).toString();
+		pc.qsSalt = query.value(3).toString();
+		pc.iKdfIterations = query.value(4).toInt();
+	}
+}
+
+int Server::verifyLocal(QString &name, const QString &password, const QStringList &emails, const QString &certhash, bool bStrongCert, const PasswordCheck &pc) {
+	int res = -2;
+
+	TransactionHolder th;
+	QSqlQuery &query = *th.qsqQuery;
+
+	if (pc.iUserId >= 0) {
+		const int userId = pc.iUserId;
+		const QString &storedPasswordHash = pc.qsHash;
+		const int storedKdfIterations = pc.iKdfIterations;
 		res = -1;
 
 		if (!storedPasswordHash.isEmpty()) {
@@ -925,8 +1172,8 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 				// If storedKdfIterations is <=0 this means this is an old-style SHA1 hash
 				// that hasn't been converted yet. Or we are operating in legacy mode.
 				if (ServerDB::getLegacySHA1Hash(password) == storedPasswordHash) {
-					name = query.value(1).toString();
-					res = query.value(0).toInt();
+					name = pc.qsName;
+					res = userId;
 					
 					if (! Meta::mp.legacyPasswordHash) {
 						// Unless disabled upgrade the user password hash
@@ -941,9 +1188,10 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 					}
 				}
 			} else {
-				if (PBKDF2::getHash(storedSalt, password, storedKdfIterations) == storedPasswordHash) {
-					name = query.value(1).toString();
-					res = query.value(0).toInt();
+				// The PBKDF2 hash is computed by the caller, see PasswordCheck.
+				if (pc.bMatch) {
+					name = pc.qsName;
+					res = userId;
 					
 					if (Meta::mp.legacyPasswordHash) {
 						// Downgrade the password to the legacy hash
@@ -1027,10 +1275,6 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 			SQLEXEC();
 		}
 	}
-	if (res >= 0) {
-		qhUserNameCache.remove(res);
-		qhUserIDCache.remove(name);
-	}
 	return res;
 }
 
@@ -1154,7 +1398,7 @@ bool Server::setTexture(int id, const QByteArray &texture) {
 }
 
 void ServerDB::setSUPW(int srvnum, const QString &pw) {
-	TransactionHolder th;
+	TransactionHolder th(true);
 	QString pwHash, saltHash;
 
 	if (!Meta::mp.legacyPasswordHash) {
@@ -1272,6 +1516,8 @@ QByteArray Server::getUserTexture(int id) {
 
 void Server::addLink(Channel *c, Channel *l) {
 	c->link(l);
+	invalidateFanout();
+	invalidateTargets();
 
 	if (c->bTemporary || l->bTemporary)
 		return;
@@ -1292,6 +1538,8 @@ void Server::addLink(Channel *c, Channel *l) {
 
 void Server::removeLink(Channel *c, Channel *l) {
 	c->unlink(l);
+	invalidateFanout();
+	invalidateTargets();
 
 	if (c->bTemporary || l->bTemporary)
 		return;
@@ -1312,7 +1560,7 @@ void Server::removeLink(Channel *c, Channel *l) {
 }
 
 Channel *Server::addChannel(Channel *p, const QString &name, bool temporary, int position) {
-	TransactionHolder th;
+	TransactionHolder th(true);
 
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -1459,125 +1707,56 @@ void Server::updateChannel(const Channel *c) {
 	}
 }
 
-/** Reads the channel privileges (group and acl) as well as the channel information key/value pairs from the database.
- * @param c Channel to fetch information for
+/** Reads all channels of the server, with their information key/value pairs, groups and ACLs.
+ * Every table is read with a single query and the tree assembled by ChannelLoader, so the
+ * number of round trips to the database doesn't grow with the number of channels.
  */
-void Server::readChannelPrivs(Channel *c) {
+void Server::readChannels() {
 	TransactionHolder th;
-
-	int cid = c->iId;
-
 	QSqlQuery &query = *th.qsqQuery;
 
-	SQLPREP("SELECT `key`, `value` FROM `%1channel_info` WHERE `server_id` = ? AND `channel_id` = ?");
-	query.addBindValue(iServerNum);
-	query.addBindValue(cid);
-	SQLEXEC();
-	while (query.next()) {
-		int key = query.value(0).toInt();
-		const QString &value = query.value(1).toString();
-		if (key == ServerDB::Channel_Description) {
-			hashAssign(c->qsDesc, c->qbaDescHash, value);
-		} else if (key == ServerDB::Channel_Position) {
-			c->iPosition = QVariant(value).toInt(); // If the conversion fails it'll return the default value 0
-		}
-	}
+	ChannelLoader cl(qhChannels, this);
 
-	SQLPREP("SELECT `group_id`, `name`, `inherit`, `inheritable` FROM `%1groups` WHERE `server_id` = ? AND `channel_id` = ?");
+	SQLPREP(ChannelLoader::sqlChannels);
 	query.addBindValue(iServerNum);
-	query.addBindValue(cid);
 	SQLEXEC();
-	while (query.next()) {
-		int gid = query.value(0).toInt();
-		QString name = query.value(1).toString();
-		Group *g = new Group(c, name);
-		g->bInherit = query.value(2).toBool();
-		g->bInheritable = query.value(3).toBool();
-
-		QSqlQuery mem;
-		mem.prepare(QString::fromLatin1("SELECT user_id, addit FROM %1group_members WHERE group_id = ?").arg(Meta::mp.qsDBPrefix));
-		mem.addBindValue(gid);
-		mem.exec();
-		while (mem.next()) {
-			int uid = mem.value(0).toInt();
-			if (mem.value(1).toBool())
-				g->qsAdd << uid;
-			else
-				g->qsRemove << uid;
-		}
-	}
+	cl.addChannels(query);
 
-	SQLPREP("SELECT `user_id`, `group_name`, `apply_here`, `apply_sub`, `grantpriv`, `revokepriv` FROM `%1acl` WHERE `server_id` = ? AND `channel_id` = ? ORDER BY `priority`");
+	SQLPREP(ChannelLoader::sqlInfo);
 	query.addBindValue(iServerNum);
-	query.addBindValue(cid);
 	SQLEXEC();
-	while (query.next()) {
-		ChanACL *acl = new ChanACL(c);
-		acl->iUserId = query.value(0).isNull() ? -1 : query.value(0).toInt();
-		acl->qsGroup = query.value(1).toString();
-		acl->bApplyHere = query.value(2).toBool();
-		acl->bApplySubs = query.value(3).toBool();
-		acl->pAllow = static_cast<ChanACL::Permissions>(query.value(4).toInt());
-		acl->pDeny = static_cast<ChanACL::Permissions>(query.value(5).toInt());
-	}
-}
+	cl.addInfo(query);
 
-void Server::readChannels(Channel *p) {
-	QList<Channel *> kids;
-	Channel *c;
-	QSqlQuery query;
-	int parentid = -1;
+	foreach(Channel *c, qhChannels)
+		if (! c->qsDesc.isEmpty())
+			hashAssign(c->qsDesc, c->qbaDescHash, c->qsDesc);
 
-	if (p) {
-		parentid = p->iId;
-		readChannelPrivs(qhChannels.value(parentid));
-	}
-
-	{
-		TransactionHolder th;
-		if (parentid == -1) {
-			SQLPREP("SELECT `channel_id`, `name`, `inheritacl` FROM `%1channels` WHERE `server_id` = ? AND `parent_id` IS NULL ORDER BY `name`");
-			query.addBindValue(iServerNum);
-		} else {
-			SQLPREP("SELECT `channel_id`, `name`, `inheritacl` FROM `%1channels` WHERE `server_id` = ? AND `parent_id`=? ORDER BY `name`");
-			query.addBindValue(iServerNum);
-			query.addBindValue(parentid);
-		}
-		SQLEXEC();
-
-		while (query.next()) {
-			c = new Channel(query.value(0).toInt(), query.value(1).toString(), p);
-			if (! p)
-				c->setParent(this);
-			qhChannels.insert(c->iId, c);
-			c->bInheritACL = query.value(2).toBool();
-			kids << c;
-		}
-	}
+	SQLPREP(ChannelLoader::sqlGroups);
+	query.addBindValue(iServerNum);
+	SQLEXEC();
+	cl.addGroups(query);
 
-	query.clear();
+	SQLPREP(ChannelLoader::sqlGroupMembers);
+	query.addBindValue(iServerNum);
+	SQLEXEC();
+	cl.addGroupMembers(query);
 
-	foreach(c, kids)
-		readChannels(c);
+	SQLPREP(ChannelLoader::sqlACL);
+	query.addBindValue(iServerNum);
+	SQLEXEC();
+	cl.addACLs(query);
 }
 
 void Server::readLinks() {
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
-	SQLPREP("SELECT `channel_id`, `link_id` FROM `%1channel_links` WHERE `server_id` = ?");
+	ChannelLoader cl(qhChannels, this);
+
+	SQLPREP(ChannelLoader::sqlLinks);
 	query.addBindValue(iServerNum);
 	SQLEXEC();
-
-	while (query.next()) {
-		int cid = query.value(0).toInt();
-		int lid = query.value(1).toInt();
-
-		Channel *c = qhChannels.value(cid);
-		Channel *l = qhChannels.value(lid);
-		if (c && l)
-			c->link(l);
-	}
+	cl.addLinks(query);
 }
 
 void Server::setLastChannel(const User *p) {
@@ -1602,6 +1781,13 @@ void Server::setLastChannel(const User *p) {
 }
 
 int Server::readLastChannel(int id) {
+	int cid = queryLastChannel(id);
+	if (qhChannels.contains(cid))
+		return cid;
+	return -1;
+}
+
+int Server::queryLastChannel(int id) {
 	if (id < 0)
 		return -1;
 
@@ -1613,11 +1799,8 @@ int Server::readLastChannel(int id) {
 	query.addBindValue(id);
 	SQLEXEC();
 
-	if (query.next()) {
-		int cid = query.value(0).toInt();
-		if (qhChannels.contains(cid))
-			return cid;
-	}
+	if (query.next())
+		return query.value(0).toInt();
 	return -1;
 }
 
@@ -1676,9 +1859,13 @@ void Server::getBans() {
 		if (ban.isValid())
 			qlBans << ban;
 	}
+
+	biBans.rebuild(qlBans);
 }
 
 void Server::saveBans() {
+	biBans.rebuild(qlBans);
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -1738,26 +1925,15 @@ void Server::setConf(const QString &key, const QVariant &value) {
 }
 
 void Server::dblog(const QString &str) const {
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
-
 	// Is logging disabled?
 	if (Meta::mp.iLogDays < 0)
 		return;
 
-	// Once per hour
-	if (Meta::mp.iLogDays > 0) {
-		if (ServerDB::tLogClean.isElapsed(3600ULL * 1000000ULL)) {
-			QString qstr;
-			if (Meta::mp.qsDBDriver == "QSQLITE") {
-				qstr = QString::fromLatin1("msgtime < datetime('now','-%1 days')").arg(Meta::mp.iLogDays);
-			} else {
-				qstr = QString::fromLatin1("msgtime < now() - INTERVAL %1 day").arg(Meta::mp.iLogDays);
-			}
-			ServerDB::prepare(query, QString::fromLatin1("DELETE FROM %1slog WHERE ") + qstr);
-			SQLEXEC();
-		}
-	}
+	if (lwLog && lwLog->post(iServerNum, str))
+		return;
+
+	TransactionHolder th;
+	QSqlQuery &query = *th.qsqQuery;
 
 	SQLPREP("INSERT INTO `%1slog` (`server_id`, `msg`) VALUES(?,?)");
 	query.addBindValue(iServerNum);
@@ -1765,6 +1941,49 @@ void Server::dblog(const QString &str) const {
 	SQLEXEC();
 }
 
+void ServerDB::addLog(const QList<QPair<int, QString> > &entries) {
+	int i = 0;
+	while (i < entries.count()) {
+		const int rows = qMin(entries.count() - i, LOG_INSERT_ROWS);
+
+		// One transaction per INSERT, so a long backlog doesn't hold the
+		// write lock away from the other connections.
+		TransactionHolder th;
+		QSqlQuery &query = *th.qsqQuery;
+
+		QString sql = QLatin1String("INSERT INTO `%1slog` (`server_id`, `msg`) VALUES (?,?)");
+		for (int j=1;j<rows;++j)
+			sql.append(QLatin1String(",(?,?)"));
+
+		if (ServerDB::prepare(query, sql, false)) {
+			for (int j=0;j<rows;++j) {
+				query.addBindValue(entries.at(i + j).first);
+				query.addBindValue(entries.at(i + j).second);
+			}
+			SOFTEXEC();
+		}
+		i += rows;
+	}
+}
+
+int ServerDB::pruneLog(int days, int rows) {
+	TransactionHolder th;
+	QSqlQuery &query = *th.qsqQuery;
+
+	// SQLite has no DELETE ... LIMIT unless built for it.
+	QString qstr;
+	if (Meta::mp.qsDBDriver == "QSQLITE") {
+		qstr = QString::fromLatin1("rowid IN (SELECT rowid FROM %1slog WHERE msgtime < datetime('now','-%2 days') LIMIT %3)").arg(QLatin1String("%1"), QString::number(days), QString::number(rows));
+	} else {
+		qstr = QString::fromLatin1("msgtime < now() - INTERVAL %1 day LIMIT %2").arg(days).arg(rows);
+	}
+	if (! ServerDB::prepare(query, QString::fromLatin1("DELETE FROM %1slog WHERE ") + qstr, false))
+		return 0;
+	if (! SOFTEXEC())
+		return 0;
+	return query.numRowsAffected();
+}
+
 void ServerDB::wipeLogs() {
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
@@ -1868,7 +2087,7 @@ bool ServerDB::serverExists(int num) {
 }
 
 int ServerDB::addServer() {
-	TransactionHolder th;
+	TransactionHolder th(true);
 	QSqlQuery &query = *th.qsqQuery;
 	SQLPREP("SELECT MAX(`server_id`)+1 AS id FROM `%1servers`");
 	SQLEXEC();
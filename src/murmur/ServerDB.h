@@ -63,8 +63,18 @@ class ServerDB {
 		static QList<LogRecord> getLog(int server_id, unsigned int offs_min, unsigned int offs_max);
 		static QString getLegacySHA1Hash(const QString &password);
 		static int getLogLen(int server_id);
+		/// Inserts (server_id, message) pairs into the slog table, several rows per statement.
+		static void addLog(const QList<QPair<int, QString> > &entries);
+		/// Deletes up to rows slog entries older than days. Returns the number deleted.
+		static int pruneLog(int days, int rows);
 		static void wipeLogs();
-		static bool prepare(QSqlQuery &, const QString &, bool fatal = true, bool warn = true);
+		/// Connection for the calling thread; the shared db unless attachThread() was called.
+		static QSqlDatabase *database();
+		/// Gives the calling thread its own connection, named connection, to the same database.
+		static void attachThread(const QString &connection);
+		static void detachThread();
+		/// Prepares str, reusing this connection's earlier statement for it if cache is set.
+		static bool prepare(QSqlQuery &, const QString &, bool fatal = true, bool warn = true, bool cache = true);
 		static bool exec(QSqlQuery &, const QString &str = QString(), bool fatal= true, bool warn = true);
 		static bool execBatch(QSqlQuery &, const QString &str = QString(), bool fatal= true);
 		// No copy; private declaration without implementation
@@ -72,6 +82,8 @@ class ServerDB {
 		
 	private:
 		static void loadOrSetupMetaPKBDF2IterationsCount(QSqlQuery &query);
+		static void reconnect();
+		static bool reprepare(QSqlQuery &query);
 };
 
 #endif
@@ -34,6 +34,7 @@
 #include "Server.h"
 #include "ServerUser.h"
 #include "Meta.h"
+#include "KernelTls.h"
 
 ServerUser::ServerUser(Server *p, QSslSocket *socket) : Connection(p, socket), User(), s(NULL) {
 	sState = ServerUser::Connected;
@@ -41,17 +42,40 @@ ServerUser::ServerUser(Server *p, QSslSocket *socket) : Connection(p, socket), U
 
 	memset(&saiUdpAddress, 0, sizeof(saiUdpAddress));
 	memset(&saiTcpLocalAddress, 0, sizeof(saiTcpLocalAddress));
+#ifdef Q_OS_LINUX
+	memset(&mhUdp, 0, sizeof(mhUdp));
+	bUdpHeader = false;
+#endif
 
 	dUDPPingAvg = dUDPPingVar = 0.0f;
 	dTCPPingAvg = dTCPPingVar = 0.0f;
 	uiUDPPackets = uiTCPPackets = 0;
 
 	bUdp = true;
+	bUdpHint = false;
 	uiVersion = 0;
 	bVerified = true;
 	iLastPermissionCheck = -1;
 	
 	bOpus = false;
+	bAuthPending = false;
+}
+
+ServerUser::~ServerUser() {
+	delete qapTargets.fetchAndStoreOrdered(NULL);
+}
+
+bool ServerUser::sessionResumed() const {
+	return TicketKeys::isResumed(qtsSocket);
+}
+
+bool ServerUser::enableKernelTls() {
+	KernelTls *kt = KernelTls::enable(qtsSocket);
+	if (! kt)
+		return false;
+
+	qiodWrite = kt;
+	return true;
 }
 
 
@@ -59,32 +83,38 @@ ServerUser::operator const QString() const {
 	return QString::fromLatin1("%1:%2(%3)").arg(qsName).arg(uiSession).arg(iId);
 }
 BandwidthRecord::BandwidthRecord() {
-	iRecNum = 0;
-	iSum = 0;
-	for (int i=0;i<N_BANDWIDTH_SLOTS;i++)
-		a_iBW[i] = 0;
+	uiLast = 0;
+	uiIdleControl = 0;
+	uiWindow = 0;
+	iBudget = 0;
+	iWindowBytes = 0;
+	iPrevWindowBytes = 0;
 }
 
 bool BandwidthRecord::addFrame(int size, int maxpersec) {
-	quint64 elapsed = a_qtWhen[iRecNum].elapsed();
+	const quint64 now = tFirst.elapsed();
+	const qint64 burst = static_cast<qint64>(maxpersec) * BANDWIDTH_BURST_SECONDS * 1000000LL;
 
-	if (elapsed == 0)
-		return false;
-
-	int nsum = iSum-a_iBW[iRecNum]+size;
-	int bw = static_cast<int>((nsum * 1000000LL) / elapsed);
+	// Refill for the time since the last accepted frame. A rejected frame
+	// leaves the record untouched, so the refill isn't lost.
+	qint64 budget = iBudget + static_cast<qint64>(now - uiLast) * maxpersec;
+	if (budget > burst)
+		budget = burst;
 
-	if (bw > maxpersec)
+	budget -= static_cast<qint64>(size) * 1000000LL;
+	if (budget < 0)
 		return false;
 
-	a_iBW[iRecNum] = static_cast<unsigned short>(size);
-	a_qtWhen[iRecNum].restart();
+	iBudget = budget;
+	uiLast = now;
 
-	iSum = nsum;
-
-	iRecNum++;
-	if (iRecNum == N_BANDWIDTH_SLOTS)
-		iRecNum = 0;
+	const quint64 windows = (now - uiWindow) / 1000000ULL;
+	if (windows > 0) {
+		iPrevWindowBytes = (windows == 1) ? iWindowBytes : 0;
+		iWindowBytes = 0;
+		uiWindow += windows * 1000000ULL;
+	}
+	iWindowBytes += size;
 
 	return true;
 }
@@ -94,37 +124,20 @@ int BandwidthRecord::onlineSeconds() const {
 }
 
 int BandwidthRecord::idleSeconds() const {
-	quint64 iIdle = a_qtWhen[(iRecNum + N_BANDWIDTH_SLOTS - 1) % N_BANDWIDTH_SLOTS].elapsed();
-	if (tIdleControl.elapsed() < iIdle)
-		iIdle = tIdleControl.elapsed();
-
-	return static_cast<int>(iIdle / 1000000LL);
+	return static_cast<int>((tFirst.elapsed() - qMax(uiLast, uiIdleControl)) / 1000000LL);
 }
 
 void BandwidthRecord::resetIdleSeconds() {
-	tIdleControl.restart();
+	uiIdleControl = tFirst.elapsed();
 }
 
 int BandwidthRecord::bandwidth() const {
-	int sum = 0;
-	int records = 0;
-	quint64 elapsed = 0ULL;
-
-	for (int i=1;i<N_BANDWIDTH_SLOTS;++i) {
-		int idx = (iRecNum + N_BANDWIDTH_SLOTS - i) % N_BANDWIDTH_SLOTS;
-		quint64 e = a_qtWhen[idx].elapsed();
-		if (e > 1000000ULL) {
-			break;
-		} else {
-			++records;
-			sum += a_iBW[idx];
-			elapsed = e;
-		}
-	}
-
-	if (elapsed < 250000ULL)
+	const quint64 into = tFirst.elapsed() - uiWindow;
+	if (into >= 2000000ULL)
 		return 0;
 
-	return static_cast<int>((sum * 1000000ULL) / elapsed);
+	// Weigh the previous window by how much of it still lies within the last second.
+	if (into >= 1000000ULL)
+		return static_cast<int>((iWindowBytes * (2000000ULL - into)) / 1000000ULL);
+	return static_cast<int>((iPrevWindowBytes * (1000000ULL - into)) / 1000000ULL) + iWindowBytes;
 }
-
@@ -32,7 +32,9 @@
 #ifndef MUMBLE_MURMUR_SERVERUSER_H_
 #define MUMBLE_MURMUR_SERVERUSER_H_
 
+#include <QtCore/QAtomicPointer>
 #include <QtCore/QStringList>
+#include <QtCore/QVector>
 
 #ifdef Q_OS_UNIX
 #include <sys/socket.h>
@@ -45,19 +47,25 @@
 #include "Timer.h"
 #include "User.h"
 
-// Unfortunately, this needs to be "large enough" to hold
-// enough frames to account for both short-term and
-// long-term "maladjustments".
+// How far a user may run ahead of the bandwidth limit. This needs to be
+// "large enough" to absorb both short-term and long-term "maladjustments",
+// like a burst of frames that were held up in the network.
 
-#define N_BANDWIDTH_SLOTS 360
+#define BANDWIDTH_BURST_SECONDS 3
 
+/// Token bucket voice rate limiter. All times are microseconds relative to
+/// tFirst, so a frame costs a single clock read.
 struct BandwidthRecord {
-	int iRecNum;
-	int iSum;
 	Timer tFirst;
-	Timer tIdleControl;
-	unsigned short a_iBW[N_BANDWIDTH_SLOTS];
-	Timer a_qtWhen[N_BANDWIDTH_SLOTS];
+	/// Time of the last accepted frame.
+	quint64 uiLast;
+	quint64 uiIdleControl;
+	/// Start of the current one second accounting window of bandwidth().
+	quint64 uiWindow;
+	/// Remaining burst allowance, in bytes times 1000000.
+	qint64 iBudget;
+	int iWindowBytes;
+	int iPrevWindowBytes;
 
 	BandwidthRecord();
 	bool addFrame(int size, int maxpersec);
@@ -78,6 +86,18 @@ struct WhisperTarget {
 	QList<WhisperTarget::Channel> qlChannels;
 };
 
+class ServerUser;
+
+/// Who hears each of a user's whisper targets, indexed by target id. Built on
+/// the main thread by Server::resolveTargets() and never modified once published.
+struct WhisperRecipients {
+	/// Bit n is set if target n is defined.
+	quint32 uiTargets;
+	QVector<ServerUser *> qvChannel[32];
+	QVector<ServerUser *> qvDirect[32];
+	WhisperRecipients() : uiTargets(0) { }
+};
+
 class Server;
 
 class ServerUser : public Connection, public User {
@@ -105,18 +125,31 @@ class ServerUser : public Connection, public User {
 
 		bool bVerified;
 		QStringList qslEmail;
+		/// True if the TLS handshake resumed an earlier session.
+		bool sessionResumed() const;
+		/// Lets the kernel seal what is sent from now on. Returns false if
+		/// the session can't be handed over. See KernelTls.
+		bool enableKernelTls();
 
 		HostAddress haAddress;
 		bool bUdp;
+		/// The client names its session ahead of UDP datagrams until it hears
+		/// back, so Server::matchPeer() never has to find it by trial
+		/// decryption. Set along with the key, under qmCrypt.
+		bool bUdpHint;
 
 		QList<int> qlCodecs;
 		bool bOpus;
 
+		/// Set while an Authenticate message is being looked up by dbwWorker.
+		bool bAuthPending;
+
 		QStringList qslAccessTokens;
 
 		QMap<int, WhisperTarget> qmTargets;
-		typedef QPair<QSet<ServerUser *>, QSet<ServerUser *> > TargetCache;
-		QMap<int, TargetCache> qmTargetCache;
+		/// qmTargets as resolved for the voice threads, or NULL if there are none.
+		QAtomicPointer<WhisperRecipients> qapTargets;
+
 		QMap<QString, QString> qmWhisperRedirect;
 
 		int iLastPermissionCheck;
@@ -127,9 +160,30 @@ class ServerUser : public Connection, public User {
 		SOCKET sUdpSocket;
 #endif
 		BandwidthRecord bwr;
+		/// Serializes use of csCrypt between the voice threads.
+		QMutex qmCrypt;
+		/// Voice to tunnel over TCP, already framed as UDPTunnel messages. Appended
+		/// to by the voice threads and written out at once by Server::tcpTransmitData().
+		QByteArray qbaTunnel;
+		QMutex qmTunnel;
+		/// This user's UserState as sent to joining clients, framed, by
+		/// Server::JoinClass. Emptied whenever a UserState for the user is broadcast.
+		QByteArray qbaJoinState[3];
 		struct sockaddr_storage saiUdpAddress;
 		struct sockaddr_storage saiTcpLocalAddress;
+#ifdef Q_OS_LINUX
+		/// Addressing of UDP datagrams to this user, pointing at saiUdpAddress and
+		/// ucUdpControl (IP_PKTINFO). Built by Server when the UDP peer is associated.
+		struct msghdr mhUdp;
+		u_char ucUdpControl[CMSG_SPACE(sizeof(struct in6_pktinfo))];
+		bool bUdpHeader;
+#endif
+		/// Set with release semantics once sUdpSocket, saiUdpAddress and the
+		/// UDP header are filled in; the voice threads read them only after
+		/// loading it with acquire semantics, see udpReady() in Server.cpp.
+		QAtomicInt iUdpReady;
 		ServerUser(Server *parent, QSslSocket *socket);
+		~ServerUser();
 };
 
 #endif
@@ -0,0 +1,84 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "murmur_pch.h"
+
+#include "StatementCache.h"
+
+#define MAX_CACHED_STATEMENTS 256
+
+StatementCache::StatementCache() {
+}
+
+bool StatementCache::acquire(QSqlQuery &query, const QString &key) {
+	QHash<QString, CachedStatement>::iterator i = qhStatements.find(key);
+	// One in use is being bound or read by someone further up the stack.
+	if ((i == qhStatements.end()) || i.value().bInUse)
+		return false;
+
+	i.value().bInUse = true;
+	query = i.value().qsqQuery;
+	qhHeld.insert(query.result(), key);
+	return true;
+}
+
+void StatementCache::insert(const QString &key, const QSqlQuery &query) {
+	if ((qhStatements.count() >= MAX_CACHED_STATEMENTS) || qhStatements.contains(key))
+		return;
+
+	CachedStatement cs;
+	cs.qsqQuery = query;
+	cs.bInUse = true;
+	qhStatements.insert(key, cs);
+	qhHeld.insert(query.result(), key);
+}
+
+void StatementCache::release(QSqlQuery &query) {
+	query.finish();
+
+	QHash<const QSqlResult *, QString>::iterator i = qhHeld.find(query.result());
+	if (i == qhHeld.end())
+		return;
+
+	QHash<QString, CachedStatement>::iterator s = qhStatements.find(i.value());
+	if (s != qhStatements.end())
+		s.value().bInUse = false;
+	qhHeld.erase(i);
+}
+
+bool StatementCache::holds(const QSqlQuery &query) const {
+	return qhHeld.contains(query.result());
+}
+
+void StatementCache::clear() {
+	qhStatements.clear();
+	qhHeld.clear();
+}
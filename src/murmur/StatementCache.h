@@ -0,0 +1,71 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MUMBLE_MURMUR_STATEMENTCACHE_H_
+#define MUMBLE_MURMUR_STATEMENTCACHE_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtSql/QSqlQuery>
+
+class QSqlResult;
+
+/// Statements prepared by ServerDB::prepare(), keyed by their unformatted SQL.
+/// One per thread, and thus one per connection. A statement is only handed
+/// to one query at a time, so a nested caller preparing the same SQL gets a
+/// statement of its own instead of rebinding one that is yet to run.
+class StatementCache {
+	private:
+		Q_DISABLE_COPY(StatementCache)
+	protected:
+		/// A prepared statement, and whether a query holds it.
+		struct CachedStatement {
+			QSqlQuery qsqQuery;
+			bool bInUse;
+		};
+
+		QHash<QString, CachedStatement> qhStatements;
+		/// Keys of the statements in use, by the result their holder shares.
+		QHash<const QSqlResult *, QString> qhHeld;
+	public:
+		StatementCache();
+		/// Hands the statement for key to query, unless there is none or it is in use.
+		bool acquire(QSqlQuery &query, const QString &key);
+		/// Keeps query, freshly prepared from key, for later callers; query holds it.
+		void insert(const QString &key, const QSqlQuery &query);
+		/// Finishes query, and lets acquire() hand out the statement it held again.
+		void release(QSqlQuery &query);
+		/// Whether query holds a cached statement.
+		bool holds(const QSqlQuery &query) const;
+		void clear();
+};
+
+#endif
@@ -0,0 +1,199 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "murmur_pch.h"
+
+#include "TicketKeys.h"
+
+#ifdef USE_SSL_SESSION_TICKETS
+#include <QtCore/private/qobject_p.h>
+#include <QtNetwork/private/qsslsocket_openssl_p.h>
+#endif
+
+#define TICKET_KEY_SIZE 16
+
+int TicketKeys::iExIndex = -1;
+
+#ifdef USE_SSL_SESSION_TICKETS
+static SSL *sslHandle(QSslSocket *socket) {
+	QSslSocketBackendPrivate *d = static_cast<QSslSocketBackendPrivate *>(QObjectPrivate::get(socket));
+	return d ? d->ssl : NULL;
+}
+#endif
+
+TicketKeys::TicketKeys() {
+	uiLifetime = 0;
+#ifdef USE_SSL_SESSION_TICKETS
+	// Servers are created on the main thread, so this is never raced.
+	if (iExIndex < 0)
+		iExIndex = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+#endif
+}
+
+void TicketKeys::fromString(const QString &str) {
+	QWriteLocker wl(&qrwlKeys);
+
+	qlKeys.clear();
+	foreach(const QString &entry, str.split(QLatin1Char(','), QString::SkipEmptyParts)) {
+		const QStringList qsl = entry.split(QLatin1Char(':'));
+		if (qsl.count() != 2)
+			continue;
+
+		bool ok = false;
+		const quint32 created = qsl.at(0).toUInt(&ok);
+		const QByteArray qba = QByteArray::fromHex(qsl.at(1).toLatin1());
+		if (! ok || (qba.size() != 3 * TICKET_KEY_SIZE))
+			continue;
+
+		Key k;
+		k.qbaName = qba.left(TICKET_KEY_SIZE);
+		k.qbaHmac = qba.mid(TICKET_KEY_SIZE, TICKET_KEY_SIZE);
+		k.qbaAes = qba.right(TICKET_KEY_SIZE);
+		k.uiCreated = created;
+		qlKeys << k;
+	}
+}
+
+QString TicketKeys::toString() const {
+	QReadLocker rl(&qrwlKeys);
+
+	QStringList qsl;
+	foreach(const Key &k, qlKeys)
+		qsl << QString::fromLatin1("%1:%2").arg(k.uiCreated).arg(QString::fromLatin1((k.qbaName + k.qbaHmac + k.qbaAes).toHex()));
+	return qsl.join(QLatin1String(","));
+}
+
+bool TicketKeys::rotate(quint32 now, quint32 lifetime) {
+	QWriteLocker wl(&qrwlKeys);
+
+	bool changed = false;
+	uiLifetime = lifetime;
+
+	// A ticket is valid for lifetime after it was issued, and a key issues
+	// tickets for lifetime after it was created.
+	while (! qlKeys.isEmpty() && (now >= qlKeys.last().uiCreated) && (now - qlKeys.last().uiCreated >= 2 * lifetime)) {
+		qlKeys.removeLast();
+		changed = true;
+	}
+
+	if (lifetime && (qlKeys.isEmpty() || ((now >= qlKeys.first().uiCreated) && (now - qlKeys.first().uiCreated >= lifetime)))) {
+		unsigned char buffer[3 * TICKET_KEY_SIZE];
+		if (RAND_bytes(buffer, sizeof(buffer)) == 1) {
+			const QByteArray qba(reinterpret_cast<const char *>(buffer), sizeof(buffer));
+
+			Key k;
+			k.qbaName = qba.left(TICKET_KEY_SIZE);
+			k.qbaHmac = qba.mid(TICKET_KEY_SIZE, TICKET_KEY_SIZE);
+			k.qbaAes = qba.right(TICKET_KEY_SIZE);
+			k.uiCreated = now;
+			qlKeys.prepend(k);
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+void TicketKeys::install(QSslSocket *socket) {
+#ifdef USE_SSL_SESSION_TICKETS
+	long timeout;
+	{
+		QReadLocker rl(&qrwlKeys);
+		if (qlKeys.isEmpty())
+			return;
+		timeout = uiLifetime;
+	}
+
+	SSL *ssl = sslHandle(socket);
+	if (! ssl)
+		return;
+
+	// If the client's hello was already read, which Qt may do while
+	// starting encryption, this connection just doesn't get to resume.
+	SSL_CTX *ctx = SSL_get_SSL_CTX(ssl);
+	SSL_CTX_set_ex_data(ctx, iExIndex, this);
+	SSL_CTX_set_timeout(ctx, timeout);
+	SSL_CTX_set_tlsext_ticket_key_cb(ctx, &TicketKeys::ticketCallback);
+#else
+	Q_UNUSED(socket);
+#endif
+}
+
+bool TicketKeys::isResumed(QSslSocket *socket) {
+#ifdef USE_SSL_SESSION_TICKETS
+	SSL *ssl = sslHandle(socket);
+	return ssl && SSL_session_reused(ssl);
+#else
+	Q_UNUSED(socket);
+	return false;
+#endif
+}
+
+#ifdef USE_SSL_SESSION_TICKETS
+int TicketKeys::ticketCallback(SSL *ssl, unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *ectx, HMAC_CTX *hctx, int enc) {
+	TicketKeys *tk = static_cast<TicketKeys *>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), iExIndex));
+	if (! tk)
+		return enc ? -1 : 0;
+
+	QReadLocker rl(&tk->qrwlKeys);
+
+	if (enc) {
+		if (tk->qlKeys.isEmpty())
+			return -1;
+
+		const Key &k = tk->qlKeys.first();
+		if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_128_cbc())) != 1)
+			return -1;
+
+		memcpy(name, k.qbaName.constData(), TICKET_KEY_SIZE);
+		EVP_EncryptInit_ex(ectx, EVP_aes_128_cbc(), NULL, reinterpret_cast<const unsigned char *>(k.qbaAes.constData()), iv);
+		HMAC_Init_ex(hctx, k.qbaHmac.constData(), TICKET_KEY_SIZE, EVP_sha256(), NULL);
+		return 1;
+	}
+
+	const QByteArray qbaName(reinterpret_cast<const char *>(name), TICKET_KEY_SIZE);
+	for (int i=0;i<tk->qlKeys.count();++i) {
+		const Key &k = tk->qlKeys.at(i);
+		if (k.qbaName != qbaName)
+			continue;
+
+		HMAC_Init_ex(hctx, k.qbaHmac.constData(), TICKET_KEY_SIZE, EVP_sha256(), NULL);
+		EVP_DecryptInit_ex(ectx, EVP_aes_128_cbc(), NULL, reinterpret_cast<const unsigned char *>(k.qbaAes.constData()), iv);
+
+		// Tickets of an older key are accepted, but replaced.
+		return (i == 0) ? 1 : 2;
+	}
+
+	// Unknown key, so do a full handshake.
+	return 0;
+}
+#endif
@@ -0,0 +1,95 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MUMBLE_MURMUR_TICKETKEYS_H_
+#define MUMBLE_MURMUR_TICKETKEYS_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QReadWriteLock>
+#include <QtCore/QString>
+#ifdef USE_SSL_SESSION_TICKETS
+#include <openssl/ssl.h>
+#endif
+
+class QSslSocket;
+
+/// Keys for the TLS session tickets of one virtual server, so clients that
+/// reconnect can resume their session instead of doing a full handshake.
+///
+/// Qt gives every socket an OpenSSL context of its own, with ticket keys of
+/// its own, so by default no ticket is ever accepted again. install() hands
+/// these keys to the context of a socket instead. The newest key encrypts
+/// new tickets, older ones are kept to decrypt tickets issued before the
+/// last rotation. They are saved in the server's configuration, so tickets
+/// stay valid across restarts.
+///
+/// Reaching the OpenSSL handle of a QSslSocket takes Qt's private headers.
+/// Without them (USE_SSL_SESSION_TICKETS undefined) install() does nothing
+/// and no session is ever resumed.
+class TicketKeys {
+	private:
+		Q_DISABLE_COPY(TicketKeys)
+	protected:
+		struct Key {
+			QByteArray qbaName;
+			QByteArray qbaHmac;
+			QByteArray qbaAes;
+			quint32 uiCreated;
+		};
+
+		mutable QReadWriteLock qrwlKeys;
+		/// Newest first.
+		QList<Key> qlKeys;
+		quint32 uiLifetime;
+
+		static int iExIndex;
+#ifdef USE_SSL_SESSION_TICKETS
+		static int ticketCallback(SSL *ssl, unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *ectx, HMAC_CTX *hctx, int enc);
+#endif
+	public:
+		TicketKeys();
+		/// Restores keys saved with toString(). Invalid ones are skipped.
+		void fromString(const QString &str);
+		QString toString() const;
+		/// Starts a new key if the newest is older than lifetime seconds,
+		/// and drops keys that can no longer have valid tickets. Returns
+		/// true if the keys changed and should be saved.
+		bool rotate(quint32 now, quint32 lifetime);
+		/// Lets socket issue and accept tickets with these keys. Must be
+		/// called on the socket's thread right after it starts encryption.
+		void install(QSslSocket *socket);
+		/// True if the handshake of socket resumed an earlier session.
+		static bool isResumed(QSslSocket *socket);
+};
+
+#endif
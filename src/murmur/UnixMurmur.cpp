@@ -32,6 +32,7 @@
 
 #include "UnixMurmur.h"
 
+#include "LogWriter.h"
 #include "Meta.h"
 
 QMutex *LimitTest::qm;
@@ -199,6 +200,7 @@ void UnixMurmur::handleSigHup() {
 			delete newlog;
 			qCritical("Failed to reopen logfile for writing, keeping old log");
 		} else {
+			QMutexLocker qml(lwLog ? &lwLog->qmFile : NULL);
 			QFile *oldlog = qfLog;
 
 			newlog->setTextModeEnabled(true);
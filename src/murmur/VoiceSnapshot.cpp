@@ -0,0 +1,96 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "murmur_pch.h"
+
+#include "VoiceSnapshot.h"
+
+VoiceEpoch::VoiceEpoch() : iEpoch(1) {
+	for (int i=0;i<VOICE_EPOCH_READERS;++i)
+		bSlotUsed[i] = false;
+}
+
+VoiceEpoch::~VoiceEpoch() {
+	QList<QPair<int, boost::function<void ()> > > ql;
+	{
+		QMutexLocker qml(&qmRetired);
+		ql = qlRetired;
+		qlRetired.clear();
+	}
+	for (int i=0;i<ql.count();++i)
+		ql.at(i).second();
+}
+
+int VoiceEpoch::registerReader() {
+	QMutexLocker qml(&qmRetired);
+	for (int i=0;i<VOICE_EPOCH_READERS;++i) {
+		if (! bSlotUsed[i]) {
+			bSlotUsed[i] = true;
+			aiReader[i].fetchAndStoreOrdered(0);
+			return i;
+		}
+	}
+	qFatal("VoiceEpoch: Too many voice threads");
+	return -1;
+}
+
+void VoiceEpoch::unregisterReader(int slot) {
+	QMutexLocker qml(&qmRetired);
+	aiReader[slot].fetchAndStoreOrdered(0);
+	bSlotUsed[slot] = false;
+}
+
+void VoiceEpoch::retire(const boost::function<void ()> &f) {
+	QMutexLocker qml(&qmRetired);
+	// Readers entering after this point can only see what was published before the call.
+	qlRetired << QPair<int, boost::function<void ()> >(iEpoch.fetchAndAddOrdered(1), f);
+}
+
+void VoiceEpoch::reclaim() {
+	QList<boost::function<void ()> > qlRun;
+	{
+		QMutexLocker qml(&qmRetired);
+		if (qlRetired.isEmpty())
+			return;
+
+		int oldest = iEpoch.fetchAndAddOrdered(0);
+		for (int i=0;i<VOICE_EPOCH_READERS;++i) {
+			int e = aiReader[i].fetchAndAddOrdered(0);
+			if (e && (e < oldest))
+				oldest = e;
+		}
+
+		while (! qlRetired.isEmpty() && (qlRetired.first().first < oldest))
+			qlRun << qlRetired.takeFirst().second;
+	}
+	foreach(const boost::function<void ()> &f, qlRun)
+		f();
+}
@@ -0,0 +1,98 @@
+/* Copyright (C) 2005-2011, Thorvald Natvig <thorvald@natvig.com>
+   Copyright (C) 2009-2011, Stefan Hacker <dd0t@users.sourceforge.net>
+
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+   - Neither the name of the Mumble Developers nor the names of its
+     contributors may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MUMBLE_MURMUR_VOICESNAPSHOT_H_
+#define MUMBLE_MURMUR_VOICESNAPSHOT_H_
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
+#include <boost/function.hpp>
+
+#include "Net.h"
+
+class Channel;
+class ServerUser;
+class User;
+
+/// Immutable copy of the user tables, published by Server::publishUsers().
+/// The voice threads read it without taking qrwlUsers.
+struct VoiceSnapshot {
+	QHash<unsigned int, ServerUser *> qhUsers;
+	QHash<QPair<HostAddress, quint16>, ServerUser *> qhPeerUsers;
+	QHash<HostAddress, QSet<ServerUser *> > qhHostUsers;
+	/// Users of each channel who hear speech, i.e. aren't deafened.
+	QHash<const Channel *, QVector<ServerUser *> > qhListeners;
+	/// Listeners in linked channels each user may speak to, by session.
+	/// Only users in linked channels have an entry.
+	QHash<unsigned int, QVector<ServerUser *> > qhLinkedListeners;
+};
+
+#define VOICE_EPOCH_READERS 72
+
+/// Epoch based reclamation. Readers announce the epoch they entered in; objects
+/// retired in an epoch are destroyed once no reader is still inside it.
+class VoiceEpoch {
+	private:
+		Q_DISABLE_COPY(VoiceEpoch)
+	protected:
+		QAtomicInt iEpoch;
+		QAtomicInt aiReader[VOICE_EPOCH_READERS];
+		QMutex qmRetired;
+		bool bSlotUsed[VOICE_EPOCH_READERS];
+		QList<QPair<int, boost::function<void ()> > > qlRetired;
+	public:
+		VoiceEpoch();
+		~VoiceEpoch();
+
+		int registerReader();
+		void unregisterReader(int slot);
+
+		void enter(int slot) {
+			aiReader[slot].fetchAndStoreOrdered(iEpoch.fetchAndAddOrdered(0));
+		};
+		void leave(int slot) {
+			aiReader[slot].fetchAndStoreOrdered(0);
+		};
+
+		/// Queues f to run once all current readers have left.
+		void retire(const boost::function<void ()> &f);
+		/// Runs every retired function that no reader can still depend on.
+		/// Must only be called from the thread owning the retired objects.
+		void reclaim();
+};
+
+#endif
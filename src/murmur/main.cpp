@@ -37,6 +37,7 @@
 #include "Server.h"
 #include "ServerDB.h"
 #include "DBus.h"
+#include "LogWriter.h"
 #include "Meta.h"
 #include "Version.h"
 #include "SSL.h"
@@ -46,6 +47,7 @@
 #endif
 
 QFile *qfLog = NULL;
+LogWriter *lwLog = NULL;
 
 static bool bVerbose = false;
 #ifdef QT_NO_DEBUG
@@ -64,6 +66,16 @@ static LogEmitter le;
 
 static QStringList qlErrors;
 
+static void writeLogLine(const QString &m) {
+	if (lwLog && lwLog->post(-1, m))
+		return;
+
+	QMutexLocker qml(lwLog ? &lwLog->qmFile : NULL);
+	qfLog->write(m.toUtf8());
+	qfLog->write("\n");
+	qfLog->flush();
+}
+
 static void murmurMessageOutputQString(QtMsgType type, const QString &msg) {
 #ifdef Q_OS_UNIX
 	if (unixMurmur->logToSyslog) {
@@ -123,18 +135,16 @@ static void murmurMessageOutputQString(QtMsgType type, const QString &msg) {
 #endif
 	} else {
 		if (! qlErrors.isEmpty()) {
-			foreach(const QString &e, qlErrors) {
-				qfLog->write(e.toUtf8());
-				qfLog->write("\n");
-			}
+			foreach(const QString &e, qlErrors)
+				writeLogLine(e);
 			qlErrors.clear();
 		}
-		qfLog->write(m.toUtf8());
-		qfLog->write("\n");
-		qfLog->flush();
+		writeLogLine(m);
 	}
 	le.addLogEntry(m);
 	if (type == QtFatalMsg) {
+		if (lwLog)
+			lwLog->finish();
 #ifdef Q_OS_UNIX
 		if (detach) {
 			if (qlErrors.isEmpty())
@@ -469,6 +479,10 @@ int main(int argc, char **argv) {
 	unixhandler.finalcap();
 #endif
 
+	// Started only now, as threads don't survive the fork above.
+	lwLog = new LogWriter();
+	lwLog->start();
+
 #ifdef USE_DBUS
 	MurmurDBus::registerTypes();
 
@@ -530,6 +544,9 @@ int main(int argc, char **argv) {
 	IceStop();
 #endif
 
+	delete lwLog;
+	lwLog = NULL;
+
 	delete qfLog;
 	qfLog = NULL;
 
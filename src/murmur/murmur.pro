@@ -10,8 +10,8 @@ TARGET = murmur
 DBFILE  = murmur.db
 LANGUAGE	= C++
 FORMS =
-HEADERS *= Server.h ServerUser.h Meta.h PBKDF2.h
-SOURCES *= main.cpp Server.cpp ServerUser.cpp ServerDB.cpp Register.cpp Cert.cpp Messages.cpp Meta.cpp RPC.cpp PBKDF2.cpp
+HEADERS *= Server.h ChannelLoader.h ServerUser.h Meta.h PBKDF2.h VoiceSnapshot.h DBWorker.h LogWriter.h ACLProgram.h BanIndex.h AttemptTracker.h HashPool.h HandshakePool.h TicketKeys.h KernelTls.h StatementCache.h
+SOURCES *= main.cpp Server.cpp ChannelLoader.cpp ServerUser.cpp ServerDB.cpp Register.cpp Cert.cpp Messages.cpp Meta.cpp RPC.cpp PBKDF2.cpp VoiceSnapshot.cpp DBWorker.cpp LogWriter.cpp ACLProgram.cpp BanIndex.cpp AttemptTracker.cpp HashPool.cpp HandshakePool.cpp TicketKeys.cpp KernelTls.cpp StatementCache.cpp
 
 DIST = DBus.h ServerDB.h ../../icons/murmur.ico Murmur.ice MurmurI.h MurmurIceWrapper.cpp murmur.plist
 PRECOMPILED_HEADER = murmur_pch.h
@@ -184,4 +184,23 @@ bonjour {
 	}
 }
 
+# TLS session resumption needs the OpenSSL handle of a QSslSocket, which
+# only Qt's private headers give access to. Define USE_SSL_SESSION_TICKETS
+# if they are available.
+#
+# Can be disabled with no-ssl-session-tickets.
+!CONFIG(no-ssl-session-tickets):isEqual(QT_MAJOR_VERSION, 5):exists($$[QT_INSTALL_HEADERS]/QtNetwork/$$[QT_VERSION]/QtNetwork/private/qsslsocket_openssl_p.h) {
+	QT *= core-private network-private
+	DEFINES *= USE_SSL_SESSION_TICKETS
+}
+
+# Handing TLS records to the kernel needs the OpenSSL handle as well, and
+# the kTLS interface of Linux 4.13 or later. Define USE_KERNEL_TLS if both
+# are available.
+#
+# Can be disabled with no-kernel-tls.
+!CONFIG(no-kernel-tls):contains(DEFINES, USE_SSL_SESSION_TICKETS):contains(UNAME, Linux):exists(/usr/include/linux/tls.h) {
+	DEFINES *= USE_KERNEL_TLS
+}
+
 include(../../symbols.pri)
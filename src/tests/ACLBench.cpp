@@ -0,0 +1,173 @@
+/**
+ * Builds a 1,000 channel tree with the kind of ACLs and groups a large
+ * community server has, connects USERS users to it, and measures how long
+ * it takes to work out every user's permissions in every channel with an
+ * empty permission cache. Compares walking the ACLs and parsing group names
+ * on every miss with evaluating the compiled ACLs, both right after the
+ * ACLs changed (cold) and once they have been compiled (warm).
+ */
+
+#include "murmur_pch.h"
+
+#include "Timer.h"
+#include "ACL.h"
+#include "ACLProgram.h"
+#include "Channel.h"
+#include "Group.h"
+#include "ServerUser.h"
+
+#define CATEGORIES 9
+#define ROOMS 10
+#define SUBROOMS 10
+#define USERS 200
+#define ROUNDS 5
+
+static ChanACL *addACL(Channel *c, const QString &group, ChanACL::Permissions allow, ChanACL::Permissions deny, bool here = true, bool subs = true) {
+	ChanACL *acl = new ChanACL(c);
+	acl->qsGroup = group;
+	acl->pAllow = allow;
+	acl->pDeny = deny;
+	acl->bApplyHere = here;
+	acl->bApplySubs = subs;
+	return acl;
+}
+
+static void addGroup(Channel *c, const QString &name, int members, bool inherit = true) {
+	Group *g = new Group(c, name);
+	g->bInherit = inherit;
+	for (int i=0;i<members;++i)
+		g->qsAdd << (1 + qrand() % (USERS / 2));
+	g->qsRemove << (1 + qrand() % (USERS / 2));
+}
+
+static Channel *buildTree(QList<Channel *> &channels) {
+	int id = 0;
+	Channel *root = new Channel(id++, QLatin1String("Root"));
+	channels << root;
+
+	// What a fresh server starts out with.
+	addGroup(root, QLatin1String("admin"), 3);
+	addACL(root, QLatin1String("admin"), ChanACL::Write, ChanACL::None);
+	addACL(root, QLatin1String("auth"), ChanACL::MakeTempChannel, ChanACL::None);
+	addACL(root, QLatin1String("all"), ChanACL::SelfRegister, ChanACL::None, true, false);
+
+	for (int i=0;i<CATEGORIES;++i) {
+		Channel *cat = new Channel(id++, QString::fromLatin1("Category %1").arg(i));
+		root->addChannel(cat);
+		channels << cat;
+
+		addGroup(cat, QLatin1String("members"), 20);
+		addGroup(cat, QLatin1String("mods"), 4);
+		addACL(cat, QLatin1String("all"), ChanACL::None, ChanACL::Enter | ChanACL::Speak);
+		addACL(cat, QLatin1String("members"), ChanACL::Enter | ChanACL::Speak, ChanACL::None);
+		addACL(cat, QLatin1String("mods"), ChanACL::MuteDeafen | ChanACL::Move, ChanACL::None);
+		addACL(cat, QLatin1String("#event"), ChanACL::Enter, ChanACL::None);
+		if (i == 0)
+			addACL(cat, QLatin1String("!auth"), ChanACL::None, ChanACL::Traverse);
+
+		for (int j=0;j<ROOMS;++j) {
+			Channel *room = new Channel(id++, QString::fromLatin1("Room %1").arg(j));
+			cat->addChannel(room);
+			channels << room;
+
+			addACL(room, QLatin1String("~in"), ChanACL::TextMessage, ChanACL::None);
+			addACL(room, QLatin1String("~sub,0,1"), ChanACL::Whisper, ChanACL::None);
+			addACL(room, QLatin1String("!strong"), ChanACL::None, ChanACL::MakeTempChannel);
+			if (j == 0) {
+				room->bInheritACL = false;
+				addGroup(room, QLatin1String("mods"), 2, false);
+				addACL(room, QLatin1String("mods"), ChanACL::Enter | ChanACL::Speak | ChanACL::Move, ChanACL::None);
+				addACL(room, QLatin1String("all"), ChanACL::None, ChanACL::Enter);
+			}
+
+			for (int k=0;k<SUBROOMS;++k) {
+				Channel *sub = new Channel(id++, QString::fromLatin1("Sub %1").arg(k));
+				room->addChannel(sub);
+				channels << sub;
+
+				if (k == 0)
+					addACL(sub, QLatin1String("out"), ChanACL::None, ChanACL::Whisper);
+				if (k == 1)
+					addACL(sub, QLatin1String("#staff"), ChanACL::Enter, ChanACL::None);
+			}
+		}
+	}
+
+	return root;
+}
+
+static void clearCache(ChanACL::ACLCache &cache) {
+	foreach(ChanACL::ChanCache *h, cache)
+		delete h;
+	cache.clear();
+}
+
+static quint64 run(QList<ServerUser *> &users, QList<Channel *> &channels, ChanACL::ACLCache &cache, bool cold, QVector<unsigned int> &results) {
+	quint64 elapsed = 0;
+
+	for (int r=0;r<ROUNDS;++r) {
+		clearCache(cache);
+		if (cold && cache.apProgram)
+			cache.apProgram->clear();
+
+		int i = 0;
+		Timer t;
+		foreach(ServerUser *u, users)
+			foreach(Channel *c, channels)
+				results[i++] = ChanACL::effectivePermissions(u, c, &cache);
+		elapsed += t.elapsed();
+	}
+
+	return elapsed;
+}
+
+int main(int argc, char **argv) {
+	QCoreApplication a(argc, argv);
+
+	qsrand(1);
+
+	QList<Channel *> channels;
+	Channel *root = buildTree(channels);
+
+	QList<ServerUser *> users;
+	for (int i=0;i<USERS;++i) {
+		ServerUser *u = new ServerUser(NULL, new QSslSocket());
+		u->uiSession = i + 1;
+		u->iId = (i < USERS * 3 / 4) ? i + 1 : -1;
+		u->bVerified = (qrand() % 4) != 0;
+		if (qrand() % 10 == 0)
+			u->qslAccessTokens << QLatin1String("Event");
+		if (qrand() % 20 == 0)
+			u->qslAccessTokens << QLatin1String("staff");
+		channels.at(qrand() % channels.count())->addUser(u);
+		users << u;
+	}
+
+	const int checks = users.count() * channels.count();
+	QVector<unsigned int> walked(checks), cold(checks), warm(checks);
+
+	ChanACL::ACLCache cache;
+	quint64 usWalk = run(users, channels, cache, false, walked);
+
+	cache.apProgram = new ACLProgram();
+	quint64 usCold = run(users, channels, cache, true, cold);
+	quint64 usWarm = run(users, channels, cache, false, warm);
+
+	int mismatch = 0;
+	for (int i=0;i<checks;++i)
+		if ((walked.at(i) != cold.at(i)) || (walked.at(i) != warm.at(i)))
+			++mismatch;
+
+	qWarning("%d channels, %d users, %d checks per round", channels.count(), users.count(), checks);
+	qWarning("walk     %8.1f ns/check", static_cast<double>(usWalk) * 1000.0 / (ROUNDS * checks));
+	qWarning("cold     %8.1f ns/check", static_cast<double>(usCold) * 1000.0 / (ROUNDS * checks));
+	qWarning("warm     %8.1f ns/check", static_cast<double>(usWarm) * 1000.0 / (ROUNDS * checks));
+	qWarning("%d mismatches", mismatch);
+
+	clearCache(cache);
+	delete cache.apProgram;
+	qDeleteAll(users);
+	delete root;
+
+	return mismatch ? 1 : 0;
+}
@@ -0,0 +1,14 @@
+include(../mumble.pri)
+
+TEMPLATE = app
+CONFIG += qt thread warn_on release
+CONFIG -= app_bundle
+QT *= network
+QT -= gui
+LANGUAGE = C++
+TARGET = ACLBench
+DEFINES *= MURMUR
+HEADERS *= ServerUser.h ACLProgram.h
+SOURCES *= ACLBench.cpp ServerUser.cpp ACLProgram.cpp
+VPATH += ../murmur
+INCLUDEPATH += ../murmur
@@ -0,0 +1,191 @@
+/**
+ * Loads BANS address bans of the kind an imported blocklist has into a
+ * BanIndex and checks LOOKUPS connecting addresses against them, comparing
+ * with matching each ban in turn the way Server::newClient() used to. Then
+ * simulates a connection flood from FLOOD_HOSTS addresses, a few of which
+ * connect far more often than the rest, and measures AttemptTracker against
+ * the per-address list of attempt times Meta::banCheck() used to keep.
+ */
+
+#include "murmur_pch.h"
+
+#include "AttemptTracker.h"
+#include "BanIndex.h"
+#include "Net.h"
+#include "Timer.h"
+
+#define BANS 100000
+#define LOOKUPS 200000
+#define LINEAR_LOOKUPS 2000
+#define FLOOD_HOSTS 100000
+#define FLOOD_ATTEMPTS 2000000
+#define FLOODERS 16
+
+#define BAN_TRIES 10
+#define BAN_TIMEFRAME 120ULL
+#define BAN_TIME 300ULL
+
+static HostAddress randomV4() {
+	HostAddress ha;
+	ha.shorts[5] = 0xffff;
+	ha.hash[3] = (static_cast<quint32>(qrand()) << 16) ^ static_cast<quint32>(qrand());
+	return ha;
+}
+
+static HostAddress randomV6() {
+	HostAddress ha;
+	for (int i=0;i<8;++i)
+		ha.shorts[i] = static_cast<quint16>(qrand());
+	ha.shorts[0] = htons(0x2000 | (ha.shorts[0] & 0x0fff));
+	return ha;
+}
+
+static QList<Ban> makeBans(quint64 now) {
+	QList<Ban> bans;
+	const QDateTime start = QDateTime::fromTime_t(static_cast<uint>(now - 3600)).toUTC();
+
+	for (int i=0;i<BANS;++i) {
+		Ban ban;
+		const int kind = qrand() % 100;
+		if (kind < 85) {
+			ban.haAddress = randomV4();
+			ban.iMask = 128;
+		} else if (kind < 95) {
+			ban.haAddress = randomV4();
+			ban.iMask = 120;
+		} else if (kind < 97) {
+			ban.haAddress = randomV4();
+			ban.iMask = 112;
+		} else {
+			ban.haAddress = randomV6();
+			ban.iMask = (qrand() % 2) ? 64 : 48;
+		}
+		ban.qdtStart = start;
+		// Some temporary bans, a few of them already expired.
+		ban.iDuration = (qrand() % 10 == 0) ? 1800 + (qrand() % 2) * 3600 : 0;
+		bans << ban;
+	}
+	return bans;
+}
+
+static bool linearMatch(const QList<Ban> &bans, const HostAddress &ha) {
+	foreach(const Ban &ban, bans) {
+		if (! ban.isExpired() && ban.haAddress.match(ha, ban.iMask))
+			return true;
+	}
+	return false;
+}
+
+static int benchBans() {
+	const quint64 now = BanIndex::now();
+	QList<Ban> bans = makeBans(now);
+
+	// Half of the lookups come from inside a banned prefix.
+	QVector<HostAddress> lookups;
+	for (int i=0;i<LOOKUPS;++i) {
+		if (i % 2) {
+			HostAddress ha = bans.at(qrand() % bans.count()).haAddress;
+			ha.shorts[7] ^= static_cast<quint16>(qrand() & 0x0100);
+			lookups << ha;
+		} else {
+			lookups << ((qrand() % 10) ? randomV4() : randomV6());
+		}
+	}
+
+	Timer t;
+	BanIndex bi;
+	bi.rebuild(bans);
+	const quint64 usBuild = t.elapsed();
+
+	t.restart();
+	int hits = 0;
+	foreach(const HostAddress &ha, lookups)
+		if (bi.match(ha, now))
+			++hits;
+	const quint64 usIndex = t.elapsed();
+
+	t.restart();
+	int mismatch = 0;
+	for (int i=0;i<LINEAR_LOOKUPS;++i)
+		if (linearMatch(bans, lookups.at(i)) != bi.match(lookups.at(i), now))
+			++mismatch;
+	const quint64 usLinear = t.elapsed();
+
+	qWarning("%d bans, %d prefixes, built in %.1f ms", bans.count(), bi.count(), static_cast<double>(usBuild) / 1000.0);
+	qWarning("trie     %10.1f ns/lookup (%d of %d banned)", static_cast<double>(usIndex) * 1000.0 / LOOKUPS, hits, LOOKUPS);
+	qWarning("linear   %10.1f ns/lookup", static_cast<double>(usLinear) * 1000.0 / LINEAR_LOOKUPS);
+	qWarning("%d mismatches", mismatch);
+
+	return mismatch;
+}
+
+static bool listCheck(QHash<HostAddress, QList<quint64> > &attempts, QHash<HostAddress, quint64> &banned, const HostAddress &ha, quint64 now) {
+	if (banned.contains(ha)) {
+		if (now - banned.value(ha) < BAN_TIME * 1000000ULL)
+			return true;
+		banned.remove(ha);
+	}
+
+	QList<quint64> &ql = attempts[ha];
+	ql.append(now);
+	while (! ql.isEmpty() && (now - ql.at(0) > BAN_TIMEFRAME * 1000000ULL))
+		ql.removeFirst();
+
+	if (ql.count() > BAN_TRIES) {
+		banned.insert(ha, now);
+		return true;
+	}
+	return false;
+}
+
+static int benchFlood() {
+	QVector<HostAddress> hosts;
+	for (int i=0;i<FLOOD_HOSTS;++i)
+		hosts << randomV4();
+
+	// Every FLOODERS-th attempt comes from one of a few hosts, the rest are
+	// spread over everyone, over ten minutes.
+	QVector<int> sources(FLOOD_ATTEMPTS);
+	for (int i=0;i<FLOOD_ATTEMPTS;++i)
+		sources[i] = (i % FLOODERS) ? (qrand() % FLOOD_HOSTS) : (i / FLOODERS) % FLOODERS;
+	const quint64 step = 600ULL * 1000000ULL / FLOOD_ATTEMPTS;
+
+	Timer t;
+	AttemptTracker at;
+	int trackerBans = 0;
+	QSet<int> trackerFlooders;
+	for (int i=0;i<FLOOD_ATTEMPTS;++i) {
+		if (at.attempt(hosts.at(sources.at(i)), 1 + i * step, BAN_TRIES, BAN_TIMEFRAME * 1000000ULL, BAN_TIME * 1000000ULL)) {
+			++trackerBans;
+			if (sources.at(i) < FLOODERS)
+				trackerFlooders.insert(sources.at(i));
+		}
+	}
+	const quint64 usTracker = t.elapsed();
+
+	t.restart();
+	QHash<HostAddress, QList<quint64> > attempts;
+	QHash<HostAddress, quint64> banned;
+	int listBans = 0;
+	for (int i=0;i<FLOOD_ATTEMPTS;++i)
+		if (listCheck(attempts, banned, hosts.at(sources.at(i)), 1 + i * step))
+			++listBans;
+	const quint64 usList = t.elapsed();
+
+	qWarning("%d attempts from %d hosts", FLOOD_ATTEMPTS, FLOOD_HOSTS);
+	qWarning("tracker  %10.1f ns/attempt, %d slots, %d refused, %d of %d flooders banned", static_cast<double>(usTracker) * 1000.0 / FLOOD_ATTEMPTS, ATTEMPT_SLOTS, trackerBans, trackerFlooders.count(), FLOODERS);
+	qWarning("lists    %10.1f ns/attempt, %d addresses kept, %d refused", static_cast<double>(usList) * 1000.0 / FLOOD_ATTEMPTS, attempts.count(), listBans);
+
+	return (trackerFlooders.count() == FLOODERS) ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+	QCoreApplication a(argc, argv);
+
+	qsrand(1);
+
+	int failed = benchBans();
+	failed += benchFlood();
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,14 @@
+include(../mumble.pri)
+
+TEMPLATE = app
+CONFIG += qt thread warn_on release
+CONFIG -= app_bundle
+QT *= network
+QT -= gui
+LANGUAGE = C++
+TARGET = BanBench
+DEFINES *= MURMUR
+HEADERS *= BanIndex.h AttemptTracker.h
+SOURCES *= BanBench.cpp BanIndex.cpp AttemptTracker.cpp
+VPATH += ../murmur
+INCLUDEPATH += ../murmur
@@ -1,6 +1,17 @@
 /**
  * Provided a target address spawns a specified number of senders/speakers,
  * UDP-listeners and TCP-listeners.
+ *
+ * In login mode it instead keeps a number of connections busy logging in
+ * to a registered account with a password, reconnecting as soon as each
+ * attempt is answered. Alongside, a single probe keeps logging in without a
+ * password to show how long the server takes to answer everybody else.
+ * The server's autoban has to be turned off (autobanAttempts=0) for this.
+ *
+ * Handshake mode does the same, but hangs up as soon as the TLS handshake is
+ * done, to measure how many handshakes the server manages per second. With
+ * "resume" each connection offers the session of its previous one, and the
+ * server's log reports how many of them it resumed.
  */
 
 #include <QtCore>
@@ -373,13 +384,238 @@ void Container::go() {
 	tickGo.restart();
 }
 
+class LoginClient : public QObject {
+		Q_OBJECT
+	public:
+		QHostAddress qha;
+		unsigned short port;
+		QString qsName, qsPassword;
+		bool bHandshakeOnly;
+		bool bResume;
+		QByteArray qbaSession;
+		QSslSocket *ssl;
+		QByteArray qbaBuffer;
+		Timer tAttempt;
+		int iAccepted, iWrong, iBusy, iOther;
+		quint64 uiLatency;
+		int iAnswered;
+		LoginClient(QObject *parent, QHostAddress srvaddr, unsigned short prt, const QString &name, const QString &password, bool handshake = false);
+		void sendMessage(const ::google::protobuf::Message &msg, unsigned int msgType);
+		void answered();
+	public slots:
+		void attempt();
+		void encrypted();
+		void readyRead();
+};
+
+LoginClient::LoginClient(QObject *p, QHostAddress srvaddr, unsigned short prt, const QString &name, const QString &password, bool handshake) : QObject(p) {
+	qha = srvaddr;
+	port = prt;
+	qsName = name;
+	qsPassword = password;
+	bHandshakeOnly = handshake;
+	bResume = false;
+	iAccepted = iWrong = iBusy = iOther = 0;
+	iAnswered = 0;
+	uiLatency = 0;
+	ssl = NULL;
+}
+
+void LoginClient::attempt() {
+	if (ssl)
+		ssl->deleteLater();
+
+	qbaBuffer.clear();
+	tAttempt.restart();
+
+	ssl = new QSslSocket(this);
+	connect(ssl, SIGNAL(encrypted()), this, SLOT(encrypted()));
+	connect(ssl, SIGNAL(readyRead()), this, SLOT(readyRead()));
+	// Also raised when the server hangs up, so this covers every way an
+	// attempt can end without an answer.
+	connect(ssl, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(attempt()), Qt::QueuedConnection);
+	ssl->ignoreSslErrors();
+
+#if QT_VERSION >= 0x050200
+	if (bResume) {
+		QSslConfiguration cfg = ssl->sslConfiguration();
+		cfg.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+		if (! qbaSession.isEmpty())
+			cfg.setSessionTicket(qbaSession);
+		ssl->setSslConfiguration(cfg);
+	}
+#endif
+
+	ssl->connectToHostEncrypted(qha.toString(), port);
+}
+
+void LoginClient::sendMessage(const ::google::protobuf::Message &msg, unsigned int msgType) {
+	unsigned char uc[4096];
+	int len = msg.ByteSize();
+	Q_ASSERT(len < 4090);
+
+	* reinterpret_cast<quint16 *>(& uc[0]) = qToBigEndian(static_cast<quint16>(msgType));
+	* reinterpret_cast<quint32 *>(& uc[2]) = qToBigEndian(static_cast<quint32>(len));
+
+	msg.SerializeToArray(uc + 6, len);
+
+	ssl->write(reinterpret_cast<const char *>(uc), len + 6);
+}
+
+void LoginClient::encrypted() {
+#if QT_VERSION >= 0x050200
+	if (bResume)
+		qbaSession = ssl->sslConfiguration().sessionTicket();
+#endif
+
+	if (bHandshakeOnly) {
+		iAccepted++;
+		answered();
+		return;
+	}
+
+	MumbleProto::Version mpv;
+	mpv.set_release(u8(QLatin1String("1.2.1 Benchmark")));
+	mpv.set_version(0x010203);
+	sendMessage(mpv, MessageHandler::Version);
+
+	MumbleProto::Authenticate mpa;
+	mpa.set_username(u8(qsName));
+	if (! qsPassword.isEmpty())
+		mpa.set_password(u8(qsPassword));
+	sendMessage(mpa, MessageHandler::Authenticate);
+
+	tAttempt.restart();
+}
+
+void LoginClient::answered() {
+	uiLatency += tAttempt.elapsed();
+	iAnswered++;
+
+	ssl->disconnect(this);
+	ssl->abort();
+	QMetaObject::invokeMethod(this, "attempt", Qt::QueuedConnection);
+}
+
+void LoginClient::readyRead() {
+	qbaBuffer.append(ssl->readAll());
+
+	while (qbaBuffer.size() >= 6) {
+		const unsigned char *b = reinterpret_cast<const unsigned char *>(qbaBuffer.constData());
+		int type = qFromBigEndian(* reinterpret_cast<const quint16 *>(& b[0]));
+		int len = qFromBigEndian(* reinterpret_cast<const quint32 *>(& b[2]));
+		if (qbaBuffer.size() < len + 6)
+			return;
+
+		if (type == MessageHandler::Reject) {
+			MumbleProto::Reject msg;
+			msg.ParseFromArray(b + 6, len);
+			if (msg.type() == MumbleProto::Reject_RejectType_WrongUserPW)
+				iWrong++;
+			else if (msg.type() == MumbleProto::Reject_RejectType_AuthenticatorFail)
+				iBusy++;
+			else
+				iOther++;
+			answered();
+			return;
+		} else if (type == MessageHandler::ServerSync) {
+			iAccepted++;
+			answered();
+			return;
+		}
+		qbaBuffer.remove(0, len + 6);
+	}
+}
+
+class LoginStorm : public QObject {
+		Q_OBJECT
+	public:
+		QList<LoginClient *> clients;
+		LoginClient *probe;
+		bool bHandshakeOnly;
+		QTimer qtReport;
+		Timer tReport;
+		LoginStorm(QHostAddress srvaddr, unsigned short port, int num, const QString &name, const QString &password, bool handshake = false, bool resume = false);
+	public slots:
+		void report();
+};
+
+LoginStorm::LoginStorm(QHostAddress qha, unsigned short port, int num, const QString &name, const QString &password, bool handshake, bool resume) {
+	bHandshakeOnly = handshake;
+
+	if (handshake)
+		qWarning("Handshaking on %d connections", num);
+	else
+		qWarning("Logging in as %s on %d connections", qPrintable(name), num);
+
+	for (int i=0;i<num;++i) {
+		LoginClient *c = new LoginClient(this, qha, port, name, password, handshake);
+		c->bResume = resume;
+		clients << c;
+	}
+	probe = new LoginClient(this, qha, port, QString::fromLatin1("probe%1").arg(qrand()), QString());
+
+	foreach(LoginClient *c, clients)
+		c->attempt();
+	probe->attempt();
+
+	connect(&qtReport, SIGNAL(timeout()), this, SLOT(report()));
+	qtReport.start(5000);
+}
+
+void LoginStorm::report() {
+	int accepted = 0, wrong = 0, busy = 0, other = 0, answered = 0;
+	quint64 latency = 0;
+
+	foreach(LoginClient *c, clients) {
+		accepted += c->iAccepted;
+		wrong += c->iWrong;
+		busy += c->iBusy;
+		other += c->iOther;
+		answered += c->iAnswered;
+		latency += c->uiLatency;
+		c->iAccepted = c->iWrong = c->iBusy = c->iOther = c->iAnswered = 0;
+		c->uiLatency = 0;
+	}
+
+	const double secs = tReport.restart() / 1000000.0;
+
+	if (bHandshakeOnly) {
+		qWarning("Handshakes: %7.1f/s  Latency: %8.2f ms  Probe: %8.2f ms",
+		         accepted / secs,
+		         answered ? (latency / 1000.0) / answered : 0.0,
+		         probe->iAnswered ? (probe->uiLatency / 1000.0) / probe->iAnswered : 0.0);
+	} else {
+		qWarning("Logins: %7.1f/s  Accepted: %6d  Wrong: %6d  Busy: %6d  Other: %6d  Latency: %8.2f ms  Probe: %8.2f ms",
+		         answered / secs, accepted, wrong, busy, other,
+		         answered ? (latency / 1000.0) / answered : 0.0,
+		         probe->iAnswered ? (probe->uiLatency / 1000.0) / probe->iAnswered : 0.0);
+	}
+
+	probe->iAnswered = 0;
+	probe->uiLatency = 0;
+}
+
 int main(int argc, char **argv) {
 	QCoreApplication a(argc, argv);
 
 	qWarning("Maximum # sockets is %d", FD_SETSIZE);
 
+	if (((argc == 5) || (argc == 6)) && (qstrcmp(argv[3], "handshake") == 0)) {
+		const bool resume = (argc == 6) && (qstrcmp(argv[5], "resume") == 0);
+		LoginStorm ls(QHostAddress(argv[1]), atoi(argv[2]), atoi(argv[4]), QString(), QString(), true, resume);
+		return a.exec();
+	}
+
+	if ((argc == 7) && (qstrcmp(argv[3], "login") == 0)) {
+		LoginStorm ls(QHostAddress(argv[1]), atoi(argv[2]), atoi(argv[4]), QString::fromLocal8Bit(argv[5]), QString::fromLocal8Bit(argv[6]));
+		return a.exec();
+	}
+
 	if (argc != 6)
-		qFatal("Invalid number of arguments. These need to be passed: <host address> <port> <numsend> <numudp> <numtcp>");
+		qFatal("Invalid number of arguments. These need to be passed: <host address> <port> <numsend> <numudp> <numtcp>\n"
+		       "or, to flood the server with password logins: <host address> <port> login <numconnections> <username> <password>\n"
+		       "or, to measure the handshake rate: <host address> <port> handshake <numconnections> [resume]");
 
 	QHostAddress qha = QHostAddress(argv[1]);
 	int port = atoi(argv[2]);
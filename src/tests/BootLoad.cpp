@@ -0,0 +1,399 @@
+/**
+ * Generates the channel tree of a large virtual server (CHANNELS channels
+ * with their descriptions, positions, groups, group members, ACLs and links)
+ * in an SQLite database and reads it back twice: with a query per parent
+ * channel and several per channel, as Server::readChannels() and
+ * readChannelPrivs() used to, and with ChannelLoader, which
+ * Server::readChannels() and readLinks() use now.
+ *
+ * Compares the two trees and fails if they differ in any way the server
+ * relies on. Takes an optional round trip time in milliseconds, to estimate
+ * the boot time against a database on another host.
+ */
+
+#include <QtCore>
+#include <QtSql>
+
+#include "ACL.h"
+#include "Channel.h"
+#include "ChannelLoader.h"
+#include "Group.h"
+#include "Timer.h"
+
+#define CHANNELS 3000
+#define FANOUT 8
+#define GROUPS 2
+#define MEMBERS 5
+#define ACLS 3
+#define LINKS 200
+#define USERS 1000
+
+static const QString prefix = QLatin1String("murmur_");
+
+static int iQueries;
+
+static void exec(QSqlQuery &query) {
+	++iQueries;
+	if (! query.exec())
+		qFatal("%s", qPrintable(query.lastError().text()));
+}
+
+static void prepare(QSqlQuery &query, const char *sql) {
+	query.prepare(QString::fromLatin1(sql).arg(prefix));
+}
+
+static void generate(QSqlDatabase &db) {
+	QSqlQuery query(db);
+	query.exec(QString::fromLatin1("CREATE TABLE `%1channels` (`server_id` INTEGER NOT NULL, `channel_id` INTEGER NOT NULL, `parent_id` INTEGER, `name` TEXT, `inheritacl` INTEGER)").arg(prefix));
+	query.exec(QString::fromLatin1("CREATE UNIQUE INDEX `%1channel_id` ON `%1channels`(`server_id`, `channel_id`)").arg(prefix));
+	query.exec(QString::fromLatin1("CREATE TABLE `%1channel_info` (`server_id` INTEGER NOT NULL, `channel_id` INTEGER NOT NULL, `key` INTEGER, `value` TEXT)").arg(prefix));
+	query.exec(QString::fromLatin1("CREATE UNIQUE INDEX `%1channel_info_id` ON `%1channel_info`(`server_id`, `channel_id`, `key`)").arg(prefix));
+	query.exec(QString::fromLatin1("CREATE TABLE `%1groups` (`group_id` INTEGER PRIMARY KEY AUTOINCREMENT, `server_id` INTEGER NOT NULL, `name` TEXT, `channel_id` INTEGER NOT NULL, `inherit` INTEGER, `inheritable` INTEGER)").arg(prefix));
+	query.exec(QString::fromLatin1("CREATE UNIQUE INDEX `%1groups_name_channels` ON `%1groups`(`server_id`, `channel_id`, `name`)").arg(prefix));
+	query.exec(QString::fromLatin1("CREATE TABLE `%1group_members` (`group_id` INTEGER NOT NULL, `server_id` INTEGER NOT NULL, `user_id` INTEGER NOT NULL, `addit` INTEGER)").arg(prefix));
+	query.exec(QString::fromLatin1("CREATE TABLE `%1acl` (`server_id` INTEGER NOT NULL, `channel_id` INTEGER NOT NULL, `priority` INTEGER, `user_id` INTEGER, `group_name` TEXT, `apply_here` INTEGER, `apply_sub` INTEGER, `grantpriv` INTEGER, `revokepriv` INTEGER)").arg(prefix));
+	query.exec(QString::fromLatin1("CREATE UNIQUE INDEX `%1acl_channel_pri` ON `%1acl`(`server_id`, `channel_id`, `priority`)").arg(prefix));
+	query.exec(QString::fromLatin1("CREATE TABLE `%1channel_links` (`server_id` INTEGER NOT NULL, `channel_id` INTEGER NOT NULL, `link_id` INTEGER NOT NULL)").arg(prefix));
+
+	db.transaction();
+	for (int i=0;i<CHANNELS;++i) {
+		prepare(query, "INSERT INTO `%1channels` (`server_id`, `channel_id`, `parent_id`, `name`, `inheritacl`) VALUES (1,?,?,?,1)");
+		query.addBindValue(i);
+		query.addBindValue(i ? QVariant((i - 1) / FANOUT) : QVariant());
+		query.addBindValue(QString::fromLatin1("Channel %1").arg(i));
+		query.exec();
+
+		prepare(query, "INSERT INTO `%1channel_info` (`server_id`, `channel_id`, `key`, `value`) VALUES (1,?,0,?)");
+		query.addBindValue(i);
+		query.addBindValue(QString::fromLatin1("Description of channel %1").arg(i));
+		query.exec();
+
+		prepare(query, "INSERT INTO `%1channel_info` (`server_id`, `channel_id`, `key`, `value`) VALUES (1,?,1,?)");
+		query.addBindValue(i);
+		query.addBindValue(QString::number(i % FANOUT));
+		query.exec();
+
+		for (int g=0;g<GROUPS;++g) {
+			prepare(query, "INSERT INTO `%1groups` (`server_id`, `name`, `channel_id`, `inherit`, `inheritable`) VALUES (1,?,?,?,1)");
+			query.addBindValue(QString::fromLatin1("group%1").arg(g));
+			query.addBindValue(i);
+			query.addBindValue(g ? 0 : 1);
+			query.exec();
+			const int gid = query.lastInsertId().toInt();
+			for (int m=0;m<MEMBERS;++m) {
+				prepare(query, "INSERT INTO `%1group_members` (`group_id`, `server_id`, `user_id`, `addit`) VALUES (?,1,?,?)");
+				query.addBindValue(gid);
+				query.addBindValue((i * MEMBERS + m) % USERS);
+				query.addBindValue(m ? 1 : 0);
+				query.exec();
+			}
+		}
+
+		for (int a=0;a<ACLS;++a) {
+			prepare(query, "INSERT INTO `%1acl` (`server_id`, `channel_id`, `priority`, `user_id`, `group_name`, `apply_here`, `apply_sub`, `grantpriv`, `revokepriv`) VALUES (1,?,?,?,?,1,?,?,?)");
+			query.addBindValue(i);
+			// Inserted out of priority order, so reading them back has to sort.
+			query.addBindValue(ACLS - a + 5);
+			if (a) {
+				query.addBindValue(QVariant());
+				query.addBindValue(QString::fromLatin1("group%1").arg(a % GROUPS));
+			} else {
+				query.addBindValue(i % USERS);
+				query.addBindValue(QVariant());
+			}
+			query.addBindValue(a % 2);
+			query.addBindValue(1 << a);
+			query.addBindValue(a ? 0 : 2);
+			query.exec();
+		}
+	}
+	for (int i=1;i<=LINKS;++i) {
+		prepare(query, "INSERT INTO `%1channel_links` (`server_id`, `channel_id`, `link_id`) VALUES (1,?,?)");
+		query.addBindValue(i);
+		query.addBindValue(CHANNELS - i);
+		query.exec();
+	}
+	db.commit();
+}
+
+static void readPrivs(QSqlDatabase &db, Channel *c) {
+	QSqlQuery query(db);
+
+	prepare(query, "SELECT `key`, `value` FROM `%1channel_info` WHERE `server_id` = ? AND `channel_id` = ?");
+	query.addBindValue(1);
+	query.addBindValue(c->iId);
+	exec(query);
+	while (query.next()) {
+		int key = query.value(0).toInt();
+		const QString &value = query.value(1).toString();
+		if (key == 0)
+			c->qsDesc = value;
+		else if (key == 1)
+			c->iPosition = QVariant(value).toInt();
+	}
+
+	prepare(query, "SELECT `group_id`, `name`, `inherit`, `inheritable` FROM `%1groups` WHERE `server_id` = ? AND `channel_id` = ?");
+	query.addBindValue(1);
+	query.addBindValue(c->iId);
+	exec(query);
+	while (query.next()) {
+		Group *g = new Group(c, query.value(1).toString());
+		g->bInherit = query.value(2).toBool();
+		g->bInheritable = query.value(3).toBool();
+
+		QSqlQuery mem(db);
+		prepare(mem, "SELECT user_id, addit FROM %1group_members WHERE group_id = ?");
+		mem.addBindValue(query.value(0).toInt());
+		exec(mem);
+		while (mem.next()) {
+			int uid = mem.value(0).toInt();
+			if (mem.value(1).toBool())
+				g->qsAdd << uid;
+			else
+				g->qsRemove << uid;
+		}
+	}
+
+	prepare(query, "SELECT `user_id`, `group_name`, `apply_here`, `apply_sub`, `grantpriv`, `revokepriv` FROM `%1acl` WHERE `server_id` = ? AND `channel_id` = ? ORDER BY `priority`");
+	query.addBindValue(1);
+	query.addBindValue(c->iId);
+	exec(query);
+	while (query.next()) {
+		ChanACL *acl = new ChanACL(c);
+		acl->iUserId = query.value(0).isNull() ? -1 : query.value(0).toInt();
+		acl->qsGroup = query.value(1).toString();
+		acl->bApplyHere = query.value(2).toBool();
+		acl->bApplySubs = query.value(3).toBool();
+		acl->pAllow = static_cast<ChanACL::Permissions>(query.value(4).toInt());
+		acl->pDeny = static_cast<ChanACL::Permissions>(query.value(5).toInt());
+	}
+}
+
+static void readPerParent(QSqlDatabase &db, Channel *p, QObject *root, QHash<int, Channel *> &channels) {
+	QList<Channel *> kids;
+	if (p)
+		readPrivs(db, p);
+
+	QSqlQuery query(db);
+	if (! p) {
+		prepare(query, "SELECT `channel_id`, `name`, `inheritacl` FROM `%1channels` WHERE `server_id` = ? AND `parent_id` IS NULL ORDER BY `name`");
+		query.addBindValue(1);
+	} else {
+		prepare(query, "SELECT `channel_id`, `name`, `inheritacl` FROM `%1channels` WHERE `server_id` = ? AND `parent_id`=? ORDER BY `name`");
+		query.addBindValue(1);
+		query.addBindValue(p->iId);
+	}
+	exec(query);
+	while (query.next()) {
+		Channel *c = new Channel(query.value(0).toInt(), query.value(1).toString(), p);
+		if (! p)
+			c->setParent(root);
+		channels.insert(c->iId, c);
+		c->bInheritACL = query.value(2).toBool();
+		kids << c;
+	}
+	query.finish();
+
+	foreach(Channel *c, kids)
+		readPerParent(db, c, root, channels);
+}
+
+static void readPerParentLinks(QSqlDatabase &db, QHash<int, Channel *> &channels) {
+	QSqlQuery query(db);
+	prepare(query, "SELECT `channel_id`, `link_id` FROM `%1channel_links` WHERE `server_id` = ?");
+	query.addBindValue(1);
+	exec(query);
+	while (query.next()) {
+		Channel *c = channels.value(query.value(0).toInt());
+		Channel *l = channels.value(query.value(1).toInt());
+		if (c && l)
+			c->link(l);
+	}
+}
+
+static void readLoader(QSqlDatabase &db, QObject *root, QHash<int, Channel *> &channels) {
+	QSqlQuery query(db);
+	ChannelLoader cl(channels, root);
+
+	prepare(query, ChannelLoader::sqlChannels);
+	query.addBindValue(1);
+	exec(query);
+	cl.addChannels(query);
+
+	prepare(query, ChannelLoader::sqlInfo);
+	query.addBindValue(1);
+	exec(query);
+	cl.addInfo(query);
+
+	prepare(query, ChannelLoader::sqlGroups);
+	query.addBindValue(1);
+	exec(query);
+	cl.addGroups(query);
+
+	prepare(query, ChannelLoader::sqlGroupMembers);
+	query.addBindValue(1);
+	exec(query);
+	cl.addGroupMembers(query);
+
+	prepare(query, ChannelLoader::sqlACL);
+	query.addBindValue(1);
+	exec(query);
+	cl.addACLs(query);
+
+	prepare(query, ChannelLoader::sqlLinks);
+	query.addBindValue(1);
+	exec(query);
+	cl.addLinks(query);
+}
+
+static QList<int> ids(const QList<Channel *> &list) {
+	QList<int> ql;
+	foreach(const Channel *c, list)
+		ql << c->iId;
+	return ql;
+}
+
+static QSet<int> ids(const QSet<Channel *> &set) {
+	QSet<int> qs;
+	foreach(const Channel *c, set)
+		qs.insert(c->iId);
+	return qs;
+}
+
+static int parentId(const Channel *c) {
+	return c->cParent ? c->cParent->iId : -1;
+}
+
+static bool sameACL(const ChanACL *a, const ChanACL *b) {
+	return (a->iUserId == b->iUserId) && (a->qsGroup == b->qsGroup) && (a->bApplyHere == b->bApplyHere) &&
+	       (a->bApplySubs == b->bApplySubs) && (a->pAllow == b->pAllow) && (a->pDeny == b->pDeny);
+}
+
+static bool sameACLs(const Channel *a, const Channel *b) {
+	if (a->qlACL.count() != b->qlACL.count())
+		return false;
+	for (int i=0;i<a->qlACL.count();++i)
+		if (! sameACL(a->qlACL.at(i), b->qlACL.at(i)))
+			return false;
+	return true;
+}
+
+static bool sameGroups(const Channel *a, const Channel *b) {
+	if (a->qhGroups.count() != b->qhGroups.count())
+		return false;
+	foreach(const Group *g, a->qhGroups) {
+		const Group *h = b->qhGroups.value(g->qsName);
+		if (! h || (g->bInherit != h->bInherit) || (g->bInheritable != h->bInheritable) ||
+		        (g->qsAdd != h->qsAdd) || (g->qsRemove != h->qsRemove))
+			return false;
+	}
+	return true;
+}
+
+/// Returns the number of channels that differ between the two trees.
+static int compare(const QHash<int, Channel *> &before, const QHash<int, Channel *> &after) {
+	int mismatches = 0;
+
+	QList<Channel *> roots;
+	foreach(Channel *c, before)
+		if (! c->cParent)
+			roots << c;
+	QList<Channel *> afterRoots;
+	foreach(Channel *c, after)
+		if (! c->cParent)
+			afterRoots << c;
+	if (ids(roots).toSet() != ids(afterRoots).toSet()) {
+		qWarning("Root channels differ");
+		++mismatches;
+	}
+
+	foreach(const Channel *a, before) {
+		const Channel *b = after.value(a->iId);
+		const char *what = NULL;
+
+		if (! b)
+			what = "missing";
+		else if (a->qsName != b->qsName)
+			what = "name";
+		else if (parentId(a) != parentId(b))
+			what = "parent";
+		else if (a->bInheritACL != b->bInheritACL)
+			what = "inheritacl";
+		else if (a->qsDesc != b->qsDesc)
+			what = "description";
+		else if (a->iPosition != b->iPosition)
+			what = "position";
+		else if (ids(a->qlChannels) != ids(b->qlChannels))
+			what = "children";
+		else if (! sameGroups(a, b))
+			what = "groups";
+		else if (! sameACLs(a, b))
+			what = "acl";
+		else if (ids(a->qsPermLinks) != ids(b->qsPermLinks))
+			what = "links";
+
+		if (what) {
+			qWarning("Channel %d differs: %s", a->iId, what);
+			++mismatches;
+		}
+	}
+
+	foreach(const Channel *b, after)
+		if (! before.contains(b->iId)) {
+			qWarning("Channel %d differs: unexpected", b->iId);
+			++mismatches;
+		}
+
+	return mismatches;
+}
+
+static void report(const char *name, QSqlDatabase &db, bool loader, double rtt, QObject *root, QHash<int, Channel *> &channels) {
+	iQueries = 0;
+
+	Timer t;
+	db.transaction();
+	if (loader) {
+		readLoader(db, root, channels);
+	} else {
+		readPerParent(db, NULL, root, channels);
+		readPerParentLinks(db, channels);
+	}
+	db.commit();
+	const quint64 elapsed = t.elapsed();
+
+	qWarning("%-10s %5d channels %6d queries %8.2f ms  at %.2f ms round trip: %8.1f ms", name,
+	         channels.count(), iQueries, static_cast<double>(elapsed) / 1000.0,
+	         rtt, static_cast<double>(elapsed) / 1000.0 + iQueries * rtt);
+}
+
+int main(int argc, char **argv) {
+	QCoreApplication a(argc, argv);
+
+	const double rtt = (argc > 1) ? QString::fromLatin1(argv[1]).toDouble() : 0.5;
+
+	QSqlDatabase db = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"));
+	db.setDatabaseName(QLatin1String(":memory:"));
+	if (! db.open())
+		qFatal("%s", qPrintable(db.lastError().text()));
+
+	generate(db);
+
+	QObject before, after;
+	QHash<int, Channel *> qhBefore, qhAfter;
+
+	report("per-parent", db, false, rtt, &before, qhBefore);
+	report("loader", db, true, rtt, &after, qhAfter);
+
+	if (qhBefore.count() != CHANNELS) {
+		qWarning("Read %d of %d channels", qhBefore.count(), CHANNELS);
+		return 1;
+	}
+
+	const int mismatches = compare(qhBefore, qhAfter);
+	if (mismatches) {
+		qWarning("%d channels differ", mismatches);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,14 @@
+include(../mumble.pri)
+
+TEMPLATE = app
+CONFIG += qt thread warn_on release
+CONFIG -= app_bundle
+QT *= network sql
+QT -= gui
+LANGUAGE = C++
+TARGET = BootLoad
+DEFINES *= MURMUR
+HEADERS *= ChannelLoader.h
+SOURCES *= BootLoad.cpp ChannelLoader.cpp
+VPATH += ../murmur
+INCLUDEPATH += ../murmur
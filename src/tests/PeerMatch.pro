@@ -0,0 +1,10 @@
+TEMPLATE = app
+CONFIG += qt thread warn_on release
+CONFIG -= app_bundle
+LANGUAGE = C++
+TARGET = PeerMatch
+HEADERS = Timer.h CryptState.h
+SOURCES = PeerMatch.cpp CryptState.cpp Timer.cpp
+VPATH += ..
+INCLUDEPATH += .. ../murmur ../mumble
+LIBS	+= -lcrypto
@@ -0,0 +1,124 @@
+/**
+ * Measures the per-query cost of the statements the server runs most often
+ * on an SQLite database, when every call prepares its SQL anew (as
+ * ServerDB::prepare() used to) and when it goes through StatementCache the
+ * way ServerDB::prepare() and TransactionHolder do now: the statement is
+ * looked up by its unformatted SQL, bound, executed and released again.
+ */
+
+#include <QtCore>
+#include <QtSql>
+
+#include "StatementCache.h"
+#include "Timer.h"
+
+#define ITER 20000
+#define USERS 1000
+
+struct Statement {
+	const char *name;
+	const char *sql;
+	int binds;
+};
+
+static const Statement statements[] = {
+	{ "getUserName", "SELECT `name` FROM `%1users` WHERE `server_id` = ? AND `user_id` = ?", 2 },
+	{ "setLastChannel", "UPDATE `%1users` SET `lastchannel`=? WHERE `server_id` = ? AND `user_id` = ?", 3 },
+	{ "dblog", "INSERT INTO `%1slog` (`server_id`, `msg`) VALUES(?,?)", 2 },
+};
+
+static const QString prefix = QLatin1String("murmur_");
+
+static void bind(QSqlQuery &query, const Statement &st, int i) {
+	if (st.binds == 3)
+		query.addBindValue(i % 100);
+	query.addBindValue(1);
+	if (qstrcmp(st.name, "dblog") == 0)
+		query.addBindValue(QString::fromLatin1("<%1:user%1(%1)> Moved to channel").arg(i % USERS));
+	else
+		query.addBindValue(i % USERS);
+}
+
+static void run(QSqlQuery &query) {
+	if (! query.exec())
+		qFatal("%s", qPrintable(query.lastError().text()));
+	while (query.next())
+		;
+}
+
+static quint64 uncached(QSqlDatabase &db, const Statement &st) {
+	Timer t;
+	for (int i=0;i<ITER;++i) {
+		QSqlQuery query(db);
+		query.prepare(QString::fromLatin1(st.sql).arg(prefix));
+		bind(query, st, i);
+		run(query);
+	}
+	return t.elapsed();
+}
+
+static quint64 cached(QSqlDatabase &db, const Statement &st, int &hits) {
+	StatementCache sc;
+	QSqlQuery query(db);
+	hits = 0;
+
+	Timer t;
+	for (int i=0;i<ITER;++i) {
+		// ServerDB::prepare()
+		const QString key = QLatin1String(st.sql);
+		sc.release(query);
+		if (sc.acquire(query, key)) {
+			++hits;
+		} else {
+			query = QSqlQuery(db);
+			query.prepare(key.arg(prefix));
+			sc.insert(key, query);
+		}
+		bind(query, st, i);
+		run(query);
+	}
+	// ~TransactionHolder()
+	sc.release(query);
+	return t.elapsed();
+}
+
+int main(int argc, char **argv) {
+	QCoreApplication a(argc, argv);
+
+	QSqlDatabase db = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"));
+	db.setDatabaseName(QLatin1String(":memory:"));
+	if (! db.open())
+		qFatal("%s", qPrintable(db.lastError().text()));
+
+	QSqlQuery query(db);
+	query.exec(QString::fromLatin1("CREATE TABLE `%1users` (`server_id` INTEGER NOT NULL, `user_id` INTEGER NOT NULL, `name` TEXT NOT NULL, `lastchannel` INTEGER, `last_active` DATE)").arg(prefix));
+	query.exec(QString::fromLatin1("CREATE UNIQUE INDEX `%1users_id` ON `%1users` (`server_id`, `user_id`)").arg(prefix));
+	query.exec(QString::fromLatin1("CREATE TABLE `%1slog` (`server_id` INTEGER NOT NULL, `msg` TEXT, `msgtime` DATE DEFAULT (datetime('now')))").arg(prefix));
+
+	db.transaction();
+	query.prepare(QString::fromLatin1("INSERT INTO `%1users` (`server_id`, `user_id`, `name`, `lastchannel`) VALUES (?,?,?,?)").arg(prefix));
+	for (int i=0;i<USERS;++i) {
+		query.addBindValue(1);
+		query.addBindValue(i);
+		query.addBindValue(QString::fromLatin1("user%1").arg(i));
+		query.addBindValue(0);
+		query.exec();
+	}
+	db.commit();
+	query.finish();
+
+	for (size_t i=0;i<sizeof(statements)/sizeof(statements[0]);++i) {
+		const Statement &st = statements[i];
+		const quint64 before = uncached(db, st);
+		int hits;
+		const quint64 after = cached(db, st, hits);
+		qWarning("%-16s prepare %6.2f us/query  cached %6.2f us/query  %d hits", st.name,
+		         static_cast<double>(before) / ITER, static_cast<double>(after) / ITER, hits);
+		if (hits != ITER - 1) {
+			qWarning("%s: expected %d cache hits", st.name, ITER - 1);
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,14 @@
+include(../mumble.pri)
+
+TEMPLATE = app
+CONFIG += qt thread warn_on release
+CONFIG -= app_bundle
+QT *= network sql
+QT -= gui
+LANGUAGE = C++
+TARGET = SQLStatements
+DEFINES *= MURMUR
+HEADERS *= StatementCache.h
+SOURCES *= SQLStatements.cpp StatementCache.cpp
+VPATH += ../murmur
+INCLUDEPATH += ../murmur
@@ -12,6 +12,8 @@ class TestCrypt : public QObject {
 		void ivrecovery();
 		void reverserecovery();
 		void tamper();
+		void backends();
+		void multi();
 };
 
 void TestCrypt::reverserecovery() {
@@ -202,5 +204,108 @@ void TestCrypt::tamper() {
 	QVERIFY(cs.decrypt(encrypted, decrypted, len+4));
 }
 
+void TestCrypt::backends() {
+	const unsigned char rawkey[AES_BLOCK_SIZE] = {0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0x0a,0x0b,0x0c,0x0d,0x0e,0x0f};
+	const unsigned char blanktag[AES_BLOCK_SIZE] = {0xBF,0x31,0x08,0x13,0x07,0x73,0xAD,0x5E,0xC7,0x0E,0xC6,0x9E,0x78,0x75,0xA7,0xB0};
+	const unsigned char longtag[AES_BLOCK_SIZE] = {0x9D,0xB0,0xCD,0xF8,0x80,0xF7,0x3E,0x3E,0x10,0xD4,0xEB,0x32,0x17,0x76,0x66,0x88};
+	const unsigned char crypted[40] = {0xF7,0x5D,0x6B,0xC8,0xB4,0xDC,0x8D,0x66,0xB8,0x36,0xA2,0xB0,0x8B,0x32,0xA6,0x36,0x9F,0x1C,0xD3,0xC5,0x22,0x8D,0x79,0xFD,
+	                                   0x6C,0x26,0x7F,0x5F,0x6A,0xA7,0xB2,0x31,0xC7,0xDF,0xB9,0xD5,0x99,0x51,0xAE,0x9C
+	                                  };
+
+	// Known answers from draft-krovetz-ocb-00.txt for every backend.
+	const CryptState::Backend backends[2] = { CryptState::Reference, CryptState::OpenSSLEVP };
+	for (int b=0;b<2;b++) {
+		CryptState cs;
+		cs.setBackend(backends[b]);
+		cs.setKey(rawkey, rawkey, rawkey);
+		QCOMPARE(cs.backend(), backends[b]);
+
+		unsigned char tag[AES_BLOCK_SIZE];
+		cs.ocb_encrypt(NULL, NULL, 0, rawkey, tag);
+		QVERIFY(memcmp(tag, blanktag, AES_BLOCK_SIZE) == 0);
+
+		unsigned char source[40];
+		unsigned char crypt[40];
+		for (int i=0;i<40;i++)
+			source[i]=i;
+		cs.ocb_encrypt(source, crypt, 40, rawkey, tag);
+		QVERIFY(memcmp(tag, longtag, AES_BLOCK_SIZE) == 0);
+		QVERIFY(memcmp(crypt, crypted, 40) == 0);
+	}
+
+	// Both backends must agree for every length, including more blocks than
+	// fit into one batch of the accelerated backend.
+	CryptState ref, evp;
+	ref.setBackend(CryptState::Reference);
+	evp.setBackend(CryptState::OpenSSLEVP);
+	ref.setKey(rawkey, rawkey, rawkey);
+	evp.setKey(rawkey, rawkey, rawkey);
+
+	const unsigned int maxlen = 1100;
+	unsigned char src[maxlen], refenc[maxlen], evpenc[maxlen], evpdec[maxlen];
+	unsigned char nonce[AES_BLOCK_SIZE], reftag[AES_BLOCK_SIZE], evptag[AES_BLOCK_SIZE], dectag[AES_BLOCK_SIZE];
+	for (unsigned int len=0;len<maxlen;len++) {
+		for (unsigned int i=0;i<len;i++)
+			src[i] = static_cast<unsigned char>(qrand());
+		for (int i=0;i<AES_BLOCK_SIZE;i++)
+			nonce[i] = static_cast<unsigned char>(qrand());
+
+		ref.ocb_encrypt(src, refenc, len, nonce, reftag);
+		evp.ocb_encrypt(src, evpenc, len, nonce, evptag);
+		QVERIFY(memcmp(refenc, evpenc, len) == 0);
+		QVERIFY(memcmp(reftag, evptag, AES_BLOCK_SIZE) == 0);
+
+		evp.ocb_decrypt(refenc, evpdec, len, nonce, dectag);
+		QVERIFY(memcmp(src, evpdec, len) == 0);
+		QVERIFY(memcmp(reftag, dectag, AES_BLOCK_SIZE) == 0);
+	}
+
+	// And interoperate through the packet interface.
+	const unsigned char msg[] = "It was a funky funky town!";
+	int len = sizeof(msg);
+	unsigned char encrypted[len+4];
+	unsigned char decrypted[len];
+	evp.encrypt(msg, encrypted, len);
+	QVERIFY(ref.decrypt(encrypted, decrypted, len+4));
+	QVERIFY(memcmp(msg, decrypted, len) == 0);
+}
+
+void TestCrypt::multi() {
+	const unsigned int count = CRYPT_MULTI + 3;
+	CryptState *states[count];
+	CryptState *single[count];
+	for (unsigned int i=0;i<count;i++) {
+		states[i] = new CryptState();
+		states[i]->genKey();
+		single[i] = new CryptState();
+		single[i]->setKey(states[i]->raw_key, states[i]->encrypt_iv, states[i]->decrypt_iv);
+	}
+	// Mixed backends have to be handled too.
+	states[2]->setBackend(CryptState::Reference);
+
+	const unsigned int maxlen = 300;
+	unsigned char src[maxlen];
+	unsigned char manyenc[count][maxlen+4], singleenc[maxlen+4];
+	unsigned char *dst[count];
+	for (unsigned int i=0;i<count;i++)
+		dst[i] = manyenc[i];
+
+	for (unsigned int len=0;len<maxlen;len++) {
+		for (unsigned int i=0;i<len;i++)
+			src[i] = static_cast<unsigned char>(qrand());
+
+		CryptState::encryptMany(states, src, dst, len, count);
+		for (unsigned int i=0;i<count;i++) {
+			single[i]->encrypt(src, singleenc, len);
+			QVERIFY(memcmp(manyenc[i], singleenc, len+4) == 0);
+		}
+	}
+
+	for (unsigned int i=0;i<count;i++) {
+		delete states[i];
+		delete single[i];
+	}
+}
+
 QTEST_MAIN(TestCrypt)
 #include "TestCrypt.moc"